@@ -0,0 +1,306 @@
+#!/usr/bin/env python3
+"""
+Controller Pool
+Drives several Teensy boards from one process
+
+Each board gets its own DualMotorController (serial port, reader thread and
+flow control) plus a dedicated worker thread. The worker is the board's
+command queue: post() hands a group to every board's worker and returns,
+and each board reports back on its own, so a board busy with a long command
+(a STOP ramp) only delays what was posted to it. A setpoint posted behind
+one the board has not started yet replaces it instead of queueing.
+
+Stops never wait in these queues: stop() drops every group a board has not
+started and sends STOP/ESTOP from the calling thread, which also cuts short
+a group still being sent (DualMotorController.stop_now).
+
+Boards are configured by name. A board spec is a Teensy USB serial number
+(matched against the ports found by discover_teensy_ports), an explicit
+port ('/dev/ttyACM1', 'sim://'), or None for the first Teensy nobody else
+claimed.
+
+Author: Daniel Khito
+Date: 2025
+"""
+
+import threading
+import time
+from concurrent.futures import Future, ThreadPoolExecutor
+from typing import Callable, Dict, List, Optional
+
+from motor_controller import DualMotorController, SIM_PORT
+
+TEENSY_USB_VID = 0x16C0        # PJRC
+FALLBACK_PORT = '/dev/ttyACM0'  # Used when discovery finds nothing for a None spec
+
+
+def discover_teensy_ports() -> Dict[str, str]:
+    """USB serial number -> device for every Teensy on the bus"""
+    try:
+        from serial.tools import list_ports
+    except ImportError:
+        return {}
+    return {p.serial_number: p.device for p in list_ports.comports()
+            if p.vid == TEENSY_USB_VID and p.serial_number}
+
+
+def resolve_ports(boards: Dict[str, Optional[str]]) -> Dict[str, str]:
+    """Map board names to ports (see module docstring for spec formats)"""
+    found = discover_teensy_ports()
+    claimed = set()
+    ports = {}
+
+    for name, spec in boards.items():
+        if spec is None:
+            continue
+        if spec.startswith('/') or spec.startswith(SIM_PORT) or spec.upper().startswith('COM'):
+            ports[name] = spec
+        elif spec in found:
+            ports[name] = found[spec]
+        else:
+            raise RuntimeError(f"No Teensy with USB serial number {spec} for board {name}")
+        claimed.add(ports[name])
+
+    unclaimed = sorted(port for port in found.values() if port not in claimed)
+    for name, spec in boards.items():
+        if spec is None:
+            ports[name] = unclaimed.pop(0) if unclaimed else FALLBACK_PORT
+    return {name: ports[name] for name in boards}
+
+
+class PostedGroup:
+    """One post(): the commands and what the boards reported so far"""
+    __slots__ = ('commands', 'done', 'remaining', 'sent_at')
+
+    def __init__(self, commands: List[str], done, boards: int):
+        self.commands = commands
+        self.done = done
+        self.remaining = boards
+        self.sent_at: List[float] = []
+
+
+class ControllerPool:
+    """Named DualMotorControllers with one I/O worker each"""
+
+    def __init__(self, boards: Dict[str, Optional[str]],
+                 factory: Callable[[str], DualMotorController] = DualMotorController):
+        """
+        Args:
+            boards: Board name -> USB serial number, port or None
+            factory: Builds a controller for a port
+        """
+        self.ports = resolve_ports(boards)
+        self.controllers: Dict[str, DualMotorController] = {
+            name: factory(port) for name, port in self.ports.items()}
+        self.workers: Dict[str, ThreadPoolExecutor] = {
+            name: ThreadPoolExecutor(max_workers=1, thread_name_prefix=f"board-{name}")
+            for name in self.ports}
+        # Setpoint slot each board has queued but not started, if it is
+        # still last in that board's queue (see post)
+        self.open_setpoints: Dict[str, Optional[list]] = {}
+        self.queued: Dict[str, List[list]] = {name: [] for name in self.ports}  # Not started
+        self.lock = threading.Lock()
+        # Spread of the first serial write across the boards of the last
+        # group, and a callback for each new value
+        self.last_fan_out_skew = 0.0
+        self.skew_callback: Optional[Callable[[float], None]] = None
+
+    @property
+    def names(self) -> List[str]:
+        return list(self.controllers)
+
+    def __len__(self) -> int:
+        return len(self.controllers)
+
+    def items(self):
+        return self.controllers.items()
+
+    def connect(self) -> bool:
+        """Connect every board concurrently; True only if all connected"""
+        results = self.call('connect')
+        for name, ok in results.items():
+            if not ok:
+                print(f"✗ Board {name} ({self.ports[name]}) failed to connect")
+        return all(results.values())
+
+    def disconnect(self):
+        self.call('disconnect')
+        for worker in self.workers.values():
+            worker.shutdown(wait=False)
+
+    def submit(self, name: str, fn: Callable, *args) -> Future:
+        """Run fn(controller, *args) on one board's worker"""
+        return self.workers[name].submit(fn, self.controllers[name], *args)
+
+    def call(self, method: str, *args, names: Optional[List[str]] = None) -> Dict[str, object]:
+        """Call a DualMotorController method on several boards (default all) concurrently"""
+        names = names or self.names
+        futures = {name: self.submit(name, getattr(DualMotorController, method), *args)
+                   for name in names}
+        results = {}
+        for name, future in futures.items():
+            try:
+                results[name] = future.result()
+            except Exception as e:
+                print(f"Board {name}: {method} failed - {e}")
+                results[name] = None
+        return results
+
+    def send(self, name: str, commands: List[str]) -> Optional[str]:
+        """Pipeline commands to one board and wait for the last ACK"""
+        return self.submit(name, DualMotorController.send_commands, commands).result()
+
+    def post(self, commands: List[str], names: Optional[List[str]] = None,
+             coalesce: bool = False,
+             done: Optional[Callable[[str, Optional[str], bool], None]] = None):
+        """Queue commands on several boards (default all) without waiting
+        
+        Args:
+            commands: Sent to each board as one pipelined group
+            names: Boards to send to
+            coalesce: A setpoint; replaces one the board has not started
+                that is still last in its queue
+            done: Called as done(name, response, superseded) on each board's
+                worker when it finishes; response is None on failure,
+                superseded is True if the group was dropped unsent (a newer
+                setpoint or a stop)
+        """
+        names = names or self.names
+        group = PostedGroup(commands, done, len(names))
+        dropped = []
+        with self.lock:
+            for name in names:
+                slot = self.open_setpoints.get(name)
+                if slot is not None and coalesce:
+                    dropped.append((name, slot[0]))
+                    slot[0] = group
+                    continue
+                slot = [group]
+                self.open_setpoints[name] = slot if coalesce else None
+                self.queued[name].append(slot)
+                self.workers[name].submit(self._run_posted, name, slot)
+        for name, stale in dropped:
+            self._finish(name, stale, None, superseded=True)
+
+    def _run_posted(self, name: str, slot: list):
+        with self.lock:
+            group, slot[0] = slot[0], None
+            if slot in self.queued[name]:
+                self.queued[name].remove(slot)
+            if self.open_setpoints.get(name) is slot:
+                self.open_setpoints[name] = None
+        if group is None:
+            return  # A stop dropped it
+        controller = self.controllers[name]
+        try:
+            response = controller.send_commands(group.commands)
+        except Exception as e:
+            print(f"Board {name}: send failed - {e}")
+            response = None
+        self._finish(name, group, response,
+                     sent_at=controller.group_sent_at if response is not None else None)
+
+    def _finish(self, name: str, group: PostedGroup, response: Optional[str],
+                superseded: bool = False, sent_at: Optional[float] = None):
+        """One board is done with a group; the last one records the skew"""
+        with self.lock:
+            group.remaining -= 1
+            if sent_at is not None:
+                group.sent_at.append(sent_at)
+            last = group.remaining == 0
+        if last and len(group.sent_at) > 1:
+            self.last_fan_out_skew = max(group.sent_at) - min(group.sent_at)
+            if self.skew_callback:
+                self.skew_callback(self.last_fan_out_skew)
+        if group.done:
+            group.done(name, response, superseded)
+
+    def stop(self, names: Optional[List[str]] = None, emergency: bool = False) -> Dict[str, bool]:
+        """STOP (or ESTOP) several boards (default all) from this thread
+        
+        Skips the workers, which may be busy with a group for seconds: every
+        group a board has not started is dropped, the stop is written to
+        each board in turn, then the ACKs are collected. True per board
+        that ACKed.
+        """
+        names = names or self.names
+        dropped = []
+        with self.lock:
+            for name in names:
+                for slot in self.queued[name]:
+                    dropped.append((name, slot[0]))
+                    slot[0] = None
+                self.queued[name].clear()
+                self.open_setpoints[name] = None
+        sent = {}
+        for name in names:
+            try:
+                sent[name] = self.controllers[name].stop_now(emergency)
+            except Exception as e:
+                print(f"Board {name}: stop failed - {e}")
+                sent[name] = None
+        for name, stale in dropped:
+            self._finish(name, stale, None, superseded=True)
+        return {name: self.controllers[name].wait_for(pending) is not None
+                for name, pending in sent.items()}
+
+    def fan_out(self, commands: List[str], names: Optional[List[str]] = None) -> Dict[str, Optional[str]]:
+        """Send the same commands to several boards (default all) and wait for all"""
+        names = names or self.names
+        results: Dict[str, Optional[str]] = {}
+        finished = threading.Event()
+
+        def done(name, response, superseded):
+            results[name] = response
+            if len(results) == len(names):
+                finished.set()
+
+        self.post(commands, names, done=done)
+        finished.wait()
+        return results
+
+    @property
+    def credits(self) -> int:
+        """Credits of the most constrained board"""
+        return min(controller.credits for controller in self.controllers.values())
+
+    @property
+    def backlog(self) -> int:
+        """Posted groups waiting on the busiest board"""
+        return max((len(slots) for slots in self.queued.values()), default=0)
+
+    def stat_total(self, key: str) -> float:
+        """A DualMotorController.stats entry summed over boards"""
+        return sum(controller.stats[key] for controller in self.controllers.values())
+
+
+def main():
+    """Aggregate command throughput as simulated boards are added"""
+    import argparse
+    parser = argparse.ArgumentParser(description="Controller pool throughput benchmark")
+    parser.add_argument('--boards', type=int, default=4, help='Largest pool to try')
+    parser.add_argument('--seconds', type=float, default=3.0, help='Run time per pool size')
+    parser.add_argument('--batch', type=int, default=5, help='Commands per group send')
+    args = parser.parse_args()
+
+    # A MOVE-sized group: speed and direction for both motors, then RUN
+    group = ["M1:SPEED:3000", "M2:SPEED:3000", "M1:FORWARD", "M2:FORWARD", "RUN"][:args.batch]
+    print(f"{'boards':>6} {'groups/s':>9} {'cmds/s':>9} {'mean skew us':>13}")
+    for count in range(1, args.boards + 1):
+        pool = ControllerPool({f"sim{i}": SIM_PORT for i in range(count)})
+        if not pool.connect():
+            return
+        groups, skew = 0, 0.0
+        start = time.perf_counter()
+        while time.perf_counter() - start < args.seconds:
+            pool.fan_out(group)
+            groups += 1
+            skew += pool.last_fan_out_skew
+        elapsed = time.perf_counter() - start
+        pool.disconnect()
+        print(f"{count:>6} {groups / elapsed:>9.1f} {groups * len(group) * count / elapsed:>9.1f} "
+              f"{skew / groups * 1e6:>13.0f}")
+
+
+if __name__ == "__main__":
+    main()
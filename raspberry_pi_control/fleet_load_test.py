@@ -0,0 +1,180 @@
+#!/usr/bin/env python3
+"""
+Fleet Load Test
+How the command/telemetry stack scales with the number of boards, before a
+central server supervises a fleet of robots
+
+Each step of the sweep boots a SimFleet of virtual Teensys on shared clock
+threads and drives it through a ControllerPool, exactly as a server would
+drive real boards: one DualMotorController (reader and writer threads,
+credit flow control) plus one worker per board. Every board cruises with
+telemetry streaming while its worker sends SPEED setpoints at --rate, each
+waiting for its ACK.
+
+Reported per fleet size:
+    - setpoints/s ACKed, against the rate offered
+    - setpoint latency p50/p95/p99: send_command() call to ACK, so it
+      includes batching, credit waits and thread hand-offs
+    - telemetry frames/s, against the rate asked for, and frame age
+      p50/p99 (firmware millis() to the callback, +-1 ms)
+    - sim lag and busy: how far the simulators fell behind the wall clock
+      and the share of the clock threads' time spent advancing them. A large
+      lag means the host ran out of CPU for the simulators themselves and
+      the numbers above are pessimistic.
+
+Usage:
+    python3 fleet_load_test.py                          # 1..200 boards
+    python3 fleet_load_test.py --boards 1,50,100,200,400 --rate 20
+    python3 fleet_load_test.py --telemetry-ms 20 --json fleet.json
+
+Author: Daniel Khito
+Date: 2025
+"""
+
+import argparse
+import contextlib
+import io
+import json
+import sys
+import threading
+import time
+from typing import Dict, List
+
+from controller_pool import ControllerPool
+from teensy_sim import SimFleet
+from trace_compare import percentile
+
+DEFAULT_BOARDS = '1,10,50,100,200'
+DEFAULT_RATE = 20.0          # Setpoints/s per board
+DEFAULT_TELEMETRY_MS = 50
+DEFAULT_SECONDS = 5.0
+CRUISE_SPEED = 2000          # Setpoints alternate around this
+SETPOINT_SWING = 500
+
+
+def _setpoint_loop(controller, rate: float, until: float, latencies: List[float]) -> int:
+    """Runs on a board's worker: SPEED setpoints at rate until the deadline"""
+    period = 1.0 / rate
+    next_at = time.perf_counter()
+    sent = failed = 0
+    while True:
+        now = time.perf_counter()
+        if now >= until:
+            break
+        if now < next_at:
+            time.sleep(next_at - now)
+        speed = CRUISE_SPEED + (SETPOINT_SWING if sent % 2 else -SETPOINT_SWING)
+        started = time.perf_counter()
+        if controller.send_command(f"SPEED:{speed}") is None:
+            failed += 1
+        else:
+            latencies.append(time.perf_counter() - started)
+        sent += 1
+        # Late sends go out back to back but never in a burst to catch up
+        next_at = max(next_at + period, time.perf_counter() - period)
+    return failed
+
+
+def run(boards: int, seconds: float, rate: float, telemetry_ms: int,
+        workers: int = None) -> Dict:
+    """One fleet size; returns its row of the report"""
+    fleet = SimFleet(boards, name=f"load{boards}", workers=workers)
+    pool = ControllerPool({f"bot{i}": port for i, port in enumerate(fleet.port_names)})
+    try:
+        with contextlib.redirect_stdout(io.StringIO()):
+            connected = pool.connect()
+        if not connected:
+            raise RuntimeError(f"Not every board in a fleet of {boards} connected")
+
+        frames = [0]
+        ages: List[float] = []
+
+        def on_frame(index):
+            def callback(frame):
+                frames[0] += 1
+                ages.append(fleet.age(index, frame['millis']))
+            return callback
+
+        for i, (name, controller) in enumerate(pool.items()):
+            pool.submit(name, lambda c, i=i: c.start_telemetry(telemetry_ms, on_frame(i)))
+        pool.call('move_forward', CRUISE_SPEED)
+        time.sleep(0.2)   # First frames are in; start counting from here
+        frames[0] = 0
+        ages.clear()
+        fleet.max_lag_s = 0.0   # Boot and connect spikes are not part of the run
+        acks_before = pool.stat_total('acks')
+
+        latencies: List[float] = []
+        started = time.perf_counter()
+        until = started + seconds
+        futures = [pool.submit(name, _setpoint_loop, rate, until, latencies)
+                   for name in pool.names]
+        failed = sum(future.result() for future in futures)
+        elapsed = time.perf_counter() - started
+        telemetry_frames = frames[0]
+        frame_ages = list(ages)
+
+        return {
+            'boards': boards,
+            'setpoints_per_s': round(len(latencies) / elapsed, 1),
+            'offered_per_s': round(boards * rate, 1),
+            'setpoint_failures': failed,
+            'latency_ms': {p: round(percentile(latencies, int(p[1:])) * 1000, 2)
+                           for p in ('p50', 'p95', 'p99')} if latencies else None,
+            'telemetry_per_s': round(telemetry_frames / elapsed, 1),
+            'telemetry_expected_per_s': round(boards * 1000 / telemetry_ms, 1),
+            'frame_age_ms': {p: round(percentile(frame_ages, int(p[1:])) * 1000, 1)
+                             for p in ('p50', 'p99')} if frame_ages else None,
+            'acks': int(pool.stat_total('acks') - acks_before),
+            'ack_timeouts': int(pool.stat_total('ack_timeouts')),
+            'sim_lag_ms': round(fleet.max_lag_s * 1000, 1),
+            'sim_busy': round(fleet.busy, 3),
+            'threads': threading.active_count(),
+        }
+    finally:
+        with contextlib.redirect_stdout(io.StringIO()):
+            pool.disconnect()
+        fleet.close()
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description="Command/telemetry throughput as the fleet grows")
+    parser.add_argument('--boards', default=DEFAULT_BOARDS,
+                        help='Comma-separated fleet sizes to try')
+    parser.add_argument('--seconds', type=float, default=DEFAULT_SECONDS,
+                        help='Measured run time per fleet size')
+    parser.add_argument('--rate', type=float, default=DEFAULT_RATE, help='Setpoints/s per board')
+    parser.add_argument('--telemetry-ms', type=int, default=DEFAULT_TELEMETRY_MS,
+                        help='Telemetry interval per board')
+    parser.add_argument('--workers', type=int, help='Simulator clock threads (default: one per CPU)')
+    parser.add_argument('--json', help='Write the report here')
+    args = parser.parse_args()
+
+    sizes = [int(size) for size in args.boards.split(',')]
+    rows = []
+    print(f"{'boards':>6} {'setpts/s':>9} {'offered':>8} {'p50 ms':>7} {'p95 ms':>7} {'p99 ms':>7} "
+          f"{'tel/s':>8} {'asked':>7} {'age p99':>8} {'lag ms':>7} {'busy':>5} {'threads':>7}")
+    for size in sizes:
+        row = run(size, args.seconds, args.rate, args.telemetry_ms, args.workers)
+        rows.append(row)
+        latency = row['latency_ms'] or {'p50': 0, 'p95': 0, 'p99': 0}
+        age = row['frame_age_ms'] or {'p99': 0}
+        print(f"{row['boards']:>6} {row['setpoints_per_s']:>9.1f} {row['offered_per_s']:>8.1f} "
+              f"{latency['p50']:>7.2f} {latency['p95']:>7.2f} {latency['p99']:>7.2f} "
+              f"{row['telemetry_per_s']:>8.1f} {row['telemetry_expected_per_s']:>7.1f} "
+              f"{age['p99']:>8.1f} {row['sim_lag_ms']:>7.1f} {row['sim_busy']:>5.0%} "
+              f"{row['threads']:>7}")
+        if row['setpoint_failures'] or row['ack_timeouts']:
+            print(f"       {row['setpoint_failures']} setpoints failed, "
+                  f"{row['ack_timeouts']} ACK timeouts")
+
+    if args.json:
+        with open(args.json, 'w') as f:
+            json.dump({'rate': args.rate, 'telemetry_ms': args.telemetry_ms,
+                       'seconds': args.seconds, 'results': rows}, f, indent=2)
+        print(f"Report written to {args.json}")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
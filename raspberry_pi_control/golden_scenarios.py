@@ -0,0 +1,311 @@
+#!/usr/bin/env python3
+"""
+Golden-Scenario Motion Regression Suite
+Runs scripted motion scenarios (joystick sweep, boost spin, e-stop at max
+speed, rapid reversal, a PVT path, ...) through the host simulator and checks each one
+against its recorded golden trace, so a change to updateSpeed/updateTimers
+or anything else on the motion path cannot alter motion unnoticed
+
+A golden (golden/<scenario>.json) holds both motors' positions every
+SAMPLE_MS, the final positions, the worst drift, each command's
+time-to-target and the p99 step period error. A scenario passes when:
+    - positions stay within POSITION_TOL steps (or POSITION_TOL_FRACTION of
+      the travel) of the golden trace at every sample
+    - final positions are within FINAL_TOL steps
+    - worst drift is at most DRIFT_SLACK steps above the golden's
+    - every time-to-target is within SETTLE_TOL_MS
+    - p99 period error is at most PERIOD_TOL_US above the golden's
+    - a PVT move passes every waypoint within WAYPOINT_TOL steps, on time
+      (checked against the points themselves, not the golden)
+Wall time and simulated steps per second are reported alongside, so an
+optimization shows its speed-up and its correctness in one run.
+
+Usage:
+    python3 golden_scenarios.py                      # check all; exit 1 on failure
+    python3 golden_scenarios.py --scenario boost_spin
+    python3 golden_scenarios.py --record             # (re)write the goldens
+    python3 golden_scenarios.py --firmware /tmp/other_main.cpp
+
+Author: Daniel Khito
+Date: 2025
+"""
+
+import argparse
+import json
+import math
+import os
+import sys
+import time
+from typing import Dict, List, Optional, Tuple
+
+from trace_compare import (MOTORS, PROFILE_BIN_S, Trace, capture, measured_rates, percentile,
+                           period_errors)
+
+GOLDEN_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'golden')
+GOLDEN_VERSION = 1
+
+SAMPLE_MS = round(PROFILE_BIN_S * 1000)  # Position sampling / rate bins (the ramp tick)
+SETTLE_BAND = 150           # steps/sec, or SETTLE_BAND_FRACTION of the target if larger
+SETTLE_BAND_FRACTION = 0.03
+MIN_SEGMENT_MS = 60         # Commands followed this soon by another get no time-to-target
+
+# Tolerances
+POSITION_TOL = 20           # Steps
+POSITION_TOL_FRACTION = 0.005
+FINAL_TOL = 5               # Steps
+DRIFT_SLACK = 10            # Steps
+SETTLE_TOL_MS = 30
+PERIOD_TOL_US = 5.0
+WAYPOINT_TOL = 0            # Steps, at each PVT point's time
+
+
+def pvt_path() -> Tuple[List[str], float]:
+    """PVT points for one sine period on motor 1 (15.7k steps/s peak) and
+    a smooth 12000-step move on motor 2, at uneven intervals so waypoints
+    fall between control ticks; ends still, back at 0 / 12000. Returns the
+    commands and the move's length in seconds."""
+    durations = [40, 37, 23, 50, 31, 10, 44, 60, 27, 33] * 3   # ms
+    length = sum(durations) / 1000
+    points, elapsed = [], 0
+    for duration in durations:
+        elapsed += duration
+        x = elapsed / 1000 / length
+        p1 = 2500 * math.sin(2 * math.pi * x)
+        v1 = 2500 * 2 * math.pi / length * math.cos(2 * math.pi * x)
+        p2 = 12000 * (3 * x ** 2 - 2 * x ** 3)
+        v2 = 12000 * 6 * (x - x ** 2) / length
+        if elapsed == sum(durations):
+            p1 = v1 = v2 = 0
+        points.append(f"PVT:{duration}:{round(p1)}:{v1:.0f}:{round(p2)}:{v2:.0f}")
+    return points, length
+
+
+PVT_POINTS, PVT_SECONDS = pvt_path()
+
+# name -> (description, [(command, seconds to run after it)])
+SCENARIOS: Dict[str, Tuple[str, List[Tuple[str, float]]]] = {
+    'ramp_up_down': ("Accelerate to 16k, slow to 2k, stop", [
+        ("CONFIG:ACCEL:8000", 0.0),
+        ("FORWARD", 0.0),
+        ("SPEED:16000", 0.0),
+        ("RUN", 2.5),
+        ("SPEED:2000", 2.0),
+        ("STOP", 0.5),
+    ]),
+    'joystick_sweep': ("Differential stick sweep at 10 Hz, as websocket_server sends it", [
+        ("CONFIG:ACCEL:16000", 0.0),
+        ("FORWARD", 0.0),
+    ] + [cmd for i in range(30) for cmd in (
+        (f"M1:SPEED:{2000 + i * 400}", 0.0),
+        (f"M2:SPEED:{14000 - i * 400}", 0.0),
+        ("RUN", 0.1),
+    )] + [("STOP", 0.5)]),
+    'boost_spin': ("Boosted spin left, settle to normal speed, stop", [
+        ("CONFIG:ACCEL:8000", 0.0),
+        ("CONFIG:BOOST:1.5:800:1", 0.0),
+        ("BOOST:LEFT:6000", 2.0),
+        ("STOP", 0.5),
+    ]),
+    'estop_max_speed': ("Full speed, then emergency stop", [
+        ("CONFIG:ACCEL:16000", 0.0),
+        ("FORWARD", 0.0),
+        ("SPEED:20000", 0.0),
+        ("RUN", 2.0),
+        ("ESTOP", 1.0),
+    ]),
+    'rapid_reversal': ("Reverse every 0.4 s at 8k", [
+        ("CONFIG:ACCEL:16000", 0.0),
+        ("FORWARD", 0.0),
+        ("SPEED:8000", 0.0),
+        ("RUN", 1.0),
+    ] + [("BACKWARD" if i % 2 == 0 else "FORWARD", 0.4) for i in range(8)] + [("STOP", 0.5)]),
+    'override_pause': ("Feed override down and up, pause and resume mid-move", [
+        ("CONFIG:ACCEL:8000", 0.0),
+        ("FORWARD", 0.0),
+        ("SPEED:10000", 0.0),
+        ("RUN", 1.5),
+        ("OVERRIDE:50", 1.0),
+        ("OVERRIDE:150", 1.0),
+        ("PAUSE", 1.5),
+        ("RESUME", 1.5),
+        ("OVERRIDE:100", 0.5),
+        ("STOP", 0.5),
+    ]),
+    'pvt_path': ("PVT sine and S-curve through 30 uneven waypoints", [
+        ("CONFIG:ACCEL:16000", 0.0),
+    ] + [(point, 0.0) for point in PVT_POINTS] + [("PVT:GO", PVT_SECONDS + 0.5)]),
+}
+
+
+def sample_positions(steps: List[Tuple[int, int]], samples: int) -> List[int]:
+    """Position at the start of every SAMPLE_MS slot"""
+    out, position, i = [], 0, 0
+    for n in range(samples):
+        t = n * SAMPLE_MS * 1_000_000
+        while i < len(steps) and steps[i][0] < t:
+            position += steps[i][1]
+            i += 1
+        out.append(position)
+    return out
+
+
+def waypoint_errors(trace: Trace, steps: List[Tuple[int, int]], axis: int) -> List[int]:
+    """Position minus each PVT point's, at the time the point is due (its
+    duration after the previous one, from PVT:GO); empty without a move"""
+    points, errors = [], []
+    for t, command in trace.events:
+        fields = command.split(':')
+        if command == 'PVT:GO':
+            due, position, i = t, 0, 0
+            for point in points:
+                due += int(point[1]) * 1_000_000
+                while i < len(steps) and steps[i][0] < due:
+                    position += steps[i][1]
+                    i += 1
+                errors.append(position - int(point[2 + 2 * axis]))
+            points = []
+        elif len(fields) == 6 and fields[0] == 'PVT':
+            points.append(fields)
+    return errors
+
+
+def settle_times(trace: Trace, rates: List[float]) -> List[Optional[int]]:
+    """
+    Milliseconds from each command until the step rate stays within the
+    settle band of the rate it ends that command's segment at, or None
+    when the segment is too short to tell
+    """
+    bins = len(rates)
+    starts = [t // 1_000_000 for t, _ in trace.events] + [bins * SAMPLE_MS]
+    out = []
+    for start_ms, end_ms in zip(starts, starts[1:]):
+        first, last = start_ms // SAMPLE_MS, min(end_ms // SAMPLE_MS, bins)
+        if (last - first) * SAMPLE_MS < MIN_SEGMENT_MS:
+            out.append(None)
+            continue
+        final = sum(rates[last - 3:last]) / 3
+        band = max(SETTLE_BAND, abs(final) * SETTLE_BAND_FRACTION)
+        settled = last
+        while settled > first and abs(rates[settled - 1] - final) <= band:
+            settled -= 1
+        out.append(max(0, settled * SAMPLE_MS - start_ms))
+    return out
+
+
+def summarize(trace: Trace) -> Dict:
+    """Everything a golden records about one run"""
+    end_ns = trace.changes[-1][0] if trace.changes else 0
+    samples = end_ns // (SAMPLE_MS * 1_000_000) + 2
+    result = {'positions': {}, 'settle_ms': {}, 'period_p99_us': {}, 'steps': {},
+              'waypoint_error': {}}
+    for axis, (name, step_pin, dir_pin) in enumerate(MOTORS):
+        steps = trace.steps(step_pin, dir_pin)
+        result['waypoint_error'][name] = waypoint_errors(trace, steps, axis)
+        result['positions'][name] = sample_positions(steps, samples)
+        rates = measured_rates(steps, samples)
+        result['settle_ms'][name] = settle_times(trace, rates)
+        result['period_p99_us'][name] = round(percentile([abs(e) for e in period_errors(steps)], 99), 2)
+        result['steps'][name] = len(steps)
+    p1, p2 = result['positions']['motor1'], result['positions']['motor2']
+    result['final'] = [p1[-1], p2[-1]]
+    result['max_drift'] = max((abs(a - b) for a, b in zip(p1, p2)), default=0)
+    return result
+
+
+def check(name: str, golden: Dict, run: Dict) -> List[str]:
+    """Failures of one run against its golden"""
+    failures = []
+    for motor, _, _ in MOTORS:
+        ref, got = golden['positions'][motor], run['positions'][motor]
+        travel = max((abs(p) for p in ref), default=0)
+        tol = max(POSITION_TOL, travel * POSITION_TOL_FRACTION)
+        n = min(len(ref), len(got))
+        worst = max(range(n), key=lambda i: abs(got[i] - ref[i]), default=0)
+        if n and abs(got[worst] - ref[worst]) > tol:
+            failures.append(f"{motor} position off by {got[worst] - ref[worst]} steps at "
+                            f"{worst * SAMPLE_MS} ms (tolerance {tol:.0f})")
+
+        for i, (ref_ms, got_ms) in enumerate(zip(golden['settle_ms'][motor], run['settle_ms'][motor])):
+            if ref_ms is not None and got_ms is not None and abs(got_ms - ref_ms) > SETTLE_TOL_MS:
+                command = golden['commands'][i][0]
+                failures.append(f"{motor} time-to-target after {command} (#{i}) {got_ms} ms, "
+                                f"golden {ref_ms} ms")
+
+        errors = run['waypoint_error'][motor]
+        worst = max(range(len(errors)), key=lambda i: abs(errors[i]), default=None)
+        if worst is not None and abs(errors[worst]) > WAYPOINT_TOL:
+            missed = sum(1 for error in errors if abs(error) > WAYPOINT_TOL)
+            failures.append(f"{motor} missed {missed} of {len(errors)} PVT waypoints, worst "
+                            f"#{worst} by {errors[worst]} steps (tolerance {WAYPOINT_TOL})")
+
+        limit = golden['period_p99_us'][motor] + PERIOD_TOL_US
+        if run['period_p99_us'][motor] > limit:
+            failures.append(f"{motor} p99 period error {run['period_p99_us'][motor]} us > {limit:.1f}")
+
+    for i, motor in enumerate(('motor1', 'motor2')):
+        if abs(run['final'][i] - golden['final'][i]) > FINAL_TOL:
+            failures.append(f"{motor} final position {run['final'][i]}, golden {golden['final'][i]}")
+    if run['max_drift'] > golden['max_drift'] + DRIFT_SLACK:
+        failures.append(f"max drift {run['max_drift']} steps, golden {golden['max_drift']}")
+    return failures
+
+
+def golden_path(name: str) -> str:
+    return os.path.join(GOLDEN_DIR, f"{name}.json")
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description="Golden-scenario motion regression suite")
+    parser.add_argument('--scenario', action='append', choices=sorted(SCENARIOS),
+                        help='Run only this scenario (repeatable)')
+    parser.add_argument('--record', action='store_true', help='Write new goldens instead of checking')
+    parser.add_argument('--firmware', help='main.cpp to build instead of the one in the tree')
+    args = parser.parse_args()
+
+    names = args.scenario or list(SCENARIOS)
+    failed = []
+    print(f"{'scenario':<18} {'result':<7} {'wall s':>7} {'sim steps/s':>12}")
+    for name in names:
+        description, commands = SCENARIOS[name]
+        started = time.perf_counter()
+        trace = capture(commands, args.firmware)
+        wall = time.perf_counter() - started
+        run = summarize(trace)
+        rate = sum(run['steps'].values()) / wall if wall else 0.0
+
+        if args.record:
+            os.makedirs(GOLDEN_DIR, exist_ok=True)
+            golden = {'scenario': name, 'version': GOLDEN_VERSION, 'description': description,
+                      'sample_ms': SAMPLE_MS, 'commands': commands, **run}
+            with open(golden_path(name), 'w') as f:
+                json.dump(golden, f, separators=(',', ':'))
+                f.write('\n')
+            print(f"{name:<18} {'saved':<7} {wall:>7.2f} {rate:>12.0f}")
+            continue
+
+        if not os.path.exists(golden_path(name)):
+            print(f"{name:<18} {'NO GOLDEN':<7}")
+            failed.append(name)
+            continue
+        with open(golden_path(name)) as f:
+            golden = json.load(f)
+        if [tuple(c) for c in golden['commands']] != [tuple(c) for c in commands]:
+            failures = ["scenario commands changed since the golden was recorded (--record)"]
+        else:
+            failures = check(name, golden, run)
+        print(f"{name:<18} {'FAIL' if failures else 'ok':<7} {wall:>7.2f} {rate:>12.0f}")
+        for failure in failures:
+            print(f"    {failure}")
+        if failures:
+            failed.append(name)
+
+    if failed:
+        print(f"\n{len(failed)} of {len(names)} scenarios failed: {', '.join(failed)}")
+        return 1
+    if not args.record:
+        print(f"\nAll {len(names)} scenarios match their goldens")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,149 @@
+#!/usr/bin/env python3
+"""
+Firmware Kernel Microbenchmarks
+Builds teensy_motor_control/host/kernel_bench.cpp (the real main.cpp on the
+Arduino shim), runs it and reports ns/op for the firmware's hot functions:
+command dispatch per verb and for a joystick session mix, updateSpeed per
+ramp regime, step period computation, the step ISRs, the sync check and
+status formatting (the kernels in teensy_motor_control/host/kernels.h)
+
+Host timings rank changes; they are not Cortex-M7 cycle counts.
+
+Usage:
+    python3 kernel_bench.py                           # all benchmarks
+    python3 kernel_bench.py --filter ramp/            # names containing ramp/
+    python3 kernel_bench.py --json out.json
+    python3 kernel_bench.py --baseline out.json       # exit 1 on regression
+
+Author: Daniel Khito
+Date: 2025
+"""
+
+import argparse
+import json
+import os
+import platform
+import subprocess
+import sys
+import time
+from typing import Dict, List, Optional
+
+from teensy_sim import BUILD_DIR, HOST_DIR, SOURCES
+from sync_benchmark import git_revision
+
+REPORT_VERSION = 1
+BENCH_SOURCE = os.path.join(HOST_DIR, 'kernel_bench.cpp')
+KERNELS = os.path.join(HOST_DIR, 'kernels.h')
+BENCH_BINARY = os.path.join(BUILD_DIR, 'kernel_bench')
+
+# Regression thresholds against a baseline report (host timings are noisy)
+NS_TOLERANCE = 0.25    # Relative
+NS_SLACK = 2.0         # ns/op, absorbs noise on the cheapest kernels
+
+
+def build(force: bool = False) -> str:
+    """Compile the benchmark if it is missing or stale; returns its path"""
+    sources = SOURCES + [BENCH_SOURCE, KERNELS]
+    if not force and os.path.exists(BENCH_BINARY):
+        built = os.path.getmtime(BENCH_BINARY)
+        if all(os.path.getmtime(src) <= built for src in sources):
+            return BENCH_BINARY
+
+    os.makedirs(BUILD_DIR, exist_ok=True)
+    compiler = os.environ.get('CXX', 'c++')
+    cmd = [compiler, '-O2', '-std=gnu++17', '-I', HOST_DIR, BENCH_SOURCE, '-o', BENCH_BINARY]
+    result = subprocess.run(cmd, capture_output=True, text=True)
+    if result.returncode != 0:
+        raise RuntimeError(f"Benchmark build failed:\n{result.stderr}")
+    return BENCH_BINARY
+
+
+def run(name_filter: Optional[str] = None) -> List[Dict]:
+    """Run the benchmark binary; returns its benchmark entries"""
+    cmd = [build()] + ([name_filter] if name_filter else [])
+    result = subprocess.run(cmd, stdout=subprocess.PIPE, text=True, check=True)
+    return json.loads(result.stdout)['benchmarks']
+
+
+def print_table(benchmarks: List[Dict], baseline: Optional[Dict[str, Dict]] = None):
+    header = f"{'benchmark':<36} {'ns/op':>9} {'min':>9}" + (f" {'baseline':>9} {'change':>8}" if baseline else '')
+    print(header)
+    print('-' * len(header))
+    group = None
+    for b in benchmarks:
+        if b['name'].split('/')[0] != group:
+            if group is not None:
+                print()
+            group = b['name'].split('/')[0]
+        line = f"{b['name']:<36} {b['ns_per_op']:>9.1f} {b['min_ns_per_op']:>9.1f}"
+        base = baseline.get(b['name']) if baseline else None
+        if base:
+            change = (b['ns_per_op'] / base['ns_per_op'] - 1) * 100
+            line += f" {base['ns_per_op']:>9.1f} {change:>+7.0f}%"
+        print(line)
+
+
+def compare(benchmarks: List[Dict], baseline: Dict[str, Dict]) -> List[str]:
+    """
+    Benchmarks that got slower than the baseline allows
+
+    Judged on the fastest batch, which a busy host disturbs far less than
+    the median.
+    """
+    regressions = []
+    for b in benchmarks:
+        base = baseline.get(b['name'])
+        if not base:
+            continue
+        limit = base['min_ns_per_op'] * (1 + NS_TOLERANCE) + NS_SLACK
+        if b['min_ns_per_op'] > limit:
+            regressions.append(f"{b['name']}: {b['min_ns_per_op']:.1f} ns/op > {limit:.1f} "
+                               f"(baseline {base['min_ns_per_op']:.1f})")
+    return regressions
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description="Firmware kernel microbenchmarks (host)")
+    parser.add_argument('--filter', help='Only benchmarks whose name contains this')
+    parser.add_argument('--json', help='Write the machine-readable report here')
+    parser.add_argument('--baseline', help='Report to compare against; exit 1 on regression')
+    args = parser.parse_args()
+
+    baseline = None
+    if args.baseline:
+        with open(args.baseline) as f:
+            baseline = {b['name']: b for b in json.load(f)['benchmarks']}
+
+    benchmarks = run(args.filter)
+    print()
+    print_table(benchmarks, baseline)
+
+    if args.json:
+        report = {
+            'tool': 'kernel_bench',
+            'version': REPORT_VERSION,
+            'git': git_revision(),
+            'host': platform.node(),
+            'machine': platform.machine(),
+            'compiler': os.environ.get('CXX', 'c++'),
+            'timestamp': time.strftime('%Y-%m-%dT%H:%M:%S'),
+            'unit': 'ns/op',
+            'benchmarks': benchmarks,
+        }
+        with open(args.json, 'w') as f:
+            json.dump(report, f, indent=2)
+        print(f"Report written to {args.json}")
+
+    if baseline:
+        regressions = compare(benchmarks, baseline)
+        if regressions:
+            print("\nREGRESSIONS:")
+            for line in regressions:
+                print(f"  {line}")
+            return 1
+        print("\nNo kernel regressions against baseline")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
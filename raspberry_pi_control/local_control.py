@@ -0,0 +1,320 @@
+#!/usr/bin/env python3
+"""
+Local Control Endpoint
+Shared-memory setpoint slot and telemetry ring for autonomy processes that
+run on the same Pi as websocket_server.py
+
+Co-located processes map one file in /dev/shm instead of talking JSON over
+the WebSocket. Writing a setpoint is a few stores plus a futex wake; the
+server's setpoint thread wakes, validates the slot and hands the command
+straight to DualMotorController - no sockets, JSON or event loop involved.
+
+Shared memory layout (all little-endian):
+    0     header     'TLC1', version, ring slots, server pid
+    64    setpoint   seq (u32 futex word, odd while being written), then
+                     written_ns (u64, CLOCK_MONOTONIC), command (64 bytes,
+                     NUL padded) and a CRC32 over written_ns + command
+    192   ring head  frames published so far (u32 futex word)
+    256   ring       RING_SLOTS slots of stamp (frame number + 1, 0 while
+                     being written), millis, pos1, pos2, speed1, speed2,
+                     credits, board index and host receive time (ns)
+
+The setpoint slot holds exactly one command: a newer one replaces one the
+server has not picked up yet, like joystick setpoints on the WebSocket.
+There must be a single setpoint writer at a time. Setpoints use the same
+commands as the page (MOVE:, DIFF:, SPIN:, STOP, ...); a STOP from the page
+does not lock out a local client.
+
+Usage:
+    python3 local_control.py send MOVE:FORWARD:3000
+    python3 local_control.py monitor
+
+    client = LocalControlClient()
+    client.set_setpoint("DIFF:FORWARD:4000:6000")
+    for frame in client.wait_frames(timeout=0.1):
+        ...
+
+Author: Daniel Khito
+Date: 2025
+"""
+
+import argparse
+import ctypes
+import logging
+import mmap
+import os
+import platform
+import struct
+import threading
+import time
+import zlib
+from typing import Callable, Dict, List, Optional
+
+from telemetry_recorder import position_diff
+
+logger = logging.getLogger(__name__)
+
+DEFAULT_NAME = 'teensy_local_control'
+SHM_DIR = '/dev/shm'
+MAGIC = b'TLC1'
+FORMAT_VERSION = 1
+RING_SLOTS = 256              # 2.5 s of frames at 10 ms telemetry
+COMMAND_MAX = 64              # Teensy RX_LINE_MAX
+
+HEADER = struct.Struct('<4sIII')
+SETPOINT_SEQ_OFFSET = 64
+SETPOINT_BODY_OFFSET = 72
+SETPOINT_BODY = struct.Struct(f'<Q{COMMAND_MAX}s')
+SETPOINT_CRC_OFFSET = SETPOINT_BODY_OFFSET + SETPOINT_BODY.size
+RING_HEAD_OFFSET = 192
+RING_OFFSET = 256
+SLOT = struct.Struct('<IIiiiiiIQ')     # stamp, millis, pos1, pos2, speed1, speed2, credits, board, ns
+SLOT_SIZE = 48
+FILE_SIZE = RING_OFFSET + RING_SLOTS * SLOT_SIZE
+
+U32_MASK = 0xffffffff
+POLL_INTERVAL = 0.001         # Fallback when futexes are unavailable
+
+# futex(2) is not wrapped by Python; call it through libc.syscall
+_FUTEX_SYSCALLS = {'x86_64': 202, 'aarch64': 98, 'armv7l': 240, 'armv6l': 240, 'i686': 240}
+_SYS_FUTEX = _FUTEX_SYSCALLS.get(platform.machine())
+FUTEX_WAIT = 0                # Not FUTEX_PRIVATE: waiters live in other processes
+FUTEX_WAKE = 1
+_libc = ctypes.CDLL(None, use_errno=True)
+
+
+class _Timespec(ctypes.Structure):
+    _fields_ = [('tv_sec', ctypes.c_long), ('tv_nsec', ctypes.c_long)]
+
+
+def futex_wait(word: ctypes.c_uint32, expected: int, timeout: Optional[float]):
+    """Sleep until word changes from expected, a wake, or timeout"""
+    if _SYS_FUTEX is None:
+        time.sleep(POLL_INTERVAL)
+        return
+    ts = None
+    if timeout is not None:
+        ts = ctypes.byref(_Timespec(int(timeout), int((timeout % 1) * 1e9)))
+    _libc.syscall(_SYS_FUTEX, ctypes.byref(word), FUTEX_WAIT,
+                  ctypes.c_uint(expected), ts, None, 0)
+
+
+def futex_wake(word: ctypes.c_uint32):
+    if _SYS_FUTEX is not None:
+        _libc.syscall(_SYS_FUTEX, ctypes.byref(word), FUTEX_WAKE, ctypes.c_int(0x7fffffff), None, None, 0)
+
+
+class _Mapping:
+    """The shared file plus typed views of its futex words"""
+
+    def __init__(self, path: str, create: bool):
+        flags = os.O_RDWR | (os.O_CREAT | os.O_TRUNC if create else 0)
+        fd = os.open(path, flags, 0o660)
+        try:
+            if create:
+                os.ftruncate(fd, FILE_SIZE)
+            elif os.fstat(fd).st_size < FILE_SIZE:
+                raise RuntimeError(f"{path} is not a local control endpoint")
+            self.mm = mmap.mmap(fd, FILE_SIZE)
+        finally:
+            os.close(fd)
+        self.path = path
+        self.setpoint_seq = ctypes.c_uint32.from_buffer(self.mm, SETPOINT_SEQ_OFFSET)
+        self.ring_head = ctypes.c_uint32.from_buffer(self.mm, RING_HEAD_OFFSET)
+
+    def close(self):
+        # The ctypes views pin the mapping until they are gone
+        del self.setpoint_seq, self.ring_head
+        try:
+            self.mm.close()
+        except BufferError:
+            pass
+
+
+def _setpoint_crc(body: bytes) -> int:
+    return zlib.crc32(body)
+
+
+class LocalControlServer:
+    """Owns the endpoint: dispatches setpoints and publishes telemetry"""
+
+    def __init__(self, dispatch: Callable[[str], object], name: str = DEFAULT_NAME,
+                 handoff_callback: Optional[Callable[[float], None]] = None):
+        """
+        Args:
+            dispatch: Called with each new setpoint command on the setpoint
+                thread; it may block (later setpoints coalesce meanwhile)
+            name: File name under /dev/shm
+            handoff_callback: Called with each setpoint's write-to-pickup time
+        """
+        self.dispatch = dispatch
+        self.path = os.path.join(SHM_DIR, name)
+        self.handoff_callback = handoff_callback
+        self.shm: Optional[_Mapping] = None
+        self.thread: Optional[threading.Thread] = None
+        self.running = False
+        self.frames_published = 0
+        self.publish_lock = threading.Lock()  # One reader thread per board publishes
+        self.stats = {'setpoints': 0, 'rejected': 0}
+
+    def start(self):
+        self.shm = _Mapping(self.path, create=True)
+        HEADER.pack_into(self.shm.mm, 0, MAGIC, FORMAT_VERSION, RING_SLOTS, os.getpid())
+        self.running = True
+        self.thread = threading.Thread(target=self._setpoint_loop, name='local-control', daemon=True)
+        self.thread.start()
+        logger.info(f"Local control endpoint at {self.path}")
+
+    def close(self):
+        if not self.shm:
+            return
+        self.running = False
+        futex_wake(self.shm.setpoint_seq)
+        self.thread.join(timeout=1.0)
+        try:
+            os.unlink(self.path)
+        except FileNotFoundError:
+            pass
+        self.shm.close()
+        self.shm = None
+
+    def _setpoint_loop(self):
+        seq_word = self.shm.setpoint_seq
+        mm = self.shm.mm
+        last_seq = seq_word.value
+        while self.running:
+            seq = seq_word.value
+            if seq == last_seq:
+                futex_wait(seq_word, seq, 0.5)
+                continue
+            if seq & 1:
+                continue  # Writer is mid-update
+
+            body = mm[SETPOINT_BODY_OFFSET:SETPOINT_CRC_OFFSET]
+            crc, = struct.unpack_from('<I', mm, SETPOINT_CRC_OFFSET)
+            if seq_word.value != seq:
+                continue  # Overwritten while we read it
+            last_seq = seq
+            if crc != _setpoint_crc(body):
+                self.stats['rejected'] += 1
+                continue
+
+            written_ns, raw = SETPOINT_BODY.unpack(body)
+            if self.handoff_callback:
+                self.handoff_callback((time.monotonic_ns() - written_ns) / 1e9)
+            command = raw.split(b'\0', 1)[0].decode(errors='replace').strip()
+            if not command:
+                continue
+            self.stats['setpoints'] += 1
+            try:
+                self.dispatch(command)
+            except Exception as e:
+                logger.error(f"Local setpoint {command} failed: {e}")
+
+    def publish_frame(self, frame: Dict[str, int], board: int = 0):
+        """Telemetry callback: append a frame to the ring (serial reader threads)"""
+        shm = self.shm
+        if not shm:
+            return
+        with self.publish_lock:
+            self._publish(shm, frame, board)
+
+    def _publish(self, shm: _Mapping, frame: Dict[str, int], board: int):
+        n = self.frames_published
+        offset = RING_OFFSET + (n % RING_SLOTS) * SLOT_SIZE
+        struct.pack_into('<I', shm.mm, offset, 0)
+        SLOT.pack_into(shm.mm, offset, 0, frame['millis'] & U32_MASK,
+                       frame['position1'], frame['position2'], frame['speed1'],
+                       frame['speed2'], frame['credits'], board, time.monotonic_ns())
+        struct.pack_into('<I', shm.mm, offset, (n + 1) & U32_MASK)
+        self.frames_published = n + 1
+        shm.ring_head.value = (n + 1) & U32_MASK
+        futex_wake(shm.ring_head)
+
+
+class LocalControlClient:
+    """Attaches to a running server's endpoint"""
+
+    def __init__(self, name: str = DEFAULT_NAME):
+        self.shm = _Mapping(os.path.join(SHM_DIR, name), create=False)
+        magic, version, slots, self.server_pid = HEADER.unpack_from(self.shm.mm, 0)
+        if magic != MAGIC or version != FORMAT_VERSION or slots != RING_SLOTS:
+            self.shm.close()
+            raise RuntimeError(f"Unsupported local control endpoint {magic!r} v{version}")
+        self.cursor = self.shm.ring_head.value
+        self.frames_lost = 0
+
+    def close(self):
+        self.shm.close()
+
+    def set_setpoint(self, command: str):
+        """Replace the setpoint slot with command and wake the server"""
+        raw = command.encode()
+        if len(raw) >= COMMAND_MAX:
+            raise ValueError(f"Command longer than {COMMAND_MAX - 1} bytes")
+        mm, seq_word = self.shm.mm, self.shm.setpoint_seq
+        seq = seq_word.value & ~1
+        seq_word.value = (seq + 1) & U32_MASK
+        SETPOINT_BODY.pack_into(mm, SETPOINT_BODY_OFFSET, time.monotonic_ns(), raw)
+        struct.pack_into('<I', mm, SETPOINT_CRC_OFFSET,
+                         _setpoint_crc(mm[SETPOINT_BODY_OFFSET:SETPOINT_CRC_OFFSET]))
+        seq_word.value = (seq + 2) & U32_MASK
+        futex_wake(seq_word)
+
+    def read_frames(self) -> List[Dict[str, int]]:
+        """Frames published since the last call (oldest lost ones skipped)"""
+        mm = self.shm.mm
+        head = self.shm.ring_head.value
+        behind = (head - self.cursor) & U32_MASK
+        if behind > RING_SLOTS - 1:
+            self.frames_lost += behind - (RING_SLOTS - 1)
+            self.cursor = (head - (RING_SLOTS - 1)) & U32_MASK
+
+        frames = []
+        while self.cursor != head:
+            offset = RING_OFFSET + (self.cursor % RING_SLOTS) * SLOT_SIZE
+            expected = (self.cursor + 1) & U32_MASK
+            stamp, ms, pos1, pos2, speed1, speed2, credits, board, ns = SLOT.unpack_from(mm, offset)
+            if stamp != expected or struct.unpack_from('<I', mm, offset)[0] != expected:
+                self.frames_lost += 1  # Overwritten while we read it
+            else:
+                frames.append({'millis': ms, 'position1': pos1, 'position2': pos2,
+                               'speed1': speed1, 'speed2': speed2, 'credits': credits,
+                               'board': board, 'host_ns': ns})
+            self.cursor = expected
+        return frames
+
+    def wait_frames(self, timeout: Optional[float] = None) -> List[Dict[str, int]]:
+        """Block until at least one new frame (or timeout) and return them"""
+        head = self.shm.ring_head.value
+        if head == self.cursor:
+            futex_wait(self.shm.ring_head, head, timeout)
+        return self.read_frames()
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Local control endpoint client")
+    parser.add_argument('--name', default=DEFAULT_NAME, help='Endpoint name under /dev/shm')
+    sub = parser.add_subparsers(dest='cmd', required=True)
+    send = sub.add_parser('send', help='Write one setpoint')
+    send.add_argument('command')
+    sub.add_parser('monitor', help='Print telemetry frames as they arrive')
+    args = parser.parse_args()
+
+    client = LocalControlClient(args.name)
+    try:
+        if args.cmd == 'send':
+            client.set_setpoint(args.command)
+        else:
+            while True:
+                for frame in client.wait_frames(timeout=1.0):
+                    print(f"[{frame['board']}] {frame['millis']:>10} pos1={frame['position1']} pos2={frame['position2']} "
+                          f"drift={position_diff(frame['position1'], frame['position2'])} credits={frame['credits']}")
+    except KeyboardInterrupt:
+        pass
+    finally:
+        client.close()
+
+
+if __name__ == "__main__":
+    main()
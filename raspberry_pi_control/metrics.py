@@ -0,0 +1,195 @@
+#!/usr/bin/env python3
+"""
+Prometheus Metrics for the Control Stack
+Counters and histograms cheap enough for the command hot path
+
+Every updating thread gets its own shard of each metric, so an update is a
+few list operations on memory no other thread writes - no locks and no lost
+increments. Scrapes add the shards up; a scrape may see a shard halfway
+through an update, which Prometheus tolerates.
+
+Author: Daniel Khito
+Date: 2025
+"""
+
+import asyncio
+import bisect
+import logging
+import threading
+from typing import Callable, Dict, List, Optional, Sequence, Tuple
+
+logger = logging.getLogger(__name__)
+
+# Latency buckets in seconds (100 us .. 2.5 s)
+LATENCY_BUCKETS = (0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01,
+                   0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5)
+# Sync drift buckets in steps
+DRIFT_BUCKETS = (0, 1, 2, 5, 10, 25, 50, 100, 250, 500, 1000, 5000)
+
+
+class _Sharded:
+    """Per-thread storage; shards are only ever written by their own thread"""
+
+    def __init__(self, size: int):
+        self._size = size
+        self._local = threading.local()
+        self._shards: List[list] = []
+        self._register = threading.Lock()  # Only taken once per thread
+
+    def _shard(self) -> list:
+        try:
+            return self._local.shard
+        except AttributeError:
+            shard = [0] * self._size
+            with self._register:
+                self._shards.append(shard)
+            self._local.shard = shard
+            return shard
+
+    def _totals(self) -> list:
+        totals = [0] * self._size
+        for shard in list(self._shards):
+            for i, value in enumerate(shard):
+                totals[i] += value
+        return totals
+
+
+class Counter(_Sharded):
+    """Monotonic counter"""
+
+    def __init__(self, name: str, help_text: str):
+        super().__init__(1)
+        self.name = name
+        self.help = help_text
+
+    def inc(self, amount: float = 1):
+        self._shard()[0] += amount
+
+    def render(self) -> List[str]:
+        return [f"# HELP {self.name} {self.help}",
+                f"# TYPE {self.name} counter",
+                f"{self.name} {self._totals()[0]}"]
+
+
+class Histogram(_Sharded):
+    """Fixed-bucket histogram; shard layout is [bucket counts..., +Inf, sum]"""
+
+    def __init__(self, name: str, help_text: str, buckets: Sequence[float]):
+        super().__init__(len(buckets) + 2)
+        self.name = name
+        self.help = help_text
+        self.buckets = tuple(buckets)
+
+    def observe(self, value: float):
+        shard = self._shard()
+        shard[bisect.bisect_left(self.buckets, value)] += 1
+        shard[-1] += value
+
+    def render(self) -> List[str]:
+        totals = self._totals()
+        return _render_histogram(self.name, self.help, self.buckets, totals[:-1], totals[-1])
+
+
+class ExternalHistogram:
+    """Histogram whose cumulative counts come from elsewhere (firmware PERF)"""
+
+    def __init__(self, name: str, help_text: str):
+        self.name = name
+        self.help = help_text
+        self.snapshot: Optional[Tuple[Sequence[float], List[int], float]] = None
+
+    def set(self, bounds: Sequence[float], counts: List[int], total: float):
+        """bounds[i] is the upper bound of counts[i]; the last count is +Inf"""
+        self.snapshot = (tuple(bounds), list(counts), total)
+
+    def render(self) -> List[str]:
+        if not self.snapshot:
+            return []
+        bounds, counts, total = self.snapshot
+        return _render_histogram(self.name, self.help, bounds, counts, total)
+
+
+class Gauge:
+    """Value read at scrape time"""
+
+    def __init__(self, name: str, help_text: str, read: Callable[[], float]):
+        self.name = name
+        self.help = help_text
+        self.read = read
+
+    def render(self) -> List[str]:
+        return [f"# HELP {self.name} {self.help}",
+                f"# TYPE {self.name} gauge",
+                f"{self.name} {self.read()}"]
+
+
+class CounterFunc(Gauge):
+    """Counter maintained elsewhere (e.g. DualMotorController.stats)"""
+
+    def render(self) -> List[str]:
+        return [f"# HELP {self.name} {self.help}",
+                f"# TYPE {self.name} counter",
+                f"{self.name} {self.read()}"]
+
+
+def _render_histogram(name: str, help_text: str, bounds: Sequence[float],
+                      counts: List[int], total: float) -> List[str]:
+    lines = [f"# HELP {name} {help_text}", f"# TYPE {name} histogram"]
+    cumulative = 0
+    for bound, count in zip(bounds, counts):
+        cumulative += count
+        lines.append(f'{name}_bucket{{le="{bound:g}"}} {cumulative}')
+    cumulative += sum(counts[len(bounds):])
+    lines.append(f'{name}_bucket{{le="+Inf"}} {cumulative}')
+    lines.append(f"{name}_sum {total}")
+    lines.append(f"{name}_count {cumulative}")
+    return lines
+
+
+class Registry:
+    """Collection of metrics rendered in Prometheus text format"""
+
+    def __init__(self):
+        self.metrics: Dict[str, object] = {}
+
+    def add(self, metric):
+        self.metrics[metric.name] = metric
+        return metric
+
+    def counter(self, name: str, help_text: str) -> Counter:
+        return self.add(Counter(name, help_text))
+
+    def histogram(self, name: str, help_text: str, buckets: Sequence[float]) -> Histogram:
+        return self.add(Histogram(name, help_text, buckets))
+
+    def render(self) -> str:
+        lines = []
+        for metric in list(self.metrics.values()):
+            lines.extend(metric.render())
+        return '\n'.join(lines) + '\n'
+
+    async def serve(self, host: str, port: int):
+        """Serve GET /metrics over plain HTTP"""
+
+        async def handle(reader: asyncio.StreamReader, writer: asyncio.StreamWriter):
+            try:
+                request = await reader.readline()
+                while (await reader.readline()) not in (b'\r\n', b'\n', b''):
+                    pass
+                if request.split(b' ')[1:2] == [b'/metrics']:
+                    status, body = '200 OK', self.render().encode()
+                else:
+                    status, body = '404 Not Found', b'Not found\n'
+                writer.write(f"HTTP/1.1 {status}\r\n"
+                             f"Content-Type: text/plain; version=0.0.4\r\n"
+                             f"Content-Length: {len(body)}\r\n"
+                             f"Connection: close\r\n\r\n".encode() + body)
+                await writer.drain()
+            except (ConnectionError, asyncio.IncompleteReadError):
+                pass
+            finally:
+                writer.close()
+
+        server = await asyncio.start_server(handle, host, port)
+        logger.info(f"Metrics on http://{host}:{port}/metrics")
+        return server
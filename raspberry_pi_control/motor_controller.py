@@ -8,29 +8,149 @@ Author: Daniel Khito
 Date: 2025
 """
 
+import contextlib
 import serial
 import time
 import threading
-from typing import Optional
+from collections import deque
+from typing import Callable, Dict, List, Optional, Tuple
 import sys
 
+# Flow control
+DEFAULT_CREDITS = 1   # Credits assumed until the Teensy advertises its queue
+# A command's ACK can take as long as the firmware blocks on it: STOP ramps
+# the motors down one after the other, each from up to MAX_SPEED at the
+# configured acceleration and through the input shaper's delay. The ACK
+# timeout (a safety net for a lost link) is that plus a margin.
+ACK_TIMEOUT_MARGIN = 2.0
+MAX_SPEED = 20000          # Steps/sec, as in main.cpp
+DEFAULT_ACCEL = 8000       # Steps/sec^2 until CONFIG:ACCEL changes it (main.cpp ACCEL_RATE)
+MIN_ACCEL = 1000           # Slowest rate the firmware accepts
+SHAPER_MAX_DELAY_S = 2.56  # Longest shaper delay (SHAPER_HISTORY control ticks)
+RX_SEQ_MODULO = 1 << 16  # Teensy counts received lines in a uint16_t
+SIM_PORT = 'sim://'   # Port name for the host simulator (teensy_sim.SimSerial)
+
+# Connection handshake
+HELLO_RETRY = 0.1        # Resend HELLO if the Teensy has not answered yet
+CONNECT_TIMEOUT = 5.0    # Give up on HELLO (pre-HELLO firmware) after this
+RECONNECT_INTERVAL = 0.2 # Between attempts to reopen a port that went away
+# Settings the Teensy forgets on reset; replayed after every (re)connect
+SESSION_PREFIXES = ('TELEMETRY:', 'TEL:', 'CONFIG:ACCEL:', 'CONFIG:BOOST:', 'CONFIG:SHAPER:',
+                    'OVERRIDE:', 'OV:')
+
+# Serial writer: commands queued within the window go out in one write
+BATCH_WINDOW = 0.0002    # Seconds; 0 only merges commands queued during a write
+URGENT_COMMANDS = ('ESTOP', 'E', 'STOP', 'X', 'PAUSE', 'P')  # Never wait for the window
+MOTOR_PREFIXES = ('M1:', 'M2:', '1:', '2:')   # Address one motor (processCommand)
+ESTOP_COMMANDS = ('ESTOP', 'E')
+ESTOP_RESERVED_CREDITS = 1   # Queue slots other commands leave free for an ESTOP
+
+# Waypoint (PVT) streaming
+PVT_POLL = 0.02          # Status poll period while the Teensy's buffer is full
+
+# LINK reply fields, in order, before the per-verb counts
+LINK_FIELDS = ('rx_bytes', 'tx_bytes', 'lines', 'parse_errors', 'unknown', 'truncated', 'dropped',
+               'rx_backlog_max', 'tx_writes', 'tx_stalls', 'tx_blocked_us')
+
+
+def command_verb(command: str) -> str:
+    """Upper-case command without its motor prefix (M1:STOP -> STOP)"""
+    upper = command.strip().upper()
+    for prefix in MOTOR_PREFIXES:
+        if upper.startswith(prefix):
+            return upper[len(prefix):]
+    return upper
+
+
+class PendingCommand:
+    """A command written to the Teensy that has not been acknowledged yet"""
+    
+    __slots__ = ('command', 'lines', 'done', 'sent_at', 'failed', 'acks_before')
+    
+    def __init__(self, command: str):
+        self.command = command
+        self.lines: List[str] = []
+        self.done = threading.Event()
+        self.sent_at = 0.0
+        self.failed = False  # The write itself failed; there will be no ACK
+        self.acks_before = 0  # stats['acks'] when it was queued
+
+
 class DualMotorController:
     """Controls both motors via single Teensy 4.1"""
     
-    def __init__(self, port: str, baud_rate: int = 115200):
+    def __init__(self, port: str, baud_rate: int = 115200, batch_window: float = BATCH_WINDOW):
         """
         Initialize dual motor controller
         
         Args:
-            port: Serial port (e.g., '/dev/ttyACM0')
+            port: Serial port (e.g., '/dev/ttyACM0'), or 'sim://' for a
+                real-time host simulator of the firmware ('sim://<fleet>/<n>'
+                for one instance of a teensy_sim.SimFleet)
             baud_rate: Serial communication baud rate
+            batch_window: How long the writer gathers commands before one
+                write (send_commands groups and stops are written at once)
         """
         self.port = port
         self.baud_rate = baud_rate
+        self.batch_window = batch_window
         self.serial_conn: Optional[serial.Serial] = None
         self.is_connected = False
         self.lock = threading.Lock()
         
+        # Credit-based flow control: the Teensy acknowledges every line with
+        # ACK:<free queue slots>:<lines received>, so we always know how many
+        # more lines fit in its receive queue.
+        self.flow = threading.Condition()
+        self.pending: deque = deque()
+        self.credits = DEFAULT_CREDITS
+        self.lines_sent = 0
+        self.accel = DEFAULT_ACCEL  # Last CONFIG:ACCEL sent, for ack_timeout
+        self.rx_synced = False  # lines_sent lined up with the Teensy's counter
+        self.stop_epoch = 0     # Bumped by stop_now; groups begun before it give up
+        self.reader_thread: Optional[threading.Thread] = None
+        
+        # Micro-batching writer: a command goes straight out if the link has
+        # been quiet for a batching window. Otherwise it waits in tx_buffer
+        # (in pending order) until the window since the last write closes and
+        # the writer thread sends everything queued with one write. Groups and
+        # stops flush right away.
+        self.tx = threading.Condition()
+        self.tx_buffer = bytearray()
+        self.tx_batch: List[PendingCommand] = []
+        self.last_write_at = 0.0
+        self.group_sent_at = 0.0  # First serial write of the last send_commands group
+        self.write_lock = threading.Lock()  # Keeps batches in order on the wire
+        self.writer_thread: Optional[threading.Thread] = None
+        
+        # Latest telemetry frame and subscribers (see start_telemetry)
+        self.telemetry: Optional[Dict[str, int]] = None
+        self.telemetry_callbacks: List[Callable[[Dict[str, int]], None]] = []
+        
+        # Called with each command's write-to-ACK time in seconds
+        self.rtt_callback: Optional[Callable[[float], None]] = None
+        
+        # HELLO handshake results and the settings replayed on reconnect
+        self.firmware: Optional[Dict[str, object]] = None
+        self.session: Dict[str, str] = {}
+        self.hello_nonce = 0
+        self.hello_acks = None   # stats['acks'] when the expected HELLO reply arrived
+        self.reconnect_thread: Optional[threading.Thread] = None
+        self.reconnecting = False
+        
+        self.stats = {
+            'commands_sent': 0,
+            'acks': 0,
+            'throttled_sends': 0,    # Sends that had to wait for a credit
+            'throttle_wait_s': 0.0,  # Total time spent waiting for credits
+            'ack_timeouts': 0,
+            'rx_dropped': 0,         # Lines the Teensy dropped with its queue full
+            'connect_s': None,       # Port open to first command accepted
+            'reconnects': 0,
+            'tx_writes': 0,          # Serial write() calls (one per batch)
+            'tx_bytes': 0,
+        }
+        
     def connect(self) -> bool:
         """
         Establish serial connection to Teensy
@@ -39,87 +159,683 @@ class DualMotorController:
             True if connection successful, False otherwise
         """
         try:
+            self._open()
+        except (serial.SerialException, OSError) as e:
+            print(f"✗ Failed to connect - {e}")
+            self.is_connected = False
+            return False
+        
+        print(f"✓ Connected to Teensy at {self.port} in {self.stats['connect_s'] * 1000:.0f} ms")
+        if self.firmware:
+            print(f"  Firmware {self.firmware['version']} (protocol {self.firmware['protocol']}), "
+                  f"up {self.firmware['uptime_ms'] / 1000:.1f} s, "
+                  f"capabilities {','.join(self.firmware['capabilities'])}")
+        return True
+    
+    def _open(self):
+        """Open the port, start the reader and handshake; raises SerialException"""
+        started = time.perf_counter()
+        if self.port.startswith(SIM_PORT):
+            from teensy_sim import open_port
+            self.serial_conn = open_port(self.port, timeout=0.1)
+        else:
             self.serial_conn = serial.Serial(
                 port=self.port,
                 baudrate=self.baud_rate,
-                timeout=1,
+                timeout=0.1,
                 write_timeout=1
             )
-            time.sleep(2)  # Wait for Teensy to initialize
-            
-            # Clear any startup messages
-            self.serial_conn.reset_input_buffer()
-            
-            self.is_connected = True
-            print(f"✓ Connected to Teensy at {self.port}")
-            
-            # Get initial status
-            status = self.get_status()
-            if status:
-                print(status)
-            
-            return True
-            
-        except serial.SerialException as e:
-            print(f"✗ Failed to connect - {e}")
-            self.is_connected = False
-            return False
+        
+        # Clear any startup messages
+        self.serial_conn.reset_input_buffer()
+        
+        self.is_connected = True
+        self._reset_flow()
+        with self.tx:
+            self.tx_buffer.clear()
+            self.tx_batch.clear()
+        self.reader_thread = threading.Thread(target=self._reader_loop, args=(self.serial_conn,),
+                                              daemon=True)
+        self.reader_thread.start()
+        self.writer_thread = threading.Thread(target=self._writer_loop, args=(self.serial_conn,),
+                                              daemon=True)
+        self.writer_thread.start()
+        
+        self._handshake()
+        self.stats['connect_s'] = time.perf_counter() - started
+    
+    def _handshake(self):
+        """
+        HELLO until the Teensy answers, instead of sleeping through its boot
+        
+        Each attempt carries a new nonce. Once the reply to the latest attempt
+        and its ACK are in, every earlier HELLO has been answered or was never
+        read, so flow control starts from a clean slate.
+        """
+        self.firmware = None
+        deadline = time.perf_counter() + CONNECT_TIMEOUT
+        while time.perf_counter() < deadline and self.is_connected:
+            with self.flow:
+                self.hello_nonce += 1
+                self.hello_acks = None
+            # Through the tx buffer like any command, so it never lands inside
+            # another write. The Teensy drops a partial line left over from
+            # before (a host that died mid-write) when HELLO completes it.
+            with self.tx:
+                self.tx_buffer += f"HELLO:{self.hello_nonce}\n".encode()
+            if not self._flush_tx():
+                raise serial.SerialException("HELLO failed")
+            with self.flow:
+                retry_at = time.perf_counter() + HELLO_RETRY
+                while self.hello_acks is None and time.perf_counter() < retry_at:
+                    self.flow.wait(retry_at - time.perf_counter())
+                if self.hello_acks is not None:
+                    self.flow.wait_for(lambda: self.stats['acks'] > self.hello_acks,
+                                       timeout=deadline - time.perf_counter())
+                    if self.stats['acks'] > self.hello_acks:
+                        break
+        
+        if not self.firmware:
+            # Firmware without HELLO still ACKs; carry on with default credits
+            print("No HELLO reply - assuming firmware without handshake support")
+            self._reset_flow()
+        self._replay_session()
+    
+    def _replay_session(self):
+        """Restore settings a reset Teensy has forgotten"""
+        for command in list(self.session.values()):
+            self.send_command(command, wait=False)
+    
+    def _handle_hello(self, line: str):
+        """HELLO:nonce:protocol:firmware:queue_depth:line_max:uptime_ms:capabilities"""
+        try:
+            _, nonce, protocol, version, depth, line_max, uptime, caps = line.split(':')
+            info = {
+                'protocol': int(protocol),
+                'version': version,
+                'queue_depth': int(depth),
+                'line_max': int(line_max),
+                'uptime_ms': int(uptime),
+                'capabilities': caps.split(','),
+            }
+        except ValueError:
+            return
+        with self.flow:
+            if int(nonce) == self.hello_nonce:
+                self.firmware = info
+                self.hello_acks = self.stats['acks']
+                self.flow.notify_all()
+    
+    def _connection_lost(self):
+        """Reader thread: the port went away (e.g. USB re-enumeration)"""
+        print(f"Lost connection to Teensy at {self.port} - reconnecting")
+        self.reconnecting = True
+        self._reset_flow()
+        try:
+            self.serial_conn.close()
+        except Exception:
+            pass
+        self.reconnect_thread = threading.Thread(target=self._reconnect_loop, daemon=True)
+        self.reconnect_thread.start()
+    
+    def _reconnect_loop(self):
+        """Reopen the port until it is back, then handshake and replay settings"""
+        while self.is_connected:
+            try:
+                self._open()
+                self.stats['reconnects'] += 1
+                self.reconnecting = False
+                print(f"✓ Reconnected to Teensy at {self.port} in {self.stats['connect_s'] * 1000:.0f} ms")
+                return
+            except (serial.SerialException, OSError):
+                if self.serial_conn:
+                    try:
+                        self.serial_conn.close()
+                    except Exception:
+                        pass
+                time.sleep(RECONNECT_INTERVAL)
+        self.reconnecting = False
     
     def disconnect(self):
         """Close serial connection"""
         if self.serial_conn and self.serial_conn.is_open:
             self.stop_all()
-            time.sleep(0.5)
+        self.is_connected = False
+        with self.tx:
+            self.tx.notify_all()
+        if self.writer_thread:
+            self.writer_thread.join(timeout=1.0)
+        if self.reader_thread:
+            self.reader_thread.join(timeout=1.0)
+        if self.reconnect_thread:
+            self.reconnect_thread.join(timeout=1.0)
+        if self.serial_conn:
             self.serial_conn.close()
-            self.is_connected = False
             print("Disconnected from Teensy")
     
-    def send_command(self, command: str) -> Optional[str]:
+    def _reset_flow(self):
+        """Forget all in-flight commands and fall back to the default credit"""
+        with self.flow:
+            for pending in self.pending:
+                pending.done.set()
+            self.pending.clear()
+            self.credits = DEFAULT_CREDITS
+            self.rx_synced = False
+            self.flow.notify_all()
+    
+    def _update_credits(self, free: int, received: int):
+        """Recompute credits from the Teensy's free slots and received-line count.
+        
+        Lines we sent that the Teensy had not read yet will still take a slot,
+        so they are subtracted from the advertised free count. Caller holds flow.
+        """
+        if not self.rx_synced:
+            return
+        in_transit = (self.lines_sent - received) % RX_SEQ_MODULO
+        self.credits = max(0, free - in_transit)
+        self.flow.notify_all()
+    
+    def _reader_loop(self, conn):
+        """Route incoming lines: ACKs, telemetry frames and command output"""
+        while self.is_connected and conn is self.serial_conn:
+            try:
+                raw = conn.readline()
+            except (serial.SerialException, OSError, TypeError) as e:
+                if self.is_connected and not self.reconnecting:
+                    print(f"Serial read error - {e}")
+                    self._connection_lost()
+                break
+            
+            line = raw.decode(errors='replace').strip()
+            if not line:
+                continue
+            
+            if line.startswith('ACK:'):
+                self._handle_ack(line)
+            elif line.startswith('T:'):
+                self._handle_telemetry(line)
+            elif line.startswith('HELLO:'):
+                self._handle_hello(line)
+            else:
+                if line.startswith('RX queue full'):
+                    self.stats['rx_dropped'] += 1
+                with self.flow:
+                    if self.pending:
+                        self.pending[0].lines.append(line)
+    
+    def _handle_ack(self, line: str):
+        """ACK:<free>:<received> - completes the oldest pending command"""
+        try:
+            _, free, received = line.split(':')
+            free, received = int(free), int(received)
+        except ValueError:
+            return
+        
+        with self.flow:
+            pending = self.pending.popleft() if self.pending else None
+            self.stats['acks'] += 1
+            if not self.pending:
+                # Everything we sent has been read - line up with the Teensy's count
+                self.lines_sent = received
+                self.rx_synced = True
+            self._update_credits(free, received)
+        
+        if pending:
+            if self.rtt_callback:
+                self.rtt_callback(time.perf_counter() - pending.sent_at)
+            pending.done.set()
+    
+    def _handle_telemetry(self, line: str):
+        """T:<ms>:<pos1>:<pos2>:<speed1>:<speed2>:<free>:<received>[:<rx_lost>:<tx_blocked_ms>:<rx_backlog_max>]"""
+        try:
+            fields = [int(v) for v in line[2:].split(':')]
+            ms, pos1, pos2, speed1, speed2, free, received = fields[:7]
+        except ValueError:
+            return
+        
+        frame = {
+            'millis': ms,
+            'position1': pos1,
+            'position2': pos2,
+            'speed1': speed1,
+            'speed2': speed2,
+            'credits': free,
+        }
+        if len(fields) >= 10:   # Link health, firmware with LINK
+            frame['rx_lost'], frame['tx_blocked_ms'], frame['rx_backlog_max'] = fields[7:10]
+        with self.flow:
+            self._update_credits(free, received)
+        self.telemetry = frame
+        
+        for callback in self.telemetry_callbacks:
+            try:
+                callback(frame)
+            except Exception as e:
+                print(f"Telemetry callback error - {e}")
+    
+    def _reserved_credits(self) -> int:
+        """Credits only an ESTOP may use: one, once the Teensy has said its
+        queue is deep enough to spare it (HELLO)"""
+        if self.firmware and self.firmware['queue_depth'] > ESTOP_RESERVED_CREDITS + 1:
+            return ESTOP_RESERVED_CREDITS
+        return 0
+    
+    def _acquire_credit(self, reserve: int = 0, epoch: Optional[int] = None) -> bool:
+        """Block until the Teensy has room for another line beyond the
+        reserve; False if disconnected or a stop_now since epoch cancelled
+        the wait. Caller holds flow."""
+        if self.credits > reserve:
+            return True
+        
+        self.stats['throttled_sends'] += 1
+        start = time.perf_counter()
+        while self.credits <= reserve and self.is_connected:
+            if epoch is not None and epoch != self.stop_epoch:
+                break
+            if not self.flow.wait(self.ack_timeout):
+                # ACKs stopped arriving (reset or lost output) - start over
+                print("Flow control timeout - resetting credits")
+                self.stats['ack_timeouts'] += 1
+                for pending in self.pending:
+                    pending.done.set()
+                self.pending.clear()
+                self.credits = DEFAULT_CREDITS
+                self.rx_synced = False
+                break
+        self.stats['throttle_wait_s'] += time.perf_counter() - start
+        return self.is_connected and (epoch is None or epoch == self.stop_epoch)
+    
+    def _write_command(self, command: str, flush: Optional[bool] = None,
+                       epoch: Optional[int] = None) -> Optional[PendingCommand]:
+        """Queue one command once a credit is available
+        
+        flush=True writes everything queued right away (stops always do),
+        False holds the command for a flush the caller is about to ask for,
+        None writes at once if the link is quiet and otherwise leaves it to
+        the writer thread at the end of the batching window. Given the
+        stop_epoch its group began in, the command is dropped (None) if a
+        stop_now has come since.
+        """
+        if not self.is_connected or not self.serial_conn:
+            print("Not connected to Teensy")
+            return None
+        
+        pending = PendingCommand(command)
+        data = f"{command}\n".encode()
+        upper = command.strip().upper()
+        estop = upper in ESTOP_COMMANDS
+        reserve = 0 if estop else self._reserved_credits()
+        if command_verb(command) in URGENT_COMMANDS:
+            flush = True
+        
+        # An ESTOP skips self.lock, which a sender waiting for credits holds,
+        # and may take the reserved credit, so it goes out at once
+        with contextlib.nullcontext() if estop else self.lock:
+            # Held lines must reach the Teensy before we can wait for its credits
+            if self.credits <= reserve:
+                self._flush_tx()
+            with self.flow:
+                if not self._acquire_credit(reserve, epoch):
+                    return None
+                self.credits -= 1
+                self.lines_sent += 1
+                self.stats['commands_sent'] += 1
+                pending.acks_before = self.stats['acks']
+                if flush is None and time.perf_counter() - self.last_write_at >= self.batch_window:
+                    flush = True  # Nothing to batch with
+                # Queued under flow as well, so the wire order matches pending
+                with self.tx:
+                    self.pending.append(pending)
+                    self.tx_buffer += data
+                    self.tx_batch.append(pending)
+                    if flush is None:
+                        self.tx.notify()  # Writer thread sends it when the window closes
+            
+            if flush:
+                self._flush_tx()
+        
+        return pending
+    
+    def _writer_loop(self, conn):
+        """Send what single commands queued, one write per batching window"""
+        while self.is_connected and conn is self.serial_conn:
+            with self.tx:
+                if not self.tx_buffer:
+                    self.tx.wait(0.1)
+                    continue
+                deadline = self.last_write_at + self.batch_window
+                while self.tx_buffer and self.is_connected:
+                    remaining = deadline - time.perf_counter()
+                    if remaining <= 0:
+                        break
+                    self.tx.wait(remaining)
+            if conn is self.serial_conn:
+                self._flush_tx()
+    
+    def _flush_tx(self) -> bool:
+        """Write everything queued in one write; False if the write failed"""
+        with self.write_lock:
+            with self.tx:
+                if not self.tx_buffer:
+                    return True
+                data = bytes(self.tx_buffer)
+                batch = self.tx_batch
+                self.tx_buffer.clear()
+                self.tx_batch = []
+            
+            try:
+                sent_at = time.perf_counter()
+                self.last_write_at = sent_at
+                for pending in batch:
+                    pending.sent_at = sent_at
+                self.serial_conn.write(data)
+                self.serial_conn.flush()
+                self.stats['tx_writes'] += 1
+                self.stats['tx_bytes'] += len(data)
+            except Exception as e:
+                print(f"Command error - {e}")
+                with self.flow:
+                    for pending in batch:
+                        if pending in self.pending:
+                            self.pending.remove(pending)
+                            self.lines_sent -= 1
+                        pending.failed = True
+                        pending.done.set()
+                return False
+        return True
+    
+    @property
+    def ack_timeout(self) -> float:
+        """Longest the Teensy can legitimately take to ACK one command"""
+        ramp = MAX_SPEED / self.accel + SHAPER_MAX_DELAY_S
+        return 2 * ramp + ACK_TIMEOUT_MARGIN
+    
+    def _wait_for(self, pending: PendingCommand) -> Optional[str]:
+        """Wait for a command's ACK and return the lines it printed
+        
+        Commands queued ahead of it may each block for up to ack_timeout, so
+        the timeout runs from the last ACK of any command, or from the send
+        if none has come since.
+        """
+        acks = pending.acks_before
+        while not pending.done.wait(self.ack_timeout):
+            if self.stats['acks'] == acks:
+                self.stats['ack_timeouts'] += 1
+                print(f"No ACK for {pending.command}")
+                return None
+            acks = self.stats['acks']
+        if pending.failed:
+            return None
+        return '\n'.join(pending.lines)
+    
+    def send_command(self, command: str, wait: bool = True) -> Optional[str]:
         """
         Send command to Teensy and get response
         
         Args:
             command: Command string to send
+            wait: Wait for the Teensy's ACK (False returns as soon as it is queued)
             
         Returns:
             Response from Teensy or None if error
         """
-        if not self.is_connected or not self.serial_conn:
-            print("Not connected to Teensy")
+        self._remember_session(command)
+        pending = self._write_command(command)
+        if pending is None:
+            return None
+        if not wait:
+            return ''
+        return self._wait_for(pending)
+    
+    def send_commands(self, commands: List[str]) -> Optional[str]:
+        """
+        Send several commands back to back and wait for the last ACK.
+        
+        Commands are pipelined up to the available credits instead of paying
+        a full round trip for each one. A stop_now from another thread ends
+        the group: commands not yet queued are never sent.
+        """
+        sent = []
+        epoch = self.stop_epoch
+        for i, command in enumerate(commands):
+            self._remember_session(command)
+            # The whole group goes out in one write as soon as it is queued
+            pending = self._write_command(command, flush=i == len(commands) - 1, epoch=epoch)
+            if pending is None:
+                return None
+            sent.append(pending)
+        
+        if not sent or self._wait_for(sent[-1]) is None:
+            return None
+        self.group_sent_at = sent[0].sent_at
+        return '\n'.join(line for pending in sent for line in pending.lines)
+    
+    def _remember_session(self, command: str):
+        """Keep the latest of each setting that must survive a Teensy reset"""
+        upper = command.strip().upper()
+        for prefix in SESSION_PREFIXES:
+            if upper.startswith(prefix):
+                key = {'TEL:': 'TELEMETRY:', 'OV:': 'OVERRIDE:'}.get(prefix, prefix)
+                self.session[key] = command.strip()
+                if key == 'CONFIG:ACCEL:':
+                    try:
+                        rate = float(upper[len(key):])
+                    except ValueError:
+                        return
+                    if rate >= MIN_ACCEL:  # The firmware ignores slower rates
+                        self.accel = rate
+                return
+    
+    @property
+    def flow_stats(self) -> Dict[str, float]:
+        """Flow-control counters plus the current credit count"""
+        with self.flow:
+            stats = dict(self.stats)
+            stats['credits'] = self.credits
+            stats['in_flight'] = len(self.pending)
+        return stats
+    
+    def start_telemetry(self, interval_ms: int,
+                        callback: Optional[Callable[[Dict[str, int]], None]] = None) -> bool:
+        """Ask the Teensy to stream telemetry frames every interval_ms (0 stops)"""
+        if callback and callback not in self.telemetry_callbacks:
+            self.telemetry_callbacks.append(callback)
+        response = self.send_command(f"TELEMETRY:{int(interval_ms)}")
+        return response is not None
+    
+    def get_perf(self) -> Optional[Dict[str, object]]:
+        """
+        Read the Teensy's loop/ISR timing histograms (PERF command)
+        
+        Returns:
+            Dict with cpu_hz, loop_count, loop_total_us, loop_buckets (bucket i
+            counts loop periods < 2**i us), isr_count, isr_total_cycles and
+            isr_buckets (bucket i counts ISRs < 2**(i + isr_shift) cycles), or
+            None if the Teensy did not answer
+        """
+        response = self.send_command("PERF")
+        if not response:
+            return None
+        for line in response.split('\n'):
+            if line.startswith('PERF:'):
+                try:
+                    _, hz, loops, loop_us, loop_b, isrs, isr_cycles, isr_b = line.split(':')
+                    return {
+                        'cpu_hz': int(hz),
+                        'loop_count': int(loops),
+                        'loop_total_us': int(loop_us),
+                        'loop_buckets': [int(v) for v in loop_b.split(',')],
+                        'isr_count': int(isrs),
+                        'isr_total_cycles': int(isr_cycles),
+                        'isr_buckets': [int(v) for v in isr_b.split(',')],
+                        'isr_shift': 6,
+                    }
+                except ValueError:
+                    return None
+        return None
+
+    def get_memory(self) -> Optional[Dict[str, int]]:
+        """
+        Read the Teensy's stack high-water mark and static RAM (MEM command)
+
+        Returns:
+            Dict with stack_max (deepest the stack has reached since boot),
+            stack_size (DTCM left for it), static_ram and boot_heap_used, all
+            bytes (the stack and static RAM are 0 on the host simulator), or
+            None if the Teensy did not answer
+        """
+        response = self.send_command("MEM")
+        if not response:
+            return None
+        for line in response.split('\n'):
+            if line.startswith('MEM:'):
+                try:
+                    stack_max, stack_size, static_ram, boot_heap = (int(v) for v in line[4:].split(':'))
+                except ValueError:
+                    return None
+                return {'stack_max': stack_max, 'stack_size': stack_size,
+                        'static_ram': static_ram, 'boot_heap_used': boot_heap}
+        return None
+
+    def get_link_stats(self) -> Optional[Dict[str, object]]:
+        """
+        Read the Teensy's USB link counters (LINK command)
+        
+        Returns:
+            Dict with rx_bytes, tx_bytes, lines, parse_errors (known command,
+            bad arguments), unknown (commands), truncated and dropped (lines
+            lost at RX_LINE_MAX or with the queue full), rx_backlog_max
+            (bytes), tx_writes, tx_stalls and tx_blocked_us (writes that
+            waited on the host and the time they took), all counted since
+            boot, plus opcodes (verb -> count), or None if the Teensy did
+            not answer
+        """
+        response = self.send_command("LINK")
+        if not response:
             return None
+        for line in response.split('\n'):
+            if line.startswith('LINK:'):
+                fields = line[5:].split(':')
+                try:
+                    stats = dict(zip(LINK_FIELDS, (int(v) for v in fields[:len(LINK_FIELDS)])))
+                    opcodes = {}
+                    for entry in filter(None, fields[len(LINK_FIELDS)].split(',')):
+                        verb, count = entry.split('=')
+                        opcodes[verb] = int(count)
+                except (ValueError, IndexError):
+                    return None
+                stats['opcodes'] = opcodes
+                return stats
+        return None
+
+    def _pvt_command(self, command: str) -> Optional[Dict[str, object]]:
+        """Send a PVT command; its PVT:state:buffered:free:done line as a dict"""
+        response = self.send_command(command)
+        if response is None:
+            return None
+        for line in response.split('\n'):
+            if line.startswith('PVT:'):
+                try:
+                    _, state, buffered, free, done = line.split(':')
+                    return {'state': state, 'buffered': int(buffered), 'free': int(free),
+                            'done': int(done), 'rejected': 'rejected' in response}
+                except ValueError:
+                    return None
+        return None
+    
+    def pvt_status(self) -> Optional[Dict[str, object]]:
+        """
+        State of the Teensy's waypoint buffer
+        
+        Returns:
+            Dict with state (IDLE, RUN, DONE, UNDERFLOW or ABORTED), buffered
+            and free point slots, and done (points reached since PVT:GO)
+        """
+        return self._pvt_command("PVT:?")
+    
+    def run_pvt(self, points: List[Tuple[int, int, float, int, float]],
+                wait: bool = True, poll: float = PVT_POLL) -> Optional[Dict[str, object]]:
+        """
+        Follow timed waypoints with cubic interpolation between them
         
-        with self.lock:
+        The Teensy's buffer is filled, the move started, and the rest of the
+        points streamed in as slots free up. If they stop coming while the
+        motors move, the Teensy ramps to a stop (state UNDERFLOW).
+        
+        Args:
+            points: (duration_ms, position1, velocity1, position2, velocity2)
+                per waypoint; duration is from the previous point (>= 10 ms),
+                positions are absolute steps, velocities signed steps/sec.
+                End on zero velocities to stop exactly on the last point.
+            wait: Return only once the move has finished
+            poll: Seconds between status polls while the buffer is full
+            
+        Returns:
+            Final (or, without wait, latest) pvt_status, None on a link error
+        """
+        queue = deque(points)
+        status = self.pvt_status()
+        started = False
+        while queue and status is not None:
+            if started and status['state'] != 'RUN':
+                return status  # Underflow or taken over by another command
+            if status['free'] == 0:
+                if not started:
+                    status = self._pvt_command("PVT:GO")
+                    started = True
+                else:
+                    time.sleep(poll)
+                    status = self.pvt_status()
+                continue
+            duration, pos1, vel1, pos2, vel2 = queue.popleft()
+            status = self._pvt_command(f"PVT:{int(duration)}:{int(pos1)}:{vel1:g}:{int(pos2)}:{vel2:g}")
+            if status and status['rejected']:
+                print(f"PVT point rejected: {duration}, {pos1}, {vel1}, {pos2}, {vel2}")
+                return status
+        
+        if status is not None and not started:
+            status = self._pvt_command("PVT:GO")
+        while wait and status is not None and status['state'] == 'RUN':
+            time.sleep(poll)
+            status = self.pvt_status()
+        return status
+    
+    def run_bench(self) -> Optional[Dict[str, object]]:
+        """
+        Firmware self-benchmark (BENCH:RUN); takes about two seconds
+        
+        The Teensy pulses both STEP pins at rates up to 100 kHz, so power
+        down or unplug the drivers first. Refused while the motors run.
+        
+        Returns:
+            Dict with rows (one dict per rate: rate, pulses1, pulses2,
+            isr_avg_us, isr_max_us, loop_max_us, jitter_max_us, cpu_pct, ok),
+            max_rate (highest rate that passed along with every lower one)
+            and cpu_at_max_speed (ISR CPU % at MAX_SPEED), or None
+        """
+        response = self.send_command("BENCH:RUN")
+        if not response:
+            return None
+        columns = ('rate', 'pulses1', 'pulses2', 'isr_avg_us', 'isr_max_us',
+                   'loop_max_us', 'jitter_max_us', 'cpu_pct', 'ok')
+        result = {'rows': [], 'max_rate': None, 'cpu_at_max_speed': None}
+        for line in response.split('\n'):
+            fields = line.split(':')
+            if fields[0] != 'BENCH':
+                continue
             try:
-                # Send command
-                self.serial_conn.write(f"{command}\n".encode())
-                self.serial_conn.flush()
-                
-                # Read response (timeout after 1 second)
-                response_lines = []
-                start_time = time.time()
-                
-                while time.time() - start_time < 1.0:
-                    if self.serial_conn.in_waiting:
-                        line = self.serial_conn.readline().decode().strip()
-                        if line:
-                            response_lines.append(line)
-                            # For status command, read all lines
-                            if "========" in line and len(response_lines) > 1:
-                                # Read remaining status lines
-                                time.sleep(0.1)
-                                while self.serial_conn.in_waiting:
-                                    line = self.serial_conn.readline().decode().strip()
-                                    if line:
-                                        response_lines.append(line)
-                                break
-                    else:
-                        time.sleep(0.01)
-                
-                return '\n'.join(response_lines) if response_lines else None
-                
-            except Exception as e:
-                print(f"Command error - {e}")
+                if fields[1] == 'MAX':
+                    result['max_rate'] = int(fields[2])
+                    result['cpu_at_max_speed'] = float(fields[3])
+                elif fields[1].isdigit():
+                    row = dict(zip(columns, (float(v) for v in fields[1:])))
+                    for key in ('rate', 'pulses1', 'pulses2'):
+                        row[key] = int(row[key])
+                    row['ok'] = bool(row['ok'])
+                    result['rows'].append(row)
+            except (ValueError, IndexError):
                 return None
+        return result if result['rows'] else None
     
     # Both Motors Commands
     def set_speed_both(self, speed: float) -> bool:
@@ -130,17 +846,15 @@ class DualMotorController:
     
     def move_forward(self, speed: float) -> bool:
         """Move both motors forward at specified speed"""
-        self.send_command("FORWARD")
-        self.set_speed_both(speed)
-        self.send_command("RUN")
-        return True
+        speed = max(0, min(speed, 20000))
+        response = self.send_commands(["FORWARD", f"SPEED:{speed}", "RUN"])
+        return response is not None
     
     def move_backward(self, speed: float) -> bool:
         """Move both motors backward at specified speed"""
-        self.send_command("BACKWARD")
-        self.set_speed_both(speed)
-        self.send_command("RUN")
-        return True
+        speed = max(0, min(speed, 20000))
+        response = self.send_commands(["BACKWARD", f"SPEED:{speed}", "RUN"])
+        return response is not None
     
     def spin_left(self, speed: float) -> bool:
         """Spin left - point turn (M1 back, M2 forward)"""
@@ -172,19 +886,85 @@ class DualMotorController:
         response = self.send_command(f"BOOST:BACKWARD:{speed}")
         return response is not None
     
+    def stop_now(self, emergency: bool = False) -> Optional[PendingCommand]:
+        """
+        Queue STOP (or ESTOP) from any thread without waiting for its ACK
+        
+        A send_commands group still being sent on another thread gives up on
+        the commands it has not queued yet, so nothing sent before the stop
+        can restart the motors after it. An ESTOP also skips the send lock
+        and may use the reserved credit (see _write_command).
+        """
+        with self.flow:
+            self.stop_epoch += 1
+            self.flow.notify_all()
+        return self._write_command("ESTOP" if emergency else "STOP")
+    
+    def wait_for(self, pending: Optional[PendingCommand]) -> Optional[str]:
+        """ACK and output of a command queued with stop_now (None on failure)"""
+        return None if pending is None else self._wait_for(pending)
+    
     def stop_all(self) -> bool:
         """Stop both motors (gradual)"""
-        response = self.send_command("STOP")
-        return response is not None
+        return self.wait_for(self.stop_now()) is not None
     
     def emergency_stop(self) -> bool:
         """Emergency stop both motors (immediate)"""
-        response = self.send_command("ESTOP")
-        return response is not None
+        return self.wait_for(self.stop_now(emergency=True)) is not None
     
     def get_status(self) -> Optional[str]:
         """Get status of both motors"""
         return self.send_command("STATUS")
+
+    def get_status_compact(self) -> Optional[Dict[str, object]]:
+        """
+        Status of both motors as numbers (STATUS:C, one line instead of the dump)
+
+        Returns:
+            Dict with millis, drift, credits, override (percent), paused and
+            motor1/motor2 dicts holding running, speed, target, direction
+            (1/-1), position and boost, or None if the Teensy did not answer
+        """
+        response = self.send_command("STATUS:C")
+        if not response:
+            return None
+        for line in response.split('\n'):
+            if line.startswith('STATUS:'):
+                try:
+                    fields = [int(v) for v in line[7:].split(':')]
+                    motors = [dict(zip(('running', 'speed', 'target', 'direction', 'position', 'boost'),
+                                       fields[1 + 6 * i:7 + 6 * i])) for i in range(2)]
+                    for motor in motors:
+                        motor['running'] = bool(motor['running'])
+                        motor['boost'] = bool(motor['boost'])
+                    return {
+                        'millis': fields[0],
+                        'motor1': motors[0],
+                        'motor2': motors[1],
+                        'drift': fields[13],
+                        'credits': fields[14],
+                        'override': fields[15] if len(fields) > 15 else 100,
+                        'paused': bool(fields[16]) if len(fields) > 16 else False,
+                    }
+                except (ValueError, IndexError):
+                    return None
+        return None
+
+    def set_override(self, percent: int) -> bool:
+        """Scale all motion (speeds and PVT timing) to 0-200% without resending it"""
+        percent = max(0, min(int(percent), 200))
+        response = self.send_command(f"OVERRIDE:{percent}")
+        return response is not None
+    
+    def pause(self) -> bool:
+        """Decelerate along the current move and hold; resume() carries on from there"""
+        response = self.send_command("PAUSE")
+        return response is not None
+    
+    def resume(self) -> bool:
+        """Continue a paused move at the current override"""
+        response = self.send_command("RESUME")
+        return response is not None
     
     def reset_all(self) -> bool:
         """Reset both motor position counters"""
@@ -208,6 +988,20 @@ class DualMotorController:
         enabled_val = 1 if enabled else 0
         response = self.send_command(f"CONFIG:BOOST:{multiplier}:{duration}:{enabled_val}")
         return response is not None
+
+    def configure_shaper(self, kind: str, frequency: float = 0.0, damping: float = 0.0) -> bool:
+        """
+        Configure the velocity input shaper that suppresses platform sway
+        
+        Args:
+            kind: 'ZV', 'ZVD' (slower, tolerates frequency error) or 'OFF'
+            frequency: Sway natural frequency in Hz (down to ~0.4 Hz for ZVD)
+            damping: Damping ratio of the sway (0-1, typically 0.02-0.1)
+        """
+        kind = kind.upper()
+        command = "CONFIG:SHAPER:OFF" if kind == 'OFF' else f"CONFIG:SHAPER:{kind}:{frequency}:{damping}"
+        response = self.send_command(command)
+        return response is not None and response.startswith("Input shaper")
     
     # Individual Motor Commands
     def set_motor_speed(self, motor_num: int, speed: float) -> bool:
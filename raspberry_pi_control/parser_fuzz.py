@@ -0,0 +1,132 @@
+#!/usr/bin/env python3
+"""
+Firmware Command Parser Fuzzer
+Builds teensy_motor_control/host/parser_fuzz.cpp (the real main.cpp on the
+Arduino shim) with AddressSanitizer and UBSan, runs it and fails on:
+    - a crash, out-of-bounds access or undefined behaviour in the receive
+      path (the input that caused it is printed)
+    - an input that leaves motor, boost, shaper, PVT or queue state out of
+      range (NaN speeds, ...) or blocks loop() for too long; a run that
+      hangs outright is stopped after RUN_TIMEOUT_S
+    - parse cost above MAX_WORK_PER_BYTE: bytes scanned or copied by the
+      parser's text operations per byte received, counted exactly
+
+The costliest short inputs (the whole dispatch chain for one unknown byte)
+set the bound; lines are capped at RX_LINE_MAX, so no input can make
+processCommand stall loop() for longer than a line's worth of that.
+Wall time per byte is reported too but not enforced - it includes the
+commands that block by design (direction changes, STOP).
+
+Usage:
+    python3 parser_fuzz.py                          # 200k inputs, seed 1
+    python3 parser_fuzz.py --iterations 2000000 --seed 7
+    python3 parser_fuzz.py --json fuzz.json
+
+Author: Daniel Khito
+Date: 2025
+"""
+
+import argparse
+import json
+import os
+import subprocess
+import sys
+from typing import Dict, List, Optional, Tuple
+
+from teensy_sim import BUILD_DIR, HOST_DIR, SOURCES
+
+FUZZ_SOURCE = os.path.join(HOST_DIR, 'parser_fuzz.cpp')
+FUZZ_BINARY = os.path.join(BUILD_DIR, 'parser_fuzz')
+SANITIZERS = ['-fsanitize=address,undefined,float-cast-overflow', '-fno-sanitize-recover=all']
+
+DEFAULT_ITERATIONS = 200000
+RUN_TIMEOUT_S = 60.0       # Per 100k inputs (a sanitized run takes about 4 s)
+MAX_WORK_PER_BYTE = 32     # Text bytes touched per byte received (worst seen: ~25)
+
+
+def build(force: bool = False) -> str:
+    """Compile the fuzzer if it is missing or stale; returns its path"""
+    sources = SOURCES + [FUZZ_SOURCE]
+    if not force and os.path.exists(FUZZ_BINARY):
+        built = os.path.getmtime(FUZZ_BINARY)
+        if all(os.path.getmtime(src) <= built for src in sources):
+            return FUZZ_BINARY
+
+    os.makedirs(BUILD_DIR, exist_ok=True)
+    compiler = os.environ.get('CXX', 'c++')
+    cmd = [compiler, '-O1', '-g', '-std=gnu++17', *SANITIZERS, '-I', HOST_DIR, FUZZ_SOURCE,
+           '-o', FUZZ_BINARY]
+    result = subprocess.run(cmd, capture_output=True, text=True)
+    if result.returncode != 0:
+        raise RuntimeError(f"Fuzzer build failed:\n{result.stderr}")
+    return FUZZ_BINARY
+
+
+def _run(cmd: List[str], timeout: float) -> Tuple[Optional[int], str, str]:
+    """(exit code or None on timeout, stdout, stderr)"""
+    try:
+        result = subprocess.run(cmd, capture_output=True, timeout=timeout)
+        return result.returncode, result.stdout.decode(), result.stderr.decode(errors='replace')
+    except subprocess.TimeoutExpired as e:
+        return None, '', (e.stderr or b'').decode(errors='replace')
+
+
+def run(iterations: int, seed: int) -> Dict:
+    """Run the fuzzer; returns its report, or one with 'crash' and 'crash_input' set"""
+    cmd = [build(), str(iterations), str(seed)]
+    timeout = RUN_TIMEOUT_S * max(1.0, iterations / 100000)
+    code, stdout, stderr = _run(cmd, timeout)
+    if code == 0:
+        return json.loads(stdout)
+
+    # Same seed, same inputs: rerun echoing each one to find the culprit
+    _, _, traced = _run(cmd + ['trace'], timeout)
+    inputs = [line[len('INPUT '):] for line in traced.splitlines() if line.startswith('INPUT ')]
+    crash = stderr[-4000:] if code is not None else f"hung (no result after {timeout:.0f} s)"
+    return {'seed': seed, 'crash': crash, 'crash_input': inputs[-1] if inputs else None}
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description="Firmware command parser fuzzer (host, sanitized)")
+    parser.add_argument('--iterations', type=int, default=DEFAULT_ITERATIONS, help='Inputs to try')
+    parser.add_argument('--seed', type=int, default=1, help='Mutation seed')
+    parser.add_argument('--json', help='Write the report here')
+    args = parser.parse_args()
+
+    report = run(args.iterations, args.seed)
+    if args.json:
+        with open(args.json, 'w') as f:
+            json.dump(report, f, indent=2)
+        print(f"Report written to {args.json}")
+
+    if 'crash' in report:
+        print("Fuzzer crashed:")
+        print(report['crash'])
+        print(f"on input {report['crash_input']}")
+        return 1
+
+    print(f"{report['inputs']} inputs, {report['bytes']} bytes (seed {report['seed']})")
+    print(f"max parse cost {report['max_work_per_byte']:.1f} text bytes per byte "
+          f"(limit {MAX_WORK_PER_BYTE}), heaviest input {report['max_work']}")
+    print(f"max receive time {report['max_ns_per_byte'] / 1000:.1f} us per byte "
+          f"for {json.dumps(report['slowest_input'])}")
+    print("\nCostliest inputs per byte:")
+    for entry in report['costliest'][:8]:
+        print(f"  {entry['work_per_byte']:6.1f}  {json.dumps(entry['input'])}")
+
+    failures = list(report['failures'])
+    if report['max_work_per_byte'] > MAX_WORK_PER_BYTE:
+        worst = report['costliest'][0]
+        failures.append(f"parse cost {worst['work_per_byte']:.1f} > {MAX_WORK_PER_BYTE} per byte "
+                        f"for {json.dumps(worst['input'])}")
+    if failures:
+        print(f"\n{len(failures)} failures:")
+        for failure in failures:
+            print(f"  {failure}")
+        return 1
+    print("\nNo crashes, state held, parse cost within limit")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,277 @@
+#!/usr/bin/env python3
+"""
+Firmware RAM Budget Report
+Static RAM per firmware subsystem against the Teensy 4.1's (i.MX RT1062)
+memory, plus a check that nothing in main.cpp can reach the heap
+
+The RT1062 has 512 KB of tightly coupled FlexRAM, handed out in 32 KB banks
+to ITCM (code - Teensyduino runs all code from it unless marked FLASHMEM)
+and DTCM (variables, const tables and the stack, which gets whatever the
+variables leave), plus 512 KB of OCRAM for DMAMEM buffers and the heap.
+The firmware uses no heap after setup() (main.cpp traps malloc at run time
+on the Teensy), so DTCM is the budget that matters.
+
+By default main.cpp is compiled for the host against the Arduino shim and
+its symbols are measured there: sizes are the target's to within a few
+bytes per pointer, and ITCM is assumed to be DEFAULT_ITCM_KB. Pass the
+Teensyduino build's ELF (--elf, from the Arduino IDE's build folder) for
+exact sizes, the real ITCM split and the core's share.
+
+The host object must not reference malloc, new, std::string or String;
+any that it does are listed and fail the report. With --elf the linked
+image is checked too, so the Teensy core and libraries are covered: it must
+hold none of newlib's allocator state (main.cpp's malloc family is the one
+that was linked), and its disassembly must show no call into the malloc
+family or operator new from anywhere but the allocator itself. A caller
+that only runs before setup() ends, where main.cpp's boot pool serves it,
+can be accepted with --boot-caller.
+
+Usage:
+    python3 ram_report.py
+    python3 ram_report.py --elf /tmp/arduino_build_123/main.ino.elf
+    python3 ram_report.py --elf main.ino.elf --objdump llvm-objdump
+    python3 ram_report.py --stack-max 3400 --json ram.json   # MEM's stack_max
+
+Author: Daniel Khito
+Date: 2025
+"""
+
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+from typing import Dict, List, Optional, Tuple
+
+from teensy_sim import BUILD_DIR, FIRMWARE_DIR, HOST_DIR
+
+FIRMWARE_SOURCE = os.path.join(FIRMWARE_DIR, 'main.cpp')
+FIRMWARE_OBJECT = os.path.join(BUILD_DIR, 'main_ram.o')
+
+FLEXRAM_KB = 512
+BANK_KB = 32
+OCRAM_KB = 512
+DEFAULT_ITCM_KB = 64          # Firmware plus Teensy core, rounded up to a bank
+DEFAULT_MIN_STACK_KB = 16     # Fail below this much DTCM left for the stack
+
+# Subsystem -> symbol pattern, first match wins (demangled names)
+SUBSYSTEMS = [
+    ('motors and shaper history', r'^motor[12]$'),
+    ('input shaper', r'^shaper$'),
+    ('PVT buffer', r'^pvt'),
+    ('command queue', r'^rx'),
+    ('response buffer', r'^resp'),
+    ('perf counters', r'^(loop(Hist|Count|TotalUs)|lastLoopMicros|isr)'),
+    ('self-benchmark', r'^bench'),
+    ('boot heap', r'(^|::)bootHeap'),
+    ('telemetry', r'[Tt]elemetry'),
+    ('USB link counters', r'^(linkStats|Link|verbs)$'),
+]
+OTHER = 'other firmware state'
+CORE = 'Teensy core and libraries'
+
+# Anything here in the firmware object means some path can allocate
+HEAP_SYMBOLS = re.compile(r'\b(malloc|calloc|realloc|free|_malloc_r|_calloc_r|_realloc_r|_free_r)\b'
+                          r'|operator new|operator delete|basic_string|\bString::')
+STATIC_TYPES = set('bBdDrRgGsS')   # bss, data, read-only, small data
+# Globals of newlib's malloc (full and nano); the linked image must have none
+NEWLIB_ALLOCATOR = re.compile(r'^(__malloc_av_|__malloc_free_list|__malloc_sbrk_start|'
+                              r'__malloc_top_pad|__malloc_trim_threshold)$')
+# Allocation entry points in the linked image (mangled; operator new and new[]),
+# and main.cpp's functions behind them that may call each other
+ALLOCATORS = re.compile(r'^(malloc|calloc|realloc|_malloc_r|_calloc_r|_realloc_r|_Zn[wa]j\w*)$')
+ALLOCATOR_INTERNALS = {'_Z9heapAllocj', '_Z8heapTrapj'}
+# A function's first line and a branch to a symbol in objdump -d (GNU or LLVM)
+DISASSEMBLY_FUNCTION = re.compile(r'^[0-9a-f]+ <([^>]+)>:$')
+DISASSEMBLY_BRANCH = re.compile(r'^\s*[0-9a-f]+:.*\s(b[\w.]*)\s+(?:0x)?[0-9a-f]+\s+<([^>+]+)(?:\+0x[0-9a-f]+)?>')
+
+
+def build_object(force: bool = False) -> str:
+    """Compile main.cpp alone against the shim; returns the object's path"""
+    sources = [FIRMWARE_SOURCE, os.path.join(HOST_DIR, 'Arduino.h')]
+    if not force and os.path.exists(FIRMWARE_OBJECT):
+        built = os.path.getmtime(FIRMWARE_OBJECT)
+        if all(os.path.getmtime(src) <= built for src in sources):
+            return FIRMWARE_OBJECT
+
+    os.makedirs(BUILD_DIR, exist_ok=True)
+    compiler = os.environ.get('CXX', 'c++')
+    cmd = [compiler, '-c', '-O2', '-std=gnu++17', '-I', HOST_DIR, FIRMWARE_SOURCE,
+           '-o', FIRMWARE_OBJECT]
+    result = subprocess.run(cmd, capture_output=True, text=True)
+    if result.returncode != 0:
+        raise RuntimeError(f"Firmware object build failed:\n{result.stderr}")
+    return FIRMWARE_OBJECT
+
+
+def _nm(nm: str, path: str, *flags: str) -> List[str]:
+    result = subprocess.run([nm, '-C', *flags, path], capture_output=True, text=True, check=True)
+    return result.stdout.splitlines()
+
+
+def heap_references(nm: str, obj: str) -> List[str]:
+    """Undefined symbols of the firmware object that reach the heap"""
+    return sorted({line.split(None, 1)[1] for line in _nm(nm, obj, '-u')
+                   if HEAP_SYMBOLS.search(line)})
+
+
+def static_symbols(nm: str, path: str) -> Dict[str, int]:
+    """Name -> size of every variable and constant (static RAM on the Teensy)"""
+    symbols = {}
+    for line in _nm(nm, path, '-S'):
+        # address size type name
+        parts = line.split(None, 3)
+        if len(parts) == 4 and parts[2] in STATIC_TYPES:
+            symbols[parts[3]] = symbols.get(parts[3], 0) + int(parts[1], 16)
+    return symbols
+
+
+def subsystem(name: str) -> str:
+    base = name.split('::')[-1] if '(' in name else name
+    for label, pattern in SUBSYSTEMS:
+        if re.search(pattern, base) or re.search(pattern, name):
+            return label
+    return OTHER
+
+
+def allocator_callers(objdump: str, elf: str) -> List[str]:
+    """'caller -> allocator' for every call or tail call into the malloc
+    family or operator new in the linked image, the allocator's own aside"""
+    result = subprocess.run([objdump, '-d', elf], capture_output=True, text=True, check=True)
+    calls = set()
+    function = None
+    for line in result.stdout.splitlines():
+        header = DISASSEMBLY_FUNCTION.match(line)
+        if header:
+            function = header.group(1)
+            continue
+        branch = DISASSEMBLY_BRANCH.match(line)
+        if not branch or function is None or not ALLOCATORS.match(branch.group(2)):
+            continue
+        if ALLOCATORS.match(function) or function in ALLOCATOR_INTERNALS:
+            continue
+        calls.add(f"{function} -> {branch.group(2)}")
+    return sorted(calls)
+
+
+def elf_sections(size_tool: str, elf: str) -> Dict[str, int]:
+    """Section -> bytes (size -A)"""
+    result = subprocess.run([size_tool, '-A', elf], capture_output=True, text=True, check=True)
+    sections = {}
+    for line in result.stdout.splitlines():
+        parts = line.split()
+        if len(parts) >= 2 and parts[0].startswith('.') and parts[1].isdigit():
+            sections[parts[0]] = int(parts[1])
+    return sections
+
+
+def report(elf: Optional[str], nm: str, size_tool: str, objdump: str, itcm_kb: int,
+           min_stack_kb: int, stack_max: Optional[int],
+           boot_callers: List[str] = ()) -> Tuple[Dict, List[str]]:
+    """(report, failures)"""
+    obj = build_object()
+    firmware = static_symbols('nm', obj)
+    failures = []
+    callers: List[str] = []
+
+    heap = heap_references('nm', obj)
+    if heap:
+        failures.append(f"firmware can reach the heap via {', '.join(heap)}")
+
+    by_subsystem: Dict[str, int] = {}
+    if elf:
+        target = static_symbols(nm, elf)
+        for name, size in target.items():
+            label = subsystem(name) if name in firmware else CORE
+            by_subsystem[label] = by_subsystem.get(label, 0) + size
+        newlib = sorted(name for name in target if NEWLIB_ALLOCATOR.match(name))
+        if newlib:
+            failures.append(f"newlib's allocator is linked in next to the trap ({', '.join(newlib)})")
+        callers = [call for call in allocator_callers(objdump, elf)
+                   if call.split(' -> ')[0] not in boot_callers]
+        if callers:
+            failures.append(f"the linked image allocates: {', '.join(callers)}")
+        sections = elf_sections(size_tool, elf)
+        itcm = sum(size for name, size in sections.items() if name.startswith('.text.itcm'))
+        itcm_banks = max(1, -(-itcm // (BANK_KB * 1024)))
+        dtcm_static = sections.get('.data', 0) + sections.get('.bss', 0)
+        ocram = sections.get('.bss.dma', 0)
+    else:
+        for name, size in firmware.items():
+            label = subsystem(name)
+            by_subsystem[label] = by_subsystem.get(label, 0) + size
+        itcm_banks = max(1, -(-itcm_kb // BANK_KB))
+        dtcm_static = sum(by_subsystem.values())
+        ocram = 0
+
+    dtcm = (FLEXRAM_KB // BANK_KB - itcm_banks) * BANK_KB * 1024
+    stack = dtcm - dtcm_static
+    if stack < min_stack_kb * 1024:
+        failures.append(f"{stack} bytes of DTCM left for the stack, under {min_stack_kb} KB")
+    if stack_max is not None and stack_max > stack:
+        failures.append(f"stack reached {stack_max} bytes, more than the {stack} available")
+
+    return {
+        'source': 'elf' if elf else 'host object',
+        'subsystems': dict(sorted(by_subsystem.items(), key=lambda item: -item[1])),
+        'itcm_bytes': itcm_banks * BANK_KB * 1024,
+        'dtcm_bytes': dtcm,
+        'dtcm_static_bytes': dtcm_static,
+        'stack_bytes': stack,
+        'stack_max_bytes': stack_max,
+        'ocram_bytes': OCRAM_KB * 1024,
+        'ocram_static_bytes': ocram,
+        'heap_references': heap,
+        'allocator_callers': callers,
+    }, failures
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description="Firmware static RAM per subsystem vs. RT1062 budget")
+    parser.add_argument('--elf', help='Teensyduino build output to measure instead of the host object')
+    parser.add_argument('--nm', default='arm-none-eabi-nm', help='nm for --elf')
+    parser.add_argument('--size', default='arm-none-eabi-size', help='size for --elf')
+    parser.add_argument('--objdump', default='arm-none-eabi-objdump', help='objdump for --elf')
+    parser.add_argument('--boot-caller', action='append', default=[], metavar='SYMBOL',
+                        help='Accept allocations from this function (mangled; runs only before '
+                             'setup() ends). Repeatable')
+    parser.add_argument('--itcm-kb', type=int, default=DEFAULT_ITCM_KB,
+                        help='Code in ITCM when measuring the host object')
+    parser.add_argument('--min-stack-kb', type=int, default=DEFAULT_MIN_STACK_KB,
+                        help='Fail if less DTCM than this is left for the stack')
+    parser.add_argument('--stack-max', type=int, help="Stack high-water mark from MEM (bytes)")
+    parser.add_argument('--json', help='Write the report here')
+    args = parser.parse_args()
+
+    result, failures = report(args.elf, args.nm, args.size, args.objdump, args.itcm_kb,
+                              args.min_stack_kb, args.stack_max, args.boot_caller)
+    if args.json:
+        with open(args.json, 'w') as f:
+            json.dump(result, f, indent=2)
+        print(f"Report written to {args.json}")
+
+    dtcm = result['dtcm_bytes']
+    print(f"Static RAM by subsystem ({result['source']}):")
+    for label, size in result['subsystems'].items():
+        print(f"  {label:<28} {size:>7} B  {size / dtcm:6.1%} of DTCM")
+    itcm_note = '' if args.elf else ' (assumed, --elf for the real split)'
+    print(f"\nFlexRAM {FLEXRAM_KB} KB: ITCM {result['itcm_bytes'] // 1024} KB{itcm_note}, "
+          f"DTCM {dtcm // 1024} KB")
+    print(f"DTCM: {result['dtcm_static_bytes']} B static, {result['stack_bytes']} B left for the stack"
+          + (f" (high-water {result['stack_max_bytes']} B)" if result['stack_max_bytes'] else ''))
+    print(f"OCRAM: {result['ocram_static_bytes']} B of {OCRAM_KB} KB (DMAMEM), no heap use after setup()")
+    print(f"Heap references in main.cpp: {', '.join(result['heap_references']) or 'none'}")
+    if args.elf:
+        print(f"Allocator calls in the image: {', '.join(result['allocator_callers']) or 'none'}")
+
+    if failures:
+        print(f"\n{len(failures)} failures:")
+        for failure in failures:
+            print(f"  {failure}")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+"""
+Server Reply Test
+Checks that every 'command' message the page sends gets an answer carrying
+its id: per-board acks when it went out, one error reply when it could not
+
+Drives JoystickServer.process_message with a stand-in WebSocket and one
+simulated board (sim://), through:
+    - a valid command (an ack from the board)
+    - a missing, non-string or empty command
+    - an unknown @board: prefix and a malformed MOVE
+    - the board queues failing to take the command
+    - a message that is not JSON (error reply without an id)
+
+Usage:
+    python3 server_reply_test.py
+
+Author: Daniel Khito
+Date: 2025
+"""
+
+import argparse
+import asyncio
+import contextlib
+import io
+import json
+import sys
+from typing import Dict, List
+
+from websocket_server import JoystickServer
+
+REPLY_WAIT_S = 5.0
+
+
+class RecordingSocket:
+    """Collects what the server sends to one page"""
+
+    def __init__(self):
+        self.sent: List[Dict] = []
+
+    async def send(self, message: str):
+        self.sent.append(json.loads(message))
+
+
+async def reply_to(server: JoystickServer, message: str, msg_id) -> List[Dict]:
+    """Replies to one message, waiting for the first if need be"""
+    socket = RecordingSocket()
+    await server.process_message(socket, message)
+    end = asyncio.get_running_loop().time() + REPLY_WAIT_S
+    while not socket.sent and asyncio.get_running_loop().time() < end:
+        await asyncio.sleep(0.01)
+    return [reply for reply in socket.sent if reply.get('id') == msg_id]
+
+
+async def run() -> List[str]:
+    failures = []
+    server = JoystickServer({'board': 'sim://'})
+    server.loop = asyncio.get_running_loop()
+    with contextlib.redirect_stdout(io.StringIO()):
+        if not server.pool.connect():
+            return ["sim board failed to connect"]
+    try:
+        replies = await reply_to(server, json.dumps(
+            {'type': 'command', 'command': 'STATUS:C', 'id': 1}), 1)
+        if [reply.get('type') for reply in replies] != ['ack'] or not replies[0].get('ok'):
+            failures.append(f"valid command: expected one ok ack, got {replies}")
+
+        bad = {
+            'missing command': {'type': 'command', 'id': 2},
+            'non-string command': {'type': 'command', 'command': 42, 'id': 3},
+            'empty command': {'type': 'command', 'command': ' ', 'id': 4},
+            'unknown board': {'type': 'command', 'command': '@nowhere:STATUS', 'id': 5},
+            'malformed MOVE': {'type': 'command', 'command': 'MOVE:FORWARD', 'id': 6},
+        }
+        for case, message in bad.items():
+            replies = await reply_to(server, json.dumps(message), message['id'])
+            if [reply.get('type') for reply in replies] != ['error']:
+                failures.append(f"{case}: expected one error reply with id "
+                                f"{message['id']}, got {replies}")
+
+        def refuse(*args, **kwargs):
+            raise RuntimeError("cannot schedule new futures after shutdown")
+        post, server.pool.post = server.pool.post, refuse
+        replies = await reply_to(server, json.dumps(
+            {'type': 'command', 'command': 'SPEED:100', 'id': 7}), 7)
+        server.pool.post = post
+        if [reply.get('type') for reply in replies] != ['error']:
+            failures.append(f"queues refusing the command: expected an error reply, got {replies}")
+        if 7 in server.command_boards:
+            failures.append("a refused command is still counted as in flight")
+
+        replies = await reply_to(server, '{"type": "command", ', None)
+        if [reply.get('type') for reply in replies] != ['error']:
+            failures.append(f"invalid JSON: expected an error reply, got {replies}")
+    finally:
+        with contextlib.redirect_stdout(io.StringIO()):
+            server.pool.disconnect()
+    return failures
+
+
+def main():
+    argparse.ArgumentParser(description='Every command message gets a reply with its id').parse_args()
+    print("Server replies: every command message answered with its id")
+    failures = asyncio.run(run())
+    for failure in failures:
+        print(f"  ✗ {failure}")
+    if failures:
+        print(f"FAILED: {len(failures)} check(s)")
+        return 1
+    print("✓ Every command got an ack or an error reply with its id")
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,329 @@
+#!/usr/bin/env python3
+"""
+Accelerated-Time Soak Test
+Runs days of mixed motion through the host simulator in minutes and checks
+invariants the whole way, to catch what only shows up after hours: the
+32-bit position wrap (about 30 h at MAX_SPEED), millis() rolling over under
+the boost and ramp timers, float creep in the ramp
+
+The simulator boots shortly before millis() wraps, with both positions
+shortly before the 32-bit wrap, and charges a coarse loop() pass (--loop-cost-us) so virtual time races ahead; the step ISRs
+still fire on the exact PIT schedule. Motion is a random mix of cruise
+speeds up to MAX_SPEED, feed overrides, pause/resume, reversals (paused,
+so both motors turn together), boosts and the occasional STOP/ESTOP,
+biased forward so the positions really wrap.
+
+Invariants, checked every --check-every virtual seconds:
+    - each firmware position equals the pulses on its STEP pin signed by
+      DIR, modulo 2^32 (exact while still, within the ACK window in motion)
+    - |drift| between the motors stays within DRIFT_BOUND of where the
+      last STOP/ESTOP left it (those stop the motors one after the other)
+    - millis() in STATUS:C advances exactly with virtual time, across the wrap
+    - settled speeds equal target x override (0 while paused)
+    - a boost ends on time
+
+Usage:
+    python3 soak_test.py                     # 3 virtual days
+    python3 soak_test.py --days 7 --seed 2 --json soak.json
+    python3 soak_test.py --hours 2           # quick look
+
+Author: Daniel Khito
+Date: 2025
+"""
+
+import argparse
+import json
+import random
+import sys
+import time
+from typing import Dict, List, Optional
+
+from teensy_sim import TeensySim
+
+MAX_SPEED = 20000            # steps/sec (main.cpp)
+ACCEL = 8000                 # steps/sec^2 for the soak
+BOOST_MULTIPLIER = 1.5
+BOOST_MS = 800
+SETTLE_S = 2 * MAX_SPEED / ACCEL + 1.0   # Longest ramp, both ways, plus margin
+MILLIS_WRAP_S = 2 ** 32 / 1000
+
+DEFAULT_LOOP_COST_US = 100.0   # Coarse loop() pass: ~700x real time
+DEFAULT_CHECK_S = 60.0
+DEFAULT_BOOT_BEFORE_WRAP_S = 600.0
+DEFAULT_STEPS_BEFORE_WRAP = 20000000   # A few virtual hours of the forward-biased mix
+DRIFT_BOUND = 2                # Steps, coordinated motion
+MILLIS_SLACK = 1               # ms
+SPEED_SLACK = 1                # steps/sec (STATUS:C rounds to whole steps/sec)
+COMMAND_TIMEOUT_S = 30.0       # Virtual; STOP from MAX_SPEED blocks for seconds
+MAX_FAILURES = 20
+
+# Segment mix: action -> weight
+ACTIONS = {'cruise': 40, 'override': 20, 'pause': 10, 'reverse': 10, 'boost': 10,
+           'stop': 6, 'estop': 4}
+SEGMENT_S = (10.0, 1800.0)     # Hold time range after each action
+
+
+def wrap32(value: int) -> int:
+    """Two's complement 32-bit value, as the firmware holds positions"""
+    return (value + 2 ** 31) % 2 ** 32 - 2 ** 31
+
+
+def parse_status(lines: List[str]) -> Optional[Dict]:
+    for line in lines:
+        if line.startswith('STATUS:'):
+            f = line.split(':')[1:]
+            return {
+                'millis': int(f[0]),
+                'speed': [int(f[2]), int(f[8])],
+                'target': [int(f[3]), int(f[9])],
+                'position': [int(f[5]), int(f[11])],
+                'boost': [f[6] == '1', f[12] == '1'],
+                'drift': int(f[13]),
+                'override': int(f[15]),
+                'paused': f[16] == '1',
+            }
+    return None
+
+
+class Soak:
+    def __init__(self, args):
+        self.args = args
+        self.rng = random.Random(args.seed)
+        boot_s = MILLIS_WRAP_S - args.boot_before_wrap
+        self.sim = TeensySim(loop_cost_us=args.loop_cost_us, start_time_s=boot_s)
+        self.boot_s = boot_s
+        start = 2 ** 31 - args.steps_before_wrap
+        self.sim.set_positions(start, start)
+        self.failures: List[str] = []
+        self.checks = 0
+        self.last_change = 0.0       # Virtual time of the last motion command
+        self.boost_at: Optional[float] = None
+        self.drift_base = 0
+        self.max_drift = 0
+        self.max_stop_drift = 0
+        self.last_millis: Optional[int] = None
+        self.last_millis_at = 0.0
+        self.running = False
+        self.direction = 1
+        self.speed = 0
+        self.override = 100
+        self.paused = False
+        self.counts = {action: 0 for action in ACTIONS}
+
+    # Helpers
+
+    def command(self, command: str) -> List[str]:
+        return self.sim.command(command, timeout=COMMAND_TIMEOUT_S)
+
+    def motion(self, command: str):
+        self.command(command)
+        self.last_change = self.sim.now
+
+    def fail(self, message: str):
+        hours = (self.sim.now - self.boot_s) / 3600
+        self.failures.append(f"[{hours:8.3f} h] {message}")
+
+    def drift(self) -> int:
+        steps = self.sim.net_steps
+        return steps['motor1'] - steps['motor2']
+
+    def rebaseline(self):
+        """STOP and ESTOP stop the motors one after the other; drift restarts from there"""
+        drift = self.drift()
+        self.max_stop_drift = max(self.max_stop_drift, abs(drift - self.drift_base))
+        self.drift_base = drift
+
+    # Invariants
+
+    def check(self):
+        self.checks += 1
+        status = parse_status(self.command("STATUS:C"))
+        now = self.sim.now
+        if status is None:
+            self.fail("no STATUS:C line")
+            return
+        steps = self.sim.net_steps
+
+        # Positions against emitted pulses (the ACK window allows a few steps in motion)
+        window = 2 * MAX_SPEED * (self.args.loop_cost_us + 100) / 1e6 + 1
+        for i, name in enumerate(('motor1', 'motor2')):
+            error = wrap32(steps[name] - status['position'][i])
+            allowed = 0 if status['speed'][i] == 0 else window
+            if abs(error) > allowed:
+                self.fail(f"{name} position {status['position'][i]} vs {wrap32(steps[name])} "
+                          f"pulses (off by {error})")
+
+        # Drift during coordinated motion, and the firmware's own drift figure
+        drift = self.drift() - self.drift_base
+        self.max_drift = max(self.max_drift, abs(drift))
+        if abs(drift) > DRIFT_BOUND:
+            self.fail(f"drift {drift} steps since the last stop")
+        reported = abs(wrap32(status['position'][0] - status['position'][1]))
+        if status['speed'] == [0, 0] and status['drift'] != reported:
+            self.fail(f"STATUS:C drift {status['drift']} != |pos1 - pos2| {reported}")
+
+        # millis() tracks virtual time across the wrap
+        expected = int(now * 1000) % 2 ** 32
+        if abs(wrap32(status['millis'] - expected)) > MILLIS_SLACK:
+            self.fail(f"millis() {status['millis']}, expected {expected}")
+        if self.last_millis is not None:
+            advanced = (status['millis'] - self.last_millis) % 2 ** 32
+            if abs(advanced - (now - self.last_millis_at) * 1000) > MILLIS_SLACK + 1:
+                self.fail(f"millis() advanced {advanced} ms in {(now - self.last_millis_at) * 1000:.0f} ms")
+        self.last_millis, self.last_millis_at = status['millis'], now
+
+        # Boost ends on time
+        if self.boost_at is not None and now - self.boost_at > BOOST_MS / 1000 + 0.05:
+            if any(status['boost']):
+                self.fail(f"boost still active {now - self.boost_at:.1f} s after BOOST")
+            self.boost_at = None
+
+        # Settled speeds
+        if now - self.last_change >= SETTLE_S and self.running and not any(status['boost']):
+            for i, name in enumerate(('motor1', 'motor2')):
+                if self.paused:
+                    expected_speed = 0
+                else:
+                    expected_speed = min(status['target'][i] * status['override'] / 100, MAX_SPEED)
+                if abs(status['speed'][i] - expected_speed) > SPEED_SLACK:
+                    self.fail(f"{name} settled at {status['speed'][i]} steps/s, expected "
+                              f"{expected_speed:.0f}")
+
+    def hold(self, seconds: float):
+        end = self.sim.now + seconds
+        while self.sim.now < end and len(self.failures) < MAX_FAILURES:
+            self.sim.advance(min(self.args.check_every, end - self.sim.now))
+            self.sim.read()  # Discard SYNC warnings and the like
+            self.check()
+
+    # Motion mix
+
+    def set_direction(self, direction: int):
+        # Reverse only while paused, so both motors turn together
+        was_paused = self.paused
+        if not was_paused and self.running:
+            self.motion("PAUSE")
+            self.sim.advance(SETTLE_S)
+        self.motion("FORWARD" if direction > 0 else "BACKWARD")
+        if not was_paused and self.running:
+            self.motion("RESUME")
+        self.direction = direction
+
+    def step(self):
+        action = self.rng.choices(list(ACTIONS), weights=list(ACTIONS.values()))[0]
+        self.counts[action] += 1
+
+        if action in ('cruise', 'boost') and self.paused:
+            self.motion("RESUME")
+            self.paused = False
+        if action == 'cruise':
+            self.speed = MAX_SPEED if self.rng.random() < 0.3 else self.rng.randrange(500, MAX_SPEED)
+            self.motion(f"SPEED:{self.speed}")
+            if not self.running:
+                self.motion("RUN")
+                self.running = True
+        elif action == 'override':
+            self.override = self.rng.choice([25, 50, 75, 100, 100, 125, 150, 200])
+            self.motion(f"OVERRIDE:{self.override}")
+        elif action == 'pause':
+            self.motion("RESUME" if self.paused else "PAUSE")
+            self.paused = not self.paused
+        elif action == 'reverse':
+            forward = self.rng.random() < self.args.forward_bias
+            self.set_direction(1 if forward else -1)
+        elif action == 'boost' and self.running:
+            self.speed = self.rng.randrange(2000, int(MAX_SPEED / BOOST_MULTIPLIER))
+            self.motion(f"BOOST:{'FORWARD' if self.direction > 0 else 'BACKWARD'}:{self.speed}")
+            self.boost_at = self.sim.now
+        elif action in ('stop', 'estop') and self.running:
+            self.motion("STOP" if action == 'stop' else "ESTOP")
+            self.running = self.paused = False
+            self.rebaseline()
+
+        self.hold(self.rng.uniform(*SEGMENT_S))
+
+    def run(self) -> Dict:
+        for command in (f"CONFIG:ACCEL:{ACCEL}", f"CONFIG:BOOST:{BOOST_MULTIPLIER}:{BOOST_MS}:1",
+                        "CONFIG:SHAPER:OFF", "FORWARD"):
+            self.command(command)
+        duration = self.args.days * 86400 + self.args.hours * 3600
+        end = self.boot_s + duration
+        started = time.perf_counter()
+        next_report = self.boot_s + 3600 * 6
+        while self.sim.now < end and len(self.failures) < MAX_FAILURES:
+            self.step()
+            if self.sim.now >= next_report:
+                self.report_progress(started)
+                next_report += 3600 * 6
+        wall = time.perf_counter() - started
+        self.check()
+
+        steps = self.sim.net_steps
+        pulses = self.sim.step_counts
+        virtual = self.sim.now - self.boot_s
+        return {
+            'virtual_hours': round(virtual / 3600, 2),
+            'wall_seconds': round(wall, 1),
+            'speedup': round(virtual / wall, 1),
+            'steps': sum(pulses.values()),
+            'steps_per_wall_second': round(sum(pulses.values()) / wall),
+            'checks': self.checks,
+            'net_steps': steps,
+            'positions_wrapped': any(not -2 ** 31 <= s < 2 ** 31 for s in steps.values()),
+            'millis_wrapped': self.sim.now >= MILLIS_WRAP_S,
+            'max_drift': self.max_drift,
+            'max_stop_drift': self.max_stop_drift,
+            'actions': self.counts,
+            'failures': self.failures,
+        }
+
+    def report_progress(self, started: float):
+        hours = (self.sim.now - self.boot_s) / 3600
+        wall = time.perf_counter() - started
+        steps = self.sim.net_steps
+        print(f"{hours:7.1f} h virtual  {wall:7.1f} s wall  pos {steps['motor1']:>12}/{steps['motor2']:<12} "
+              f"checks {self.checks}  failures {len(self.failures)}", file=sys.stderr)
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description="Accelerated-time soak test (host simulator)")
+    parser.add_argument('--days', type=float, default=3.0, help='Virtual days to run')
+    parser.add_argument('--hours', type=float, default=0.0, help='Virtual hours to add')
+    parser.add_argument('--seed', type=int, default=1, help='Motion mix seed')
+    parser.add_argument('--loop-cost-us', type=float, default=DEFAULT_LOOP_COST_US,
+                        help='Virtual time per loop() pass')
+    parser.add_argument('--check-every', type=float, default=DEFAULT_CHECK_S,
+                        help='Virtual seconds between invariant checks')
+    parser.add_argument('--boot-before-wrap', type=float, default=DEFAULT_BOOT_BEFORE_WRAP_S,
+                        help='Boot this many seconds before millis() wraps')
+    parser.add_argument('--steps-before-wrap', type=int, default=DEFAULT_STEPS_BEFORE_WRAP,
+                        help='Start both positions this many steps before the 32-bit wrap')
+    parser.add_argument('--forward-bias', type=float, default=0.8,
+                        help='Chance a reversal picks forward (makes positions wrap)')
+    parser.add_argument('--json', help='Write the report here')
+    args = parser.parse_args()
+    if args.hours and args.days == parser.get_default('days'):
+        args.days = 0.0
+
+    result = Soak(args).run()
+    print(f"{result['virtual_hours']} h virtual in {result['wall_seconds']} s "
+          f"({result['speedup']}x), {result['steps']} steps "
+          f"({result['steps_per_wall_second']} steps/s wall), {result['checks']} checks")
+    print(f"positions wrapped: {'yes' if result['positions_wrapped'] else 'no'}, "
+          f"millis() wrapped: {'yes' if result['millis_wrapped'] else 'no'}, "
+          f"max drift {result['max_drift']} (after stops up to {result['max_stop_drift']})")
+    if args.json:
+        with open(args.json, 'w') as f:
+            json.dump(result, f, indent=2)
+        print(f"Report written to {args.json}")
+    if result['failures']:
+        print(f"\n{len(result['failures'])} invariant failures:")
+        for failure in result['failures']:
+            print(f"  {failure}")
+        return 1
+    print("All invariants held")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
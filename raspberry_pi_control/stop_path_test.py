@@ -0,0 +1,185 @@
+#!/usr/bin/env python3
+"""
+Stop Path Test
+Checks that an ESTOP overtakes a long command group a board is still
+sending, through the same ControllerPool calls the server makes
+
+One simulated board cruises, then the bytes written to it are held back
+(the Teensy stops ACKing, as it does mid STOP ramp) while a group longer
+than its queue is posted, so the board's worker blocks waiting for
+credits. A second group queues behind it. ControllerPool.stop(emergency=
+True) must then:
+    - put ESTOP on the wire next, without waiting for the blocked group
+    - never send the rest of that group, after ESTOP or once released
+    - drop the queued group unsent
+    - get the ESTOP ACKed once the link flows again, with both motors stopped
+
+Usage:
+    python3 stop_path_test.py
+    python3 stop_path_test.py --group 200
+
+Author: Daniel Khito
+Date: 2025
+"""
+
+import argparse
+import contextlib
+import io
+import sys
+import threading
+import time
+from typing import Dict, List
+
+from controller_pool import ControllerPool
+
+DEFAULT_GROUP = 64           # Lines; well past the firmware's queue
+CRUISE_SPEED = 3000
+ESTOP_WAIT_S = 0.5           # ESTOP must reach the wire within this
+SETTLE_S = 0.3
+
+
+class HeldWire:
+    """Records the lines written to a SimSerial; while holding, keeps the
+    bytes from the firmware until release()"""
+
+    def __init__(self, port):
+        self.port = port
+        self.deliver = port.write
+        self.lines: List[str] = []
+        self.held = bytearray()
+        self.holding = False
+        self.lock = threading.Lock()
+        port.write = self.write
+
+    def write(self, data: bytes) -> int:
+        with self.lock:
+            self.lines += bytes(data).decode(errors='replace').splitlines()
+            if self.holding:
+                self.held += data
+                return len(data)
+        return self.deliver(data)
+
+    def release(self):
+        with self.lock:
+            self.holding = False
+            data, self.held = bytes(self.held), bytearray()
+        if data:
+            self.deliver(data)
+
+    def wait_for_line(self, line: str, timeout: float) -> bool:
+        end = time.perf_counter() + timeout
+        while time.perf_counter() < end:
+            with self.lock:
+                if line in self.lines:
+                    return True
+            time.sleep(0.005)
+        return False
+
+
+def run(group_lines: int) -> List[str]:
+    """Returns the failures"""
+    failures = []
+    pool = ControllerPool({'board': 'sim://'})
+    with contextlib.redirect_stdout(io.StringIO()):
+        connected = pool.connect()
+    if not connected:
+        return ["sim board failed to connect"]
+    controller = pool.controllers['board']
+    wire = HeldWire(controller.serial_conn)
+    try:
+        if pool.send('board', [f"SPEED:{CRUISE_SPEED}", "FORWARD", "RUN"]) is None:
+            return ["cruise setup not ACKed"]
+        time.sleep(SETTLE_S)
+
+        # A group the board cannot take in one go, blocked on credits
+        results: Dict[str, tuple] = {}
+        done = threading.Event()
+
+        def finished(key):
+            def callback(name, response, superseded):
+                results[key] = (response, superseded)
+                if len(results) == 2:
+                    done.set()
+            return callback
+
+        group = [f"SPEED:{1000 + i}" for i in range(group_lines)]
+        throttled = controller.stats['throttled_sends']
+        with wire.lock:
+            wire.holding = True
+        pool.post(group, done=finished('long'))
+        pool.post(["SPEED:1", "RUN"], done=finished('queued'))
+        end = time.perf_counter() + 2.0
+        while controller.stats['throttled_sends'] == throttled and time.perf_counter() < end:
+            time.sleep(0.005)
+        if controller.stats['throttled_sends'] == throttled:
+            return ["the long group never blocked on credits"]
+        sent_before = len(wire.lines)
+
+        stopped: Dict[str, bool] = {}
+        stopper = threading.Thread(target=lambda: stopped.update(pool.stop(emergency=True)))
+        started = time.perf_counter()
+        stopper.start()
+        if not wire.wait_for_line("ESTOP", ESTOP_WAIT_S):
+            failures.append(f"ESTOP not on the wire within {ESTOP_WAIT_S * 1000:.0f} ms "
+                            f"of stop() while a group was blocked")
+        else:
+            print(f"  ESTOP on the wire {(time.perf_counter() - started) * 1000:.1f} ms after stop()")
+        with wire.lock:
+            ahead = wire.lines[sent_before:wire.lines.index("ESTOP")] if "ESTOP" in wire.lines else []
+        if ahead:
+            failures.append(f"{len(ahead)} line(s) written between stop() and ESTOP: {ahead[:3]}")
+
+        wire.release()
+        stopper.join(timeout=5.0)
+        if stopped.get('board') is not True:
+            failures.append(f"ESTOP not ACKed ({stopped})")
+        if not done.wait(timeout=5.0):
+            failures.append(f"posted groups never finished ({sorted(results)})")
+        time.sleep(SETTLE_S)
+
+        with wire.lock:
+            after = wire.lines[wire.lines.index("ESTOP") + 1:] if "ESTOP" in wire.lines else []
+        late = [line for line in after if line in group or line == "SPEED:1" or line == "RUN"]
+        if late:
+            failures.append(f"{len(late)} group line(s) sent after ESTOP: {late[:3]}")
+        unsent = sum(1 for line in group if line not in wire.lines)
+        print(f"  long group: {group_lines - unsent} of {group_lines} lines sent before the stop")
+        if unsent == 0:
+            failures.append("the whole long group went out; the stop cut nothing short")
+        if results.get('long', (None, False))[0] is not None:
+            failures.append("the cut-short group reported success")
+        if results.get('queued') != (None, True):
+            failures.append(f"the queued group was not dropped unsent ({results.get('queued')})")
+
+        status = controller.get_status_compact()
+        if status is None:
+            failures.append("no STATUS:C after the ESTOP")
+        elif status['motor1']['speed'] or status['motor2']['speed']:
+            failures.append(f"motors still turning after ESTOP: "
+                            f"{status['motor1']['speed']}, {status['motor2']['speed']} steps/s")
+    finally:
+        wire.release()
+        with contextlib.redirect_stdout(io.StringIO()):
+            pool.disconnect()
+    return failures
+
+
+def main():
+    parser = argparse.ArgumentParser(description='ESTOP overtakes a blocked command group')
+    parser.add_argument('--group', type=int, default=DEFAULT_GROUP,
+                        help=f'Lines in the blocked group (default {DEFAULT_GROUP})')
+    args = parser.parse_args()
+
+    print("Stop path: ESTOP while a long group is blocked")
+    failures = run(args.group)
+    for failure in failures:
+        print(f"  ✗ {failure}")
+    if failures:
+        print(f"FAILED: {len(failures)} check(s)")
+        return 1
+    print("✓ ESTOP went out first and the blocked group was cut short")
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
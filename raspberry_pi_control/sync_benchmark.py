@@ -0,0 +1,284 @@
+#!/usr/bin/env python3
+"""
+Motor Synchronization Benchmark
+Sweeps speed, acceleration, direction-change rate and boost, captures
+high-rate position telemetry and reports a drift matrix
+
+Positions come from the firmware's T: telemetry frames, which snapshot both
+motor positions with interrupts disabled, so every sample is a true
+instantaneous drift rather than two reads taken at different times.
+
+Usage:
+    python3 sync_benchmark.py --sim                      # host simulator
+    python3 sync_benchmark.py --port /dev/ttyACM0        # hardware
+    python3 sync_benchmark.py --sim --quick --json out.json
+    python3 sync_benchmark.py --sim --baseline out.json  # exit 1 on regression
+
+Author: Daniel Khito
+Date: 2025
+"""
+
+import argparse
+import itertools
+import json
+import platform
+import subprocess
+import sys
+import time
+from typing import Dict, List, Optional, Tuple
+
+from telemetry_recorder import position_diff
+
+REPORT_VERSION = 1
+
+# Default sweep
+SPEEDS = [2000, 8000, 16000]           # steps/sec
+ACCELS = [4000, 8000, 16000]           # steps/sec^2
+REVERSAL_RATES = [0.0, 0.5, 2.0]       # direction changes per second
+BOOSTS = [False, True]
+QUICK_SPEEDS = [4000, 16000]
+QUICK_ACCELS = [8000]
+QUICK_REVERSAL_RATES = [0.0, 1.0]
+
+RUN_SECONDS = 4.0          # Motion time per condition
+SETTLE_SECONDS = 0.5       # Telemetry captured after STOP
+TELEMETRY_MS = 1           # Frame period while measuring
+BOOST_CONFIG = "CONFIG:BOOST:1.5:800:{enabled}"
+
+# Regression thresholds against a baseline report
+MAX_DRIFT_TOLERANCE = 0.10   # Relative
+MAX_DRIFT_SLACK = 2          # Steps, absorbs noise on tiny drifts
+
+Frame = Tuple[float, int, int]   # (seconds, position1, position2)
+
+
+class SimTarget:
+    """Drives the host simulator in virtual time"""
+
+    name = 'sim'
+
+    def __init__(self):
+        from teensy_sim import TeensySim
+        self.sim = TeensySim()
+        self.frames: List[Frame] = []
+
+    def _collect(self, lines: List[str]):
+        for line in lines:
+            frame = parse_frame(line)
+            if frame:
+                self.frames.append(frame)
+
+    def send(self, command: str):
+        self._collect(self.sim.command(command))
+
+    def wait(self, seconds: float):
+        end = self.sim.now + seconds
+        while self.sim.now < end:
+            self.sim.advance(min(0.05, end - self.sim.now))
+            self._collect(self.sim.read_lines())
+
+    def close(self):
+        self.sim.close()
+
+
+class HardwareTarget:
+    """Drives a real Teensy through DualMotorController"""
+
+    name = 'hardware'
+
+    def __init__(self, port: str):
+        from motor_controller import DualMotorController
+        self.controller = DualMotorController(port)
+        if not self.controller.connect():
+            raise RuntimeError(f"Could not connect to Teensy at {port}")
+        self.frames: List[Frame] = []
+        self.controller.telemetry_callbacks.append(self._on_frame)
+
+    def _on_frame(self, frame: Dict[str, int]):
+        self.frames.append((frame['millis'] / 1000.0, frame['position1'], frame['position2']))
+
+    def send(self, command: str):
+        if self.controller.send_command(command) is None:
+            raise RuntimeError(f"No response to {command}")
+
+    def wait(self, seconds: float):
+        time.sleep(seconds)
+
+    def close(self):
+        self.controller.send_command("TELEMETRY:0")
+        self.controller.disconnect()
+
+
+def parse_frame(line: str) -> Optional[Frame]:
+    """T:<ms>:<pos1>:<pos2>:... -> (seconds, pos1, pos2)"""
+    if not line.startswith('T:'):
+        return None
+    try:
+        fields = line[2:].split(':')
+        return int(fields[0]) / 1000.0, int(fields[1]), int(fields[2])
+    except (ValueError, IndexError):
+        return None
+
+
+def run_condition(target, speed: int, accel: int, reversal_hz: float, boost: bool) -> Dict:
+    """Run one motion scenario and summarize its drift"""
+    target.send("STOP")
+    target.send(f"CONFIG:ACCEL:{accel}")
+    target.send(BOOST_CONFIG.format(enabled=1 if boost else 0))
+    target.send("FORWARD")
+    target.send("SYNC")
+    target.frames.clear()
+    target.send(f"TELEMETRY:{TELEMETRY_MS}")
+
+    if boost:
+        target.send(f"BOOST:FORWARD:{speed}")
+    else:
+        target.send(f"SPEED:{speed}")
+        target.send("RUN")
+
+    # Reverse at the requested rate for the rest of the run
+    elapsed = 0.0
+    forward = True
+    interval = 1.0 / reversal_hz if reversal_hz > 0 else RUN_SECONDS
+    while elapsed < RUN_SECONDS:
+        step = min(interval, RUN_SECONDS - elapsed)
+        target.wait(step)
+        elapsed += step
+        if reversal_hz > 0 and elapsed < RUN_SECONDS:
+            forward = not forward
+            target.send("FORWARD" if forward else "BACKWARD")
+
+    target.send("STOP")
+    target.wait(SETTLE_SECONDS)
+    target.send("TELEMETRY:0")
+
+    frames = list(target.frames)
+    drifts = [abs(position_diff(p1, p2)) for _, p1, p2 in frames]
+    final = frames[-1] if frames else (0.0, 0, 0)
+    return {
+        'speed': speed,
+        'accel': accel,
+        'reversal_hz': reversal_hz,
+        'boost': boost,
+        'frames': len(frames),
+        'max_drift': max(drifts) if drifts else None,
+        'mean_drift': round(sum(drifts) / len(drifts), 3) if drifts else None,
+        'final_drift': abs(position_diff(final[1], final[2])),
+        'distance': max(abs(final[1]), abs(final[2])),
+    }
+
+
+def condition_key(result: Dict) -> Tuple:
+    return (result['speed'], result['accel'], result['reversal_hz'], result['boost'])
+
+
+def git_revision() -> Optional[str]:
+    try:
+        return subprocess.run(['git', 'rev-parse', '--short', 'HEAD'], capture_output=True,
+                              text=True, check=True).stdout.strip()
+    except (OSError, subprocess.CalledProcessError):
+        return None
+
+
+def print_matrix(results: List[Dict], speeds: List[int]):
+    """Rows: accel / reversal rate / boost; columns: speed; cells: max/mean drift"""
+    by_key = {condition_key(r): r for r in results}
+    rows = sorted({(r['accel'], r['reversal_hz'], r['boost']) for r in results})
+
+    header = f"{'accel':>7} {'rev/s':>6} {'boost':>5} |" + ''.join(f"{s:>14}" for s in speeds)
+    print(header)
+    print('-' * len(header))
+    for accel, rev, boost in rows:
+        cells = []
+        for speed in speeds:
+            r = by_key.get((speed, accel, rev, boost))
+            cells.append(f"{r['max_drift']}/{r['mean_drift']:.1f}" if r and r['frames'] else '-')
+        print(f"{accel:>7} {rev:>6.1f} {'on' if boost else 'off':>5} |" + ''.join(f"{c:>14}" for c in cells))
+    print("cells: max/mean |drift| in steps")
+
+
+def compare(results: List[Dict], baseline_path: str) -> List[str]:
+    """Conditions whose max drift got worse than the baseline allows"""
+    with open(baseline_path) as f:
+        baseline = {condition_key(r): r for r in json.load(f)['conditions']}
+
+    regressions = []
+    for r in results:
+        base = baseline.get(condition_key(r))
+        if not base or base['max_drift'] is None or r['max_drift'] is None:
+            continue
+        limit = base['max_drift'] * (1 + MAX_DRIFT_TOLERANCE) + MAX_DRIFT_SLACK
+        if r['max_drift'] > limit:
+            regressions.append(f"speed={r['speed']} accel={r['accel']} rev={r['reversal_hz']} "
+                               f"boost={r['boost']}: max drift {r['max_drift']} > {limit:.0f} "
+                               f"(baseline {base['max_drift']})")
+    return regressions
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description="Motor synchronization benchmark")
+    where = parser.add_mutually_exclusive_group(required=True)
+    where.add_argument('--sim', action='store_true', help='Run against the host simulator')
+    where.add_argument('--port', help='Teensy serial port, e.g. /dev/ttyACM0')
+    parser.add_argument('--quick', action='store_true', help='Small sweep')
+    parser.add_argument('--json', help='Write the machine-readable report here')
+    parser.add_argument('--baseline', help='Report to compare against; exit 1 on regression')
+    args = parser.parse_args()
+
+    if args.quick:
+        speeds, accels, reversals = QUICK_SPEEDS, QUICK_ACCELS, QUICK_REVERSAL_RATES
+    else:
+        speeds, accels, reversals = SPEEDS, ACCELS, REVERSAL_RATES
+
+    target = SimTarget() if args.sim else HardwareTarget(args.port)
+    results = []
+    started = time.time()
+    try:
+        conditions = list(itertools.product(accels, reversals, BOOSTS, speeds))
+        for n, (accel, rev, boost, speed) in enumerate(conditions, 1):
+            result = run_condition(target, speed, accel, rev, boost)
+            results.append(result)
+            print(f"[{n}/{len(conditions)}] speed={speed} accel={accel} rev={rev} "
+                  f"boost={'on' if boost else 'off'}: max={result['max_drift']} "
+                  f"mean={result['mean_drift']} final={result['final_drift']}", file=sys.stderr)
+    finally:
+        target.send("STOP")
+        target.close()
+
+    print()
+    print_matrix(results, speeds)
+
+    report = {
+        'tool': 'sync_benchmark',
+        'version': REPORT_VERSION,
+        'target': target.name,
+        'git': git_revision(),
+        'host': platform.node(),
+        'timestamp': time.strftime('%Y-%m-%dT%H:%M:%S'),
+        'wall_seconds': round(time.time() - started, 1),
+        'settings': {
+            'run_seconds': RUN_SECONDS,
+            'settle_seconds': SETTLE_SECONDS,
+            'telemetry_ms': TELEMETRY_MS,
+            'boost': BOOST_CONFIG,
+        },
+        'conditions': results,
+    }
+    if args.json:
+        with open(args.json, 'w') as f:
+            json.dump(report, f, indent=2)
+        print(f"Report written to {args.json}")
+
+    if args.baseline:
+        regressions = compare(results, args.baseline)
+        if regressions:
+            print("\nREGRESSIONS:")
+            for line in regressions:
+                print(f"  {line}")
+            return 1
+        print("\nNo drift regressions against baseline")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
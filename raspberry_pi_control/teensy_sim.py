@@ -0,0 +1,552 @@
+#!/usr/bin/env python3
+"""
+Host Simulator for the Teensy Firmware
+Runs the real teensy_motor_control/main.cpp on a virtual clock in-process
+
+The firmware is compiled against the Arduino shim in teensy_motor_control/host
+into a shared library the first time it is needed (and again whenever a
+source file changes). Every TeensySim loads a private copy of that library,
+so each simulator has its own firmware globals. Booting one takes well under
+a millisecond; close it (or use it in a with block) to unload the copy, so
+sweeps can run thousands of scenarios in one process.
+
+Example:
+    with TeensySim(trace=True) as sim:
+        sim.command("SPEED:4000")
+        sim.command("RUN")
+        sim.advance(1.0)
+        print(sim.command("STATUS"))
+        times, direction = sim.step_trace()['motor1']
+
+SimSerial wraps a TeensySim in a pyserial-like port that runs in real time,
+so DualMotorController can drive a virtual Teensy (port 'sim://'). SimFleet
+runs hundreds of them on a few shared clock threads (ports
+'sim://<fleet>/<index>').
+
+Author: Daniel Khito
+Date: 2025
+"""
+
+import _ctypes
+import ctypes
+import hashlib
+import os
+import shutil
+import subprocess
+import tempfile
+import threading
+import time
+from typing import Dict, List, Optional, Tuple
+
+REPO_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+FIRMWARE_DIR = os.path.join(REPO_DIR, 'teensy_motor_control')
+HOST_DIR = os.path.join(FIRMWARE_DIR, 'host')
+BUILD_DIR = os.path.join(HOST_DIR, 'build')
+LIBRARY = os.path.join(BUILD_DIR, 'libteensy_sim.so')
+SOURCES = [
+    os.path.join(HOST_DIR, 'teensy_sim.cpp'),
+    os.path.join(HOST_DIR, 'Arduino.h'),
+    os.path.join(FIRMWARE_DIR, 'main.cpp'),
+]
+
+# Firmware pin map (see main.cpp)
+M1_STEP_PIN = 2
+M1_DIR_PIN = 3
+M2_STEP_PIN = 4
+M2_DIR_PIN = 5
+MOTORS = [('motor1', M1_STEP_PIN, M1_DIR_PIN), ('motor2', M2_STEP_PIN, M2_DIR_PIN)]
+
+PS_PER_SECOND = 10 ** 12
+DEFAULT_LOOP_COST_US = 2.0    # One loop() pass on the Teensy when idle
+DEFAULT_TX_BYTE_COST_US = 0.0
+REALTIME_SLICE_S = 0.0005     # SimSerial keeps virtual time within this of wall time
+FLEET_LOOP_COST_US = 20.0     # SimFleet default; 1/10 the simulation work per instance
+
+_build_lock = threading.Lock()
+
+
+def build(force: bool = False, firmware: Optional[str] = None) -> str:
+    """
+    Compile the simulator library if it is missing or stale; returns its path
+
+    firmware builds another main.cpp (e.g. one checked out from an older
+    commit) into its own library instead of the one in this tree.
+    """
+    library, sources, defines = LIBRARY, SOURCES, []
+    if firmware:
+        firmware = os.path.abspath(firmware)
+        tag = hashlib.sha1(firmware.encode()).hexdigest()[:12]
+        library = os.path.join(BUILD_DIR, f'libteensy_sim_{tag}.so')
+        sources = SOURCES[:2] + [firmware]
+        defines = [f'-DSIM_FIRMWARE="{firmware}"']
+
+    with _build_lock:
+        if not force and os.path.exists(library):
+            built = os.path.getmtime(library)
+            if all(os.path.getmtime(src) <= built for src in sources):
+                return library
+
+        os.makedirs(BUILD_DIR, exist_ok=True)
+        compiler = os.environ.get('CXX', 'c++')
+        tmp = library + f'.{os.getpid()}.tmp'
+        cmd = [compiler, '-O2', '-std=gnu++17', '-shared', '-fPIC',
+               '-I', HOST_DIR, *defines, SOURCES[0], '-o', tmp]
+        result = subprocess.run(cmd, capture_output=True, text=True)
+        if result.returncode != 0:
+            raise RuntimeError(f"Simulator build failed:\n{result.stderr}")
+        os.replace(tmp, library)
+        return library
+
+
+def _load_private_copy(path: str):
+    """dlopen a private copy so globals are not shared between simulators"""
+    fd, copy = tempfile.mkstemp(prefix='teensy_sim_', suffix='.so')
+    os.close(fd)
+    shutil.copyfile(path, copy)
+    try:
+        lib = ctypes.CDLL(copy, mode=os.RTLD_LOCAL | os.RTLD_NOW)
+    finally:
+        os.unlink(copy)  # The mapping stays valid after unlink
+
+    u64, size_t, char_p = ctypes.c_uint64, ctypes.c_size_t, ctypes.c_char_p
+    lib.sim_set_costs.argtypes = [u64, u64]
+    lib.sim_set_time_ps.argtypes = [u64]
+    lib.sim_now_ps.restype = u64
+    lib.sim_advance_ps.argtypes = [u64]
+    lib.sim_write.argtypes = [char_p, size_t]
+    lib.sim_read.argtypes = [ctypes.c_void_p, size_t]
+    lib.sim_read.restype = size_t
+    lib.sim_output_pending.restype = size_t
+    lib.sim_input_pending.restype = size_t
+    lib.sim_rising_edges.argtypes = [ctypes.c_uint8]
+    lib.sim_rising_edges.restype = u64
+    lib.sim_pin_level.argtypes = [ctypes.c_uint8]
+    lib.sim_pin_level.restype = ctypes.c_uint8
+    lib.sim_axis_track.argtypes = [ctypes.c_uint8, ctypes.c_uint8, ctypes.c_uint8]
+    lib.sim_axis_steps.argtypes = [ctypes.c_uint8]
+    lib.sim_axis_steps.restype = ctypes.c_int64
+    lib.sim_set_positions.argtypes = [ctypes.c_int32, ctypes.c_int32]
+    lib.sim_trace_enable.argtypes = [ctypes.c_int]
+    lib.sim_trace_count.restype = size_t
+    lib.sim_trace_read.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p, size_t]
+    lib.sim_trace_read.restype = size_t
+    return lib
+
+
+class TeensySim:
+    """One simulated Teensy running the firmware"""
+
+    def __init__(self, loop_cost_us: float = DEFAULT_LOOP_COST_US,
+                 tx_byte_cost_us: float = DEFAULT_TX_BYTE_COST_US,
+                 trace: bool = False, start_time_s: float = 0.0,
+                 firmware: Optional[str] = None):
+        """
+        Load and boot a simulator
+
+        Args:
+            loop_cost_us: Virtual time charged per loop() pass
+            tx_byte_cost_us: Virtual time charged per byte the firmware prints
+            trace: Record every pin change with its timestamp
+            start_time_s: Virtual clock at power-up (e.g. to test millis() rollover)
+            firmware: Run this main.cpp instead of the one in the tree
+        """
+        self.lib = _load_private_copy(build(firmware=firmware))
+        self.lib.sim_set_costs(int(loop_cost_us * 1e6), int(tx_byte_cost_us * 1e6))
+        self.lib.sim_set_time_ps(int(start_time_s * PS_PER_SECOND))
+        self.lib.sim_trace_enable(1 if trace else 0)
+        self.lib.sim_axis_track(0, M1_STEP_PIN, M1_DIR_PIN)
+        self.lib.sim_axis_track(1, M2_STEP_PIN, M2_DIR_PIN)
+        self._partial = b''
+        self._read_buffer = ctypes.create_string_buffer(65536)
+        self.lib.sim_setup()
+        self.boot_output = self.read_lines()
+
+    def close(self):
+        """Unload this simulator's library copy; the simulator is unusable afterwards"""
+        if self.lib is not None:
+            _ctypes.dlclose(self.lib._handle)
+            self.lib = None
+
+    def __enter__(self) -> 'TeensySim':
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    @property
+    def now(self) -> float:
+        """Virtual time in seconds"""
+        return self.lib.sim_now_ps() / PS_PER_SECOND
+
+    def advance(self, seconds: float):
+        """Run the firmware for the given virtual time"""
+        self.lib.sim_advance_ps(int(seconds * PS_PER_SECOND))
+
+    def write(self, data: bytes):
+        """Bytes from the host to the firmware's USB serial"""
+        self.lib.sim_write(data, len(data))
+
+    def read(self) -> bytes:
+        """All bytes the firmware has printed since the last read"""
+        chunks = []
+        while True:
+            n = self.lib.sim_read(self._read_buffer, len(self._read_buffer))
+            if not n:
+                break
+            chunks.append(self._read_buffer.raw[:n])
+        return b''.join(chunks)
+
+    def read_lines(self) -> List[str]:
+        """Complete output lines since the last call"""
+        data = self._partial + self.read()
+        *lines, self._partial = data.split(b'\n')
+        return [line.decode(errors='replace').strip() for line in lines if line.strip()]
+
+    def command(self, command: str, timeout: float = 5.0, step: float = 0.0001) -> List[str]:
+        """
+        Send one command and run until the firmware ACKs it
+
+        Returns every line printed meanwhile, ACK included (telemetry frames too).
+        """
+        self.write(f"{command}\n".encode())
+        lines = []
+        deadline = self.now + timeout
+        while self.now < deadline:
+            self.advance(step)
+            new = self.read_lines()
+            lines.extend(new)
+            if any(line.startswith('ACK:') for line in new):
+                return lines
+        raise TimeoutError(f"No ACK for {command} within {timeout} s of virtual time")
+
+    def rising_edges(self, pin: int) -> int:
+        """Rising edges seen on a pin since boot"""
+        return self.lib.sim_rising_edges(pin)
+
+    @property
+    def step_counts(self) -> Dict[str, int]:
+        return {'motor1': self.rising_edges(M1_STEP_PIN), 'motor2': self.rising_edges(M2_STEP_PIN)}
+
+    @property
+    def net_steps(self) -> Dict[str, int]:
+        """Pulses signed by the DIR pin, plus any preset (never wraps, unlike position)"""
+        return {'motor1': self.lib.sim_axis_steps(0), 'motor2': self.lib.sim_axis_steps(1)}
+
+    def set_positions(self, motor1: int, motor2: int):
+        """Preset both positions and net step counts (motors must be stopped)"""
+        self.lib.sim_set_positions(motor1, motor2)
+
+    def read_trace(self):
+        """
+        Drain recorded pin changes
+
+        Returns (time_ps, pin, level) as NumPy arrays when NumPy is available,
+        otherwise as ctypes arrays.
+        """
+        count = self.lib.sim_trace_count()
+        time_ps = (ctypes.c_uint64 * count)()
+        pins = (ctypes.c_uint8 * count)()
+        levels = (ctypes.c_uint8 * count)()
+        self.lib.sim_trace_read(time_ps, pins, levels, count)
+        try:
+            import numpy as np
+            return (np.frombuffer(time_ps, dtype=np.uint64),
+                    np.frombuffer(pins, dtype=np.uint8),
+                    np.frombuffer(levels, dtype=np.uint8))
+        except ImportError:
+            return time_ps, pins, levels
+
+    def step_trace(self) -> Dict[str, Tuple]:
+        """
+        Drain recorded pin changes as step pulses per motor
+
+        Returns {'motor1': (time_s, direction), 'motor2': ...}: the virtual
+        time of every STEP rising edge and the direction the DIR pin gave it
+        (1 forward, -1 backward). NumPy arrays when NumPy is available,
+        otherwise lists.
+        """
+        time_ps, pins, levels = self.read_trace()
+        try:
+            import numpy as np
+        except ImportError:
+            return self._step_trace_lists(time_ps, pins, levels)
+
+        result = {}
+        index = np.arange(len(pins))
+        for name, step_pin, dir_pin in MOTORS:
+            # DIR level at each event: that of the latest DIR change so far
+            is_dir = pins == dir_pin
+            last_dir = np.maximum.accumulate(np.where(is_dir, index, -1))
+            dir_level = np.where(last_dir >= 0, levels[np.maximum(last_dir, 0)],
+                                 self._dir_level_before(dir_pin, levels[is_dir]))
+            steps = (pins == step_pin) & (levels == 1)
+            result[name] = (time_ps[steps] / PS_PER_SECOND,
+                            np.where(dir_level[steps] == 0, 1, -1).astype(np.int8))
+        return result
+
+    def _step_trace_lists(self, time_ps, pins, levels) -> Dict[str, Tuple]:
+        result = {}
+        for name, step_pin, dir_pin in MOTORS:
+            level = self._dir_level_before(dir_pin, [l for p, l in zip(pins, levels) if p == dir_pin])
+            times, directions = [], []
+            for t, pin, pin_level in zip(time_ps, pins, levels):
+                if pin == dir_pin:
+                    level = pin_level
+                elif pin == step_pin and pin_level == 1:
+                    times.append(t / PS_PER_SECOND)
+                    directions.append(1 if level == 0 else -1)
+            result[name] = (times, directions)
+        return result
+
+    def _dir_level_before(self, dir_pin: int, dir_levels) -> int:
+        """DIR level before a drained batch (the trace only holds changes)"""
+        return 1 - int(dir_levels[0]) if len(dir_levels) else self.lib.sim_pin_level(dir_pin)
+
+
+class SimSerial:
+    """
+    Real-time virtual Teensy behind the subset of serial.Serial used by
+    DualMotorController. A background thread advances the simulator to keep
+    pace with the wall clock; written bytes reach the firmware on its next
+    slice, so the link latency is about REALTIME_SLICE_S.
+
+    Given a sim, the port drives that simulator instead of booting its own
+    and leaves the clock to the caller (see SimFleet), which calls pump().
+    """
+
+    def __init__(self, timeout: Optional[float] = None, sim: Optional[TeensySim] = None,
+                 **sim_options):
+        self.timeout = timeout
+        self._owns_sim = sim is None
+        self.sim = TeensySim(**sim_options) if sim is None else sim
+        self._sim_lock = threading.Lock()
+        self._rx = bytearray()
+        self._rx_ready = threading.Condition()
+        self.is_open = True
+        self.bytes_written = 0
+        self.writes = 0
+        self._thread = None
+        if self._owns_sim:
+            self._thread = threading.Thread(target=self._run, name='sim-serial', daemon=True)
+            self._thread.start()
+
+    def _run(self):
+        start_wall = time.perf_counter()
+        start_virtual = self.sim.now
+        while self.is_open:
+            behind = (time.perf_counter() - start_wall) - (self.sim.now - start_virtual)
+            if behind < REALTIME_SLICE_S:
+                time.sleep(REALTIME_SLICE_S - max(behind, 0.0))
+                continue
+            self.pump(min(behind, 0.01))
+
+    def pump(self, seconds: float):
+        """Run the firmware for the given virtual time and pass on what it printed"""
+        with self._sim_lock:
+            self.sim.advance(seconds)
+            data = self.sim.read()
+        if data:
+            with self._rx_ready:
+                self._rx += data
+                self._rx_ready.notify_all()
+
+    def write(self, data: bytes) -> int:
+        with self._sim_lock:
+            self.sim.write(bytes(data))
+        self.bytes_written += len(data)
+        self.writes += 1
+        return len(data)
+
+    def flush(self):
+        pass
+
+    @property
+    def in_waiting(self) -> int:
+        return len(self._rx)
+
+    def reset_input_buffer(self):
+        with self._rx_ready:
+            self._rx.clear()
+
+    def read(self, size: int = 1) -> bytes:
+        with self._rx_ready:
+            if not self._rx:
+                self._rx_ready.wait(self.timeout)
+            data = bytes(self._rx[:size])
+            del self._rx[:size]
+            return data
+
+    def readline(self) -> bytes:
+        deadline = None if self.timeout is None else time.monotonic() + self.timeout
+        with self._rx_ready:
+            while self.is_open:
+                end = self._rx.find(b'\n')
+                if end >= 0:
+                    line = bytes(self._rx[:end + 1])
+                    del self._rx[:end + 1]
+                    return line
+                remaining = None if deadline is None else deadline - time.monotonic()
+                if remaining is not None and remaining <= 0:
+                    break
+                self._rx_ready.wait(remaining)
+            # Timed out: pyserial returns the partial line
+            line = bytes(self._rx)
+            self._rx.clear()
+            return line
+
+    def close(self):
+        self.is_open = False
+        if self._thread:
+            self._thread.join(timeout=1.0)
+        with self._rx_ready:
+            self._rx_ready.notify_all()
+        if self._owns_sim and not self._thread.is_alive():
+            with self._sim_lock:
+                self.sim.close()
+
+
+class SimFleet:
+    """
+    Many virtual Teensys on one shared real-time clock
+
+    A few worker threads (one per CPU by default) each advance their share
+    of the simulators to the fleet clock every REALTIME_SLICE_S, instead of
+    a thread per simulator. The firmware runs inside ctypes calls, which
+    release the GIL, so the workers run in parallel with each other and
+    with the host stack being tested.
+
+    Each instance is reached as port 'sim://<name>/<index>' (see open_port),
+    so DualMotorController and ControllerPool drive it like any other
+    board. A simulator keeps running while its port is closed, like a board
+    whose USB cable was pulled, and what it prints meanwhile is dropped.
+
+    If the workers cannot keep up, the simulators fall behind the wall
+    clock: lag_s and max_lag_s say by how much, busy the share of the
+    workers' time spent running firmware.
+    """
+
+    registry: Dict[str, 'SimFleet'] = {}
+
+    def __init__(self, count: int, name: str = 'fleet', workers: Optional[int] = None,
+                 loop_cost_us: float = FLEET_LOOP_COST_US, **sim_options):
+        """
+        Args:
+            count: Simulators to boot
+            name: Port namespace; must be unique among open fleets
+            workers: Clock threads (default: one per CPU, at most count)
+            loop_cost_us: Virtual time per loop() pass; coarser than
+                TeensySim's default so hundreds of instances fit on a host
+            sim_options: Passed on to every TeensySim
+        """
+        if name in SimFleet.registry:
+            raise ValueError(f"Simulator fleet {name} is already running")
+        self.name = name
+        self.sims = [TeensySim(loop_cost_us=loop_cost_us, **sim_options) for _ in range(count)]
+        self.ports: List[Optional[SimSerial]] = [None] * count
+        self.lag_s = 0.0
+        self.max_lag_s = 0.0
+        self._running = True
+        self._start_wall = time.perf_counter()
+        self._start_virtual = [sim.now for sim in self.sims]
+        workers = max(1, min(workers or os.cpu_count() or 1, count))
+        self._lags = [0.0] * workers
+        self._busy_s = [0.0] * workers
+        self._threads = [threading.Thread(target=self._run, args=(w, workers),
+                                          name=f'sim-fleet-{w}', daemon=True)
+                         for w in range(workers)]
+        SimFleet.registry[name] = self
+        for thread in self._threads:
+            thread.start()
+
+    def __len__(self) -> int:
+        return len(self.sims)
+
+    def __enter__(self) -> 'SimFleet':
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    @property
+    def port_names(self) -> List[str]:
+        return [f"sim://{self.name}/{i}" for i in range(len(self.sims))]
+
+    @property
+    def busy(self) -> float:
+        """Share of the workers' time spent in the firmware since the fleet started"""
+        elapsed = (time.perf_counter() - self._start_wall) * len(self._threads)
+        return sum(self._busy_s) / elapsed if elapsed > 0 else 0.0
+
+    def age(self, index: int, millis: int) -> float:
+        """Seconds on the fleet clock since instance index's millis() read this"""
+        return time.perf_counter() - self._start_wall - (millis / 1000 - self._start_virtual[index])
+
+    def open(self, index: int, timeout: Optional[float] = None) -> SimSerial:
+        """A serial port to one instance, replacing any port still open to it"""
+        old = self.ports[index]
+        port = SimSerial(timeout=timeout, sim=self.sims[index])
+        self.ports[index] = port
+        if old:
+            old.close()
+        return port
+
+    def _run(self, worker: int, workers: int):
+        indices = range(worker, len(self.sims), workers)
+        while self._running:
+            target = time.perf_counter() - self._start_wall
+            started = time.perf_counter()
+            lag = 0.0
+            for i in indices:
+                sim = self.sims[i]
+                behind = target - (sim.now - self._start_virtual[i])
+                if behind <= 0:
+                    continue
+                lag = max(lag, behind)
+                port = self.ports[i]
+                if port and port.is_open:
+                    port.pump(behind)
+                else:
+                    sim.advance(behind)
+                    sim.read()
+            self._busy_s[worker] += time.perf_counter() - started
+            self._lags[worker] = lag
+            self.lag_s = max(self._lags)
+            self.max_lag_s = max(self.max_lag_s, lag)
+            idle = REALTIME_SLICE_S - (time.perf_counter() - started)
+            if idle > 0:
+                time.sleep(idle)
+
+    def close(self):
+        """Stop the clock, close the ports and unload every simulator"""
+        self._running = False
+        for thread in self._threads:
+            thread.join(timeout=1.0)
+        for port in self.ports:
+            if port:
+                port.close()
+        for sim in self.sims:
+            sim.close()
+        SimFleet.registry.pop(self.name, None)
+
+
+def open_port(url: str, timeout: Optional[float] = None) -> SimSerial:
+    """A port for 'sim://' (a simulator of its own) or 'sim://<fleet>/<index>'"""
+    fleet, _, index = url[len('sim://'):].partition('/')
+    if not fleet:
+        return SimSerial(timeout=timeout)
+    if fleet not in SimFleet.registry or not index.isdigit():
+        raise OSError(f"No simulator at {url}")
+    instances = SimFleet.registry[fleet]
+    if int(index) >= len(instances):
+        raise OSError(f"No simulator at {url} (fleet has {len(instances)})")
+    return instances.open(int(index), timeout)
+
+
+if __name__ == "__main__":
+    sim = TeensySim()
+    print('\n'.join(sim.boot_output))
+    for cmd in ("SPEED:4000", "RUN"):
+        print('\n'.join(sim.command(cmd)))
+    sim.advance(1.0)
+    print('\n'.join(sim.command("STATUS")))
+    print(f"Virtual time: {sim.now:.3f} s, pulses: {sim.step_counts}")
@@ -0,0 +1,361 @@
+#!/usr/bin/env python3
+"""
+Columnar Telemetry Recorder
+Stores Teensy telemetry frames in an append-only, memory-mappable file
+
+File layout (all little-endian):
+    header  'TLM1', version, column count, wall-clock anchor (ns since the
+            epoch at time_ns 0), then per column a 16-byte name and a struct
+            type code, padded to 8 bytes
+    chunks  'CHNK', row count, first/last host timestamp (ns), then each
+            column stored contiguously (int64 columns first, so every column
+            stays naturally aligned), padded to 8 bytes
+    <file>.idx  one 32-byte record per chunk: offset, rows, first/last
+            timestamp - lets readers jump straight to a time range
+
+Rows are buffered in memory and a full chunk is written by a background
+thread, so recording costs the telemetry callback a handful of list appends.
+
+Timestamps come from the host's monotonic clock, so they stay in order (and
+binary-searchable) when NTP steps the wall clock, as it does on a Pi without
+an RTC once the network is up. The header's anchor turns them back into wall
+time, as accurate as the wall clock was when the file was created.
+
+Usage:
+    python3 telemetry_recorder.py info run.tlm
+    python3 telemetry_recorder.py dump run.tlm [--from SECONDS] [--to SECONDS]
+
+Author: Daniel Khito
+Date: 2025
+"""
+
+import argparse
+import bisect
+import mmap
+import os
+import queue
+import struct
+import sys
+import threading
+import time
+from array import array
+from typing import Dict, List, Optional, Tuple
+
+FILE_MAGIC = b'TLM1'
+CHUNK_MAGIC = b'CHNK'
+FORMAT_VERSION = 2   # 2: monotonic time column, wall-clock anchor in the header
+
+CHUNK_ROWS = 4096   # ~40 s of frames at 10 ms - one write() per chunk
+
+# (name, struct type code) - 'q' = int64, 'i' = int32, 'h' = int16
+COLUMNS: List[Tuple[str, str]] = [
+    ('time_ns', 'q'),     # Host monotonic clock when the frame arrived, from the anchor
+    ('position1', 'q'),
+    ('position2', 'q'),
+    ('millis', 'q'),      # Teensy millis()
+    ('speed1', 'i'),      # Signed steps/sec
+    ('speed2', 'i'),
+    ('drift', 'i'),       # position_diff(position1, position2)
+    ('credits', 'h'),
+]
+
+HEADER_FMT = '<4sHHq'
+COLUMN_FMT = '<16sc'
+CHUNK_FMT = '<4sIqq'
+INDEX_FMT = '<qIIqq'
+CHUNK_HEADER_SIZE = struct.calcsize(CHUNK_FMT)
+INDEX_RECORD_SIZE = struct.calcsize(INDEX_FMT)
+
+
+def position_diff(a: int, b: int) -> int:
+    """a - b for Teensy int32 positions, correct across a 2^31 wrap
+    (positionDiff in main.cpp)"""
+    return ((a - b + 0x80000000) & 0xFFFFFFFF) - 0x80000000
+
+
+def _pad8(n: int) -> int:
+    return (n + 7) & ~7
+
+
+def _header_bytes(anchor_ns: int = 0) -> bytes:
+    data = struct.pack(HEADER_FMT, FILE_MAGIC, FORMAT_VERSION, len(COLUMNS), anchor_ns)
+    for name, code in COLUMNS:
+        data += struct.pack(COLUMN_FMT, name.encode(), code.encode())
+    return data + b'\0' * (_pad8(len(data)) - len(data))
+
+
+HEADER_SIZE = len(_header_bytes())
+ANCHOR_OFFSET = struct.calcsize('<4sHH')
+
+
+def _read_header(data: bytes) -> Optional[int]:
+    """The wall-clock anchor if data starts with a compatible header"""
+    if len(data) < HEADER_SIZE:
+        return None
+    anchor_ns = struct.unpack_from('<q', data, ANCHOR_OFFSET)[0]
+    return anchor_ns if data[:HEADER_SIZE] == _header_bytes(anchor_ns) else None
+
+
+class TelemetryRecorder:
+    """Appends telemetry frames to a columnar file"""
+
+    def __init__(self, path: str, chunk_rows: int = CHUNK_ROWS):
+        """
+        Open (or create) a recording
+
+        Args:
+            path: Recording file; <path>.idx holds the chunk index
+            chunk_rows: Rows buffered before a chunk is written
+        """
+        self.path = path
+        self.chunk_rows = chunk_rows
+        self.columns = self._new_columns()
+        self.chunks: queue.Queue = queue.Queue()
+        self.stats = {'rows': 0, 'chunks': 0, 'bytes': 0, 'write_time_s': 0.0}
+
+        # time_ns = time.monotonic_ns() + clock_offset
+        new_file = not os.path.exists(path) or os.path.getsize(path) == 0
+        if new_file:
+            self.anchor_ns = time.time_ns()
+            self.clock_offset = -time.monotonic_ns()
+        else:
+            # Appending, maybe after a reboot reset the monotonic clock: pick
+            # up at the wall time since the anchor, never before the last row
+            recording = TelemetryFile(path)
+            self.anchor_ns = recording.anchor_ns
+            last_ns = recording.chunks[-1][3] if recording.chunks else -1
+            recording.close()
+            now_ns = max(time.time_ns() - self.anchor_ns, last_ns + 1)
+            self.clock_offset = now_ns - time.monotonic_ns()
+
+        self.data_file = open(path, 'ab')
+        self.index_file = open(path + '.idx', 'ab')
+        if new_file:
+            self.data_file.write(_header_bytes(self.anchor_ns))
+            self.data_file.flush()
+
+        self.writer_thread = threading.Thread(target=self._writer_loop, daemon=True)
+        self.writer_thread.start()
+
+    @staticmethod
+    def _new_columns() -> List[array]:
+        return [array(code) for _, code in COLUMNS]
+
+    def append(self, frame: Dict[str, int]):
+        """Record one telemetry frame (DualMotorController callback signature)"""
+        columns = self.columns
+        columns[0].append(time.monotonic_ns() + self.clock_offset)
+        columns[1].append(frame['position1'])
+        columns[2].append(frame['position2'])
+        columns[3].append(frame['millis'])
+        columns[4].append(frame['speed1'])
+        columns[5].append(frame['speed2'])
+        columns[6].append(position_diff(frame['position1'], frame['position2']))
+        columns[7].append(frame['credits'])
+
+        if len(columns[0]) >= self.chunk_rows:
+            self.columns = self._new_columns()
+            self.chunks.put(columns)
+
+    def flush(self):
+        """Write buffered rows as a (short) chunk"""
+        if len(self.columns[0]):
+            columns, self.columns = self.columns, self._new_columns()
+            self.chunks.put(columns)
+
+    def close(self):
+        """Flush remaining rows and close the files"""
+        self.flush()
+        self.chunks.put(None)
+        self.writer_thread.join()
+        self.data_file.close()
+        self.index_file.close()
+
+    def _writer_loop(self):
+        while True:
+            columns = self.chunks.get()
+            if columns is None:
+                break
+            start = time.perf_counter()
+            self._write_chunk(columns)
+            self.stats['write_time_s'] += time.perf_counter() - start
+
+    def _write_chunk(self, columns: List[array]):
+        rows = len(columns[0])
+        timestamps = columns[0]
+        offset = self.data_file.tell()
+
+        parts = [struct.pack(CHUNK_FMT, CHUNK_MAGIC, rows, timestamps[0], timestamps[-1])]
+        size = CHUNK_HEADER_SIZE
+        for column in columns:
+            if sys.byteorder != 'little':
+                column.byteswap()
+            parts.append(column.tobytes())
+            size += rows * column.itemsize
+        parts.append(b'\0' * (_pad8(size) - size))
+
+        # Data first, index last: a crash can only leave an unindexed chunk,
+        # which TelemetryFile recovers by walking chunk headers
+        self.data_file.write(b''.join(parts))
+        self.data_file.flush()
+        self.index_file.write(struct.pack(INDEX_FMT, offset, rows, 0, timestamps[0], timestamps[-1]))
+        self.index_file.flush()
+
+        self.stats['rows'] += rows
+        self.stats['chunks'] += 1
+        self.stats['bytes'] += _pad8(size)
+
+
+class TelemetryFile:
+    """Read-only, memory-mapped view of a recording"""
+
+    def __init__(self, path: str):
+        self.path = path
+        self.file = open(path, 'rb')
+        self.map = mmap.mmap(self.file.fileno(), 0, access=mmap.ACCESS_READ)
+        self.data_start = HEADER_SIZE
+        self.anchor_ns = _read_header(self.map[:HEADER_SIZE])
+        if self.anchor_ns is None:
+            self.map.close()
+            self.file.close()
+            raise ValueError(f"{path} is not a compatible telemetry recording")
+
+        # (offset, rows, first_ns, last_ns) per chunk
+        self.chunks: List[Tuple[int, int, int, int]] = self._load_index()
+        self.first_ns = [c[2] for c in self.chunks]
+
+    def wall_ns(self, time_ns: int) -> int:
+        """Wall-clock time (ns since the epoch) of a time_ns value"""
+        return self.anchor_ns + time_ns
+
+    def close(self):
+        """Release the mapping (arrays returned by query() keep it alive)"""
+        try:
+            self.map.close()
+        except BufferError:
+            pass  # Column views still exist - the mapping is freed with them
+        self.file.close()
+
+    def _chunk_size(self, rows: int) -> int:
+        return _pad8(CHUNK_HEADER_SIZE + rows * sum(struct.calcsize(code) for _, code in COLUMNS))
+
+    def _load_index(self) -> List[Tuple[int, int, int, int]]:
+        chunks = []
+        index_path = self.path + '.idx'
+        if os.path.exists(index_path):
+            with open(index_path, 'rb') as f:
+                data = f.read()
+            for pos in range(0, len(data) - INDEX_RECORD_SIZE + 1, INDEX_RECORD_SIZE):
+                offset, rows, _, first_ns, last_ns = struct.unpack_from(INDEX_FMT, data, pos)
+                if offset + self._chunk_size(rows) > len(self.map):
+                    break
+                chunks.append((offset, rows, first_ns, last_ns))
+
+        # Walk any chunks the index does not cover (writer stopped mid-run)
+        offset = chunks[-1][0] + self._chunk_size(chunks[-1][1]) if chunks else self.data_start
+        while offset + CHUNK_HEADER_SIZE <= len(self.map):
+            magic, rows, first_ns, last_ns = struct.unpack_from(CHUNK_FMT, self.map, offset)
+            size = self._chunk_size(rows)
+            if magic != CHUNK_MAGIC or offset + size > len(self.map):
+                break
+            chunks.append((offset, rows, first_ns, last_ns))
+            offset += size
+        return chunks
+
+    @property
+    def rows(self) -> int:
+        return sum(c[1] for c in self.chunks)
+
+    def chunk_columns(self, chunk: int):
+        """Zero-copy column views for one chunk (NumPy arrays when available)"""
+        offset, rows, _, _ = self.chunks[chunk]
+        pos = offset + CHUNK_HEADER_SIZE
+        views = {}
+        for name, code in COLUMNS:
+            size = rows * struct.calcsize(code)
+            view = memoryview(self.map)[pos:pos + size]
+            views[name] = _as_array(view, code)
+            pos += size
+        return views
+
+    def query(self, start_ns: Optional[int] = None, end_ns: Optional[int] = None):
+        """
+        Rows with start_ns <= time_ns < end_ns
+
+        Only chunks overlapping the range are touched; within a chunk the
+        time column is binary searched. Returns a list of per-chunk column
+        dicts so nothing is copied.
+        """
+        if start_ns is None:
+            start_ns = self.first_ns[0] if self.chunks else 0
+        if end_ns is None:
+            end_ns = (self.chunks[-1][3] + 1) if self.chunks else 0
+
+        first = max(0, bisect.bisect_right(self.first_ns, start_ns) - 1)
+        results = []
+        for chunk in range(first, len(self.chunks)):
+            _, _, chunk_first, chunk_last = self.chunks[chunk]
+            if chunk_first >= end_ns:
+                break
+            if chunk_last < start_ns:
+                continue
+            columns = self.chunk_columns(chunk)
+            times = columns['time_ns']
+            lo = bisect.bisect_left(times, start_ns)
+            hi = bisect.bisect_left(times, end_ns)
+            if hi > lo:
+                results.append({name: col[lo:hi] for name, col in columns.items()})
+        return results
+
+
+def _as_array(view: memoryview, code: str):
+    try:
+        import numpy as np
+        return np.frombuffer(view, dtype='<' + code)
+    except ImportError:
+        return view.cast(code)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Inspect telemetry recordings")
+    sub = parser.add_subparsers(dest='cmd', required=True)
+    info = sub.add_parser('info', help='Summarize a recording')
+    info.add_argument('path')
+    dump = sub.add_parser('dump', help='Print rows as CSV')
+    dump.add_argument('path')
+    dump.add_argument('--from', dest='start', type=float, default=None,
+                      help='Seconds from start of recording')
+    dump.add_argument('--to', dest='end', type=float, default=None,
+                      help='Seconds from start of recording')
+    args = parser.parse_args()
+
+    recording = TelemetryFile(args.path)
+    try:
+        if not recording.chunks:
+            print("Empty recording")
+            return
+        origin = recording.chunks[0][2]
+
+        if args.cmd == 'info':
+            duration = (recording.chunks[-1][3] - origin) / 1e9
+            print(f"Rows:     {recording.rows}")
+            print(f"Chunks:   {len(recording.chunks)}")
+            started = time.strftime('%Y-%m-%d %H:%M:%S',
+                                    time.localtime(recording.wall_ns(origin) / 1e9))
+            print(f"Started:  {started}")
+            print(f"Duration: {duration:.1f} s")
+            print(f"Size:     {os.path.getsize(args.path)} bytes")
+        else:
+            start = origin + int(args.start * 1e9) if args.start is not None else None
+            end = origin + int(args.end * 1e9) if args.end is not None else None
+            names = [name for name, _ in COLUMNS]
+            print(','.join(names))
+            for part in recording.query(start, end):
+                for row in zip(*(part[name] for name in names)):
+                    print(','.join(str(int(v)) for v in row))
+    finally:
+        recording.close()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,433 @@
+#!/usr/bin/env python3
+"""
+Step Trace A/B Comparison
+Captures step-pulse timestamp traces of a motion scenario and compares two
+of them (e.g. the firmware before and after a change to the step or ramp
+path) on period error, jitter, inter-motor skew and profile tracking error
+
+A trace is a CSV of pin changes:
+    # trace_compare v1 {"source": ..., "events": [[t_ns, "SPEED:4000"], ...]}
+    time_ns,pin,level
+    1250000,2,1
+    ...
+Only rising STEP edges and DIR changes are needed (pins as in main.cpp:
+STEP1=2, DIR1=3, STEP2=4, DIR2=5). The metadata line is optional; without
+its events the profile tracking comparison is skipped, so a logic-analyzer
+export converted to these three columns compares fine on everything else.
+
+Each distribution is compared with a Mann-Whitney U test and reported with
+the probability that a B sample is larger than an A sample (0.5 = same).
+
+Usage:
+    python3 trace_compare.py capture a.csv                         # this tree
+    python3 trace_compare.py capture b.csv --firmware /tmp/old_main.cpp
+    python3 trace_compare.py capture a.csv --scenario moves.json
+    python3 trace_compare.py compare a.csv b.csv
+    python3 trace_compare.py compare a.csv b.csv --gate            # exit 1 if B is worse
+
+Author: Daniel Khito
+Date: 2025
+"""
+
+import argparse
+import json
+import math
+import subprocess
+import sys
+from typing import Dict, List, Optional, Tuple
+
+TRACE_VERSION = 1
+TRACE_HEADER = '# trace_compare v'
+
+# Firmware pin map (see main.cpp); matches teensy_sim
+M1_STEP_PIN = 2
+M1_DIR_PIN = 3
+M2_STEP_PIN = 4
+M2_DIR_PIN = 5
+MOTORS = [('motor1', M1_STEP_PIN, M1_DIR_PIN), ('motor2', M2_STEP_PIN, M2_DIR_PIN)]
+
+# Default scenario: (command, seconds to run after it)
+SCENARIO = [
+    ("CONFIG:ACCEL:8000", 0.0),
+    ("FORWARD", 0.0),
+    ("SPEED:4000", 0.0),
+    ("RUN", 1.0),
+    ("SPEED:12000", 2.0),
+    ("BACKWARD", 2.0),
+    ("STOP", 1.0),
+]
+
+# Firmware defaults the ideal profile starts from
+ACCEL_RATE = 8000           # steps/sec^2 until CONFIG:ACCEL
+PROFILE_BIN_S = 0.010       # Rate bins for tracking error (the firmware's ramp tick)
+
+MEDIAN_WINDOW = 9           # Intervals in the running median a period is judged against
+SEGMENT_GAP_NS = 50_000_000  # A longer gap between steps starts a new segment
+
+ALPHA = 0.01                # Significance level
+MIN_EFFECT = 0.55           # P(B>A) a significant change must also reach to count
+
+COMMAND_TIMEOUT_S = 30.0    # Virtual time allowed for one command to ACK
+
+Event = Tuple[int, str]     # (time_ns, command)
+
+
+# ---------------------------------------------------------------------------
+# Traces
+# ---------------------------------------------------------------------------
+
+class Trace:
+    """Step and DIR edges of both motors plus the commands that produced them"""
+
+    def __init__(self, changes: List[Tuple[int, int, int]], meta: Optional[Dict] = None):
+        self.meta = meta or {}
+        self.events: List[Event] = [(int(t), cmd) for t, cmd in self.meta.get('events', [])]
+        self.changes = sorted(changes)
+
+    def steps(self, step_pin: int, dir_pin: int) -> List[Tuple[int, int]]:
+        """(time_ns, direction) of every rising step edge; DIR low = forward"""
+        direction = 1
+        out = []
+        for t, pin, level in self.changes:
+            if pin == dir_pin:
+                direction = 1 if level == 0 else -1
+            elif pin == step_pin and level == 1:
+                out.append((t, direction))
+        return out
+
+    def save(self, path: str):
+        with open(path, 'w') as f:
+            f.write(f"{TRACE_HEADER}{TRACE_VERSION} {json.dumps(self.meta)}\n")
+            f.write("time_ns,pin,level\n")
+            for t, pin, level in self.changes:
+                f.write(f"{t},{pin},{level}\n")
+
+    @classmethod
+    def load(cls, path: str) -> 'Trace':
+        meta, changes = {}, []
+        with open(path) as f:
+            for line in f:
+                line = line.strip()
+                if line.startswith(TRACE_HEADER):
+                    meta = json.loads(line.split(' ', 3)[3])
+                elif line and not line.startswith('#') and not line.startswith('time'):
+                    t, pin, level = line.split(',')
+                    changes.append((int(t), int(pin), int(level)))
+        return cls(changes, meta)
+
+
+def git_revision() -> Optional[str]:
+    try:
+        return subprocess.run(['git', 'rev-parse', '--short', 'HEAD'], capture_output=True,
+                              text=True, check=True).stdout.strip()
+    except (OSError, subprocess.CalledProcessError):
+        return None
+
+
+def capture(scenario: List[Tuple[str, float]], firmware: Optional[str] = None) -> Trace:
+    """Run a scenario on the host simulator with pin tracing on"""
+    from teensy_sim import TeensySim
+    changes, events = [], []
+    with TeensySim(trace=True, firmware=firmware) as sim:
+        sim.read_trace()  # Drop boot pin changes
+        start_ps = sim.lib.sim_now_ps()
+        wanted = {pin for _, step, dir_pin in MOTORS for pin in (step, dir_pin)}
+
+        def drain():
+            for t, pin, level in zip(*sim.read_trace()):
+                pin, level = int(pin), int(level)
+                if pin in wanted and (level or pin not in (M1_STEP_PIN, M2_STEP_PIN)):
+                    changes.append(((int(t) - start_ps) // 1000, pin, level))
+
+        for command, wait in scenario:
+            events.append(((sim.lib.sim_now_ps() - start_ps) // 1000, command))
+            sim.command(command, timeout=COMMAND_TIMEOUT_S)  # Reversals and stops block
+            drain()
+            end = sim.now + wait
+            while sim.now < end:
+                sim.advance(min(0.05, end - sim.now))
+                drain()
+
+    meta = {
+        'source': 'sim',
+        'firmware': firmware or 'tree',
+        'git': git_revision(),
+        'events': events,
+    }
+    return Trace(changes, meta)
+
+
+# ---------------------------------------------------------------------------
+# Metrics
+# ---------------------------------------------------------------------------
+
+def percentile(values: List[float], p: float) -> float:
+    """Nearest-rank percentile of an unsorted list"""
+    if not values:
+        return float('nan')
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, max(0, math.ceil(p / 100 * len(ordered)) - 1))]
+
+
+def stdev(values: List[float]) -> float:
+    if len(values) < 2:
+        return float('nan')
+    mean = sum(values) / len(values)
+    return math.sqrt(sum((v - mean) ** 2 for v in values) / (len(values) - 1))
+
+
+def period_errors(steps: List[Tuple[int, int]]) -> List[float]:
+    """
+    Each step interval minus the running median of its neighbours, in us
+
+    The median follows the commanded ramp, so what is left is the timing
+    noise the step path added. Segments break at long gaps and reversals.
+    """
+    errors = []
+    segment: List[int] = []
+
+    def flush():
+        intervals = [(b - a) / 1000.0 for a, b in zip(segment, segment[1:])]
+        half = MEDIAN_WINDOW // 2
+        for i, interval in enumerate(intervals):
+            window = sorted(intervals[max(0, i - half):i + half + 1])
+            errors.append(interval - window[len(window) // 2])
+
+    last_t, last_dir = None, None
+    for t, direction in steps:
+        if last_t is not None and (t - last_t > SEGMENT_GAP_NS or direction != last_dir):
+            flush()
+            segment = []
+        segment.append(t)
+        last_t, last_dir = t, direction
+    flush()
+    return errors
+
+
+def skews(steps1: List[Tuple[int, int]], steps2: List[Tuple[int, int]]) -> List[float]:
+    """Motor 2's k-th step minus motor 1's k-th step, in us"""
+    return [(b[0] - a[0]) / 1000.0 for a, b in zip(steps1, steps2)]
+
+
+def ideal_rates(events: List[Event], end_ns: int) -> Dict[str, List[float]]:
+    """
+    Signed step rate per PROFILE_BIN_S an ideal accel-limited controller
+    would produce for the recorded commands (SPEED, RUN, STOP, ESTOP,
+    FORWARD/BACKWARD, CONFIG:ACCEL, with M1:/M2: prefixes)
+    """
+    bins = int(end_ns / 1e9 / PROFILE_BIN_S) + 1
+    accel = ACCEL_RATE
+    state = {name: {'speed': 0.0, 'dir': 1, 'running': False, 'rate': 0.0} for name, _, _ in MOTORS}
+    out = {name: [] for name in state}
+    pending = sorted(events)
+
+    for i in range(bins):
+        t_ns = i * PROFILE_BIN_S * 1e9
+        while pending and pending[0][0] <= t_ns:
+            command = pending.pop(0)[1].upper()
+            targets = list(state)
+            for prefix, name in (('M1:', 'motor1'), ('1:', 'motor1'), ('M2:', 'motor2'), ('2:', 'motor2')):
+                if command.startswith(prefix):
+                    targets, command = [name], command[len(prefix):]
+                    break
+            word, _, value = command.partition(':')
+            if word == 'CONFIG' and value.startswith('ACCEL:'):
+                accel = float(value[6:])
+            for name in targets:
+                m = state[name]
+                if word in ('SPEED', 'S'):
+                    m['speed'] = abs(float(value))
+                elif word in ('RUN', 'R'):
+                    m['running'] = True
+                elif word in ('STOP', 'X'):
+                    m['running'] = False
+                elif word in ('ESTOP', 'E'):
+                    m['running'], m['rate'] = False, 0.0
+                elif word in ('FORWARD', 'FWD', 'F'):
+                    m['dir'] = 1
+                elif word in ('BACKWARD', 'BACK', 'B'):
+                    m['dir'] = -1
+        for name, m in state.items():
+            target = m['dir'] * m['speed'] if m['running'] else 0.0
+            step = accel * PROFILE_BIN_S
+            m['rate'] += max(-step, min(step, target - m['rate']))
+            out[name].append(m['rate'])
+    return out
+
+
+def measured_rates(steps: List[Tuple[int, int]], bins: int) -> List[float]:
+    rates = [0.0] * bins
+    for t, direction in steps:
+        i = int(t / 1e9 / PROFILE_BIN_S)
+        if 0 <= i < bins:
+            rates[i] += direction / PROFILE_BIN_S
+    return rates
+
+
+def tracking_errors(trace: Trace, steps: Dict[str, List[Tuple[int, int]]]) -> Dict[str, List[float]]:
+    """|measured - ideal| step rate per bin, or {} when the trace has no events"""
+    if not trace.events or not trace.changes:
+        return {}
+    end_ns = trace.changes[-1][0]
+    ideal = ideal_rates(trace.events, end_ns)
+    out = {}
+    for name, _, _ in MOTORS:
+        measured = measured_rates(steps[name], len(ideal[name]))
+        out[name] = [abs(m - i) for m, i in zip(measured, ideal[name])]
+    return out
+
+
+def analyze(trace: Trace) -> Dict[str, List[float]]:
+    """Named sample distributions; for each of them larger is worse"""
+    steps = {name: trace.steps(step, dir_pin) for name, step, dir_pin in MOTORS}
+    samples = {}
+    for name, _, _ in MOTORS:
+        samples[f"{name} |period err| us"] = [abs(e) for e in period_errors(steps[name])]
+    samples["|skew| us"] = [abs(s) for s in skews(steps['motor1'], steps['motor2'])]
+    for name, errors in tracking_errors(trace, steps).items():
+        samples[f"{name} |track err| st/s"] = errors
+    samples['_counts'] = [len(steps['motor1']), len(steps['motor2'])]
+    return samples
+
+
+def mann_whitney(a: List[float], b: List[float]) -> Tuple[float, float]:
+    """Two-sided p-value (normal approximation, tie-corrected) and P(B>A)"""
+    na, nb = len(a), len(b)
+    if not na or not nb:
+        return float('nan'), float('nan')
+    pooled = sorted([(v, 0) for v in a] + [(v, 1) for v in b])
+    n = na + nb
+    rank_sum_a, ties, i = 0.0, 0.0, 0
+    while i < n:
+        j = i
+        while j + 1 < n and pooled[j + 1][0] == pooled[i][0]:
+            j += 1
+        rank = (i + j) / 2 + 1
+        rank_sum_a += rank * sum(1 for k in range(i, j + 1) if pooled[k][1] == 0)
+        t = j - i + 1
+        ties += t ** 3 - t
+        i = j + 1
+    u_a = rank_sum_a - na * (na + 1) / 2   # Pairs where A > B
+    mean = na * nb / 2
+    var = na * nb / 12 * ((n + 1) - ties / (n * (n - 1))) if n > 1 else 0.0
+    p = math.erfc(abs(u_a - mean) / math.sqrt(2 * var)) if var > 0 else 1.0
+    return p, 1 - u_a / (na * nb)
+
+
+# ---------------------------------------------------------------------------
+# Report
+# ---------------------------------------------------------------------------
+
+def describe(values: List[float]) -> Dict[str, float]:
+    return {
+        'n': len(values),
+        'p50': percentile(values, 50),
+        'p95': percentile(values, 95),
+        'p99': percentile(values, 99),
+        'max': max(values) if values else float('nan'),
+        'rms': math.sqrt(sum(v * v for v in values) / len(values)) if values else float('nan'),
+    }
+
+
+def compare(a: Trace, b: Trace) -> Tuple[List[Dict], Dict]:
+    """Per-metric comparison rows plus extras (jitter, step counts)"""
+    sa, sb = analyze(a), analyze(b)
+    rows = []
+    for name in sa:
+        if name.startswith('_') or name not in sb:
+            continue
+        p, effect = mann_whitney(sa[name], sb[name])
+        worse = p < ALPHA and effect >= MIN_EFFECT
+        better = p < ALPHA and effect <= 1 - MIN_EFFECT
+        rows.append({
+            'metric': name,
+            'a': describe(sa[name]),
+            'b': describe(sb[name]),
+            'p': p,
+            'p_b_gt_a': effect,
+            'verdict': 'WORSE' if worse else 'better' if better else 'same',
+        })
+    extras = {
+        'jitter_us': {name: tuple(stdev(period_errors(t.steps(step, dir_pin))) for t in (a, b))
+                      for name, step, dir_pin in MOTORS},
+        'steps': (sa['_counts'], sb['_counts']),
+    }
+    return rows, extras
+
+
+def print_report(rows: List[Dict], extras: Dict, labels: Tuple[str, str]):
+    print(f"A: {labels[0]}")
+    print(f"B: {labels[1]}")
+    (a1, a2), (b1, b2) = extras['steps']
+    print(f"steps  A: {a1}/{a2} (final diff {a1 - a2})   B: {b1}/{b2} (final diff {b1 - b2})")
+    for name, (ja, jb) in extras['jitter_us'].items():
+        print(f"{name} jitter (stdev of period error): A {ja:.2f} us   B {jb:.2f} us")
+    print()
+    header = (f"{'metric':<24} {'':>2} {'p50':>9} {'p95':>9} {'p99':>9} {'max':>9} {'rms':>9}"
+              f" {'P(B>A)':>7} {'p':>8}  verdict")
+    print(header)
+    print('-' * len(header))
+    for r in rows:
+        for side in ('a', 'b'):
+            d = r[side]
+            cells = ''.join(f" {d[k]:>9.2f}" for k in ('p50', 'p95', 'p99', 'max', 'rms'))
+            label = r['metric'] if side == 'a' else ''
+            tail = f" {r['p_b_gt_a']:>7.3f} {r['p']:>8.1e}  {r['verdict']}" if side == 'b' else ''
+            print(f"{label:<24} {side.upper():>2}{cells}{tail}")
+    print(f"verdict: Mann-Whitney p < {ALPHA} and P(B>A) beyond {MIN_EFFECT:.2f}; larger is worse")
+
+
+def load_scenario(path: Optional[str]) -> List[Tuple[str, float]]:
+    """JSON list of [command, seconds] pairs, or the default scenario"""
+    if not path:
+        return SCENARIO
+    with open(path) as f:
+        return [(str(command), float(wait)) for command, wait in json.load(f)]
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description="Step trace A/B comparison")
+    sub = parser.add_subparsers(dest='action', required=True)
+    cap = sub.add_parser('capture', help='Record a scenario on the host simulator')
+    cap.add_argument('output', help='Trace CSV to write')
+    cap.add_argument('--firmware', help='main.cpp to build instead of the one in the tree')
+    cap.add_argument('--scenario', help='JSON list of [command, seconds] pairs')
+    cmp_ = sub.add_parser('compare', help='Compare two traces')
+    cmp_.add_argument('a', help='Reference trace')
+    cmp_.add_argument('b', help='Candidate trace')
+    cmp_.add_argument('--json', help='Write the comparison here')
+    cmp_.add_argument('--gate', action='store_true', help='Exit 1 if B is significantly worse')
+    args = parser.parse_args()
+
+    if args.action == 'capture':
+        trace = capture(load_scenario(args.scenario), args.firmware)
+        trace.save(args.output)
+        counts = [len(trace.steps(step, dir_pin)) for _, step, dir_pin in MOTORS]
+        print(f"{args.output}: {counts[0]}/{counts[1]} steps, {len(trace.events)} commands")
+        return 0
+
+    a, b = Trace.load(args.a), Trace.load(args.b)
+    if a.events and b.events and [c for _, c in a.events] != [c for _, c in b.events]:
+        print("Warning: the traces ran different command sequences", file=sys.stderr)
+    rows, extras = compare(a, b)
+    labels = tuple(f"{path} ({t.meta.get('source', '?')}, {t.meta.get('firmware', '?')}, "
+                   f"git {t.meta.get('git', '?')})" for path, t in ((args.a, a), (args.b, b)))
+    print_report(rows, extras, labels)
+
+    if args.json:
+        with open(args.json, 'w') as f:
+            json.dump({'tool': 'trace_compare', 'version': TRACE_VERSION,
+                       'a': args.a, 'b': args.b, 'metrics': rows, **extras}, f, indent=2)
+        print(f"Comparison written to {args.json}")
+
+    if args.gate:
+        worse = [r['metric'] for r in rows if r['verdict'] == 'WORSE']
+        if worse:
+            print(f"\nB is worse on: {', '.join(worse)}")
+            return 1
+        print("\nNo significant regressions in B")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -12,14 +12,36 @@ import asyncio
 import websockets
 import json
 import logging
-from motor_controller import DualMotorController
-from typing import Set
+import os
+import time
+from controller_pool import ControllerPool
+from local_control import LocalControlServer
+from metrics import (Registry, ExternalHistogram, Gauge, CounterFunc,
+                     LATENCY_BUCKETS, DRIFT_BUCKETS)
+from telemetry_recorder import TelemetryRecorder, position_diff
+from typing import Dict, List, Optional, Set
 import signal
 
 # Configuration
 WEBSOCKET_HOST = '0.0.0.0'  # Listen on all interfaces
 WEBSOCKET_PORT = 8765
-TEENSY_PORT = '/dev/ttyACM0'
+# Teensy boards by name: USB serial number, port ('/dev/ttyACM0', 'sim://')
+# or None for the first unclaimed Teensy. Commands go to every board unless
+# prefixed with @<name>:, e.g. @rear:STOP
+TEENSY_BOARDS = {'main': None}
+TELEMETRY_INTERVAL_MS = 10                  # Teensy telemetry frame period
+TELEMETRY_RECORD_DIR = 'telemetry'          # One recording per run (None disables)
+TELEMETRY_TO_PAGES = True                   # Forward every frame to the pages' live plot
+METRICS_HOST = '127.0.0.1'                  # Prometheus endpoint (local only)
+METRICS_PORT = 9108
+PERF_POLL_INTERVAL = 2                      # Seconds between firmware PERF reads
+LOCAL_CONTROL_NAME = 'teensy_local_control' # /dev/shm endpoint for on-robot autonomy (None disables)
+
+# Joystick setpoints - a newer one replaces any still waiting to be sent
+SETPOINT_PREFIXES = ('MOVE:', 'DIFF:', 'SPIN:')
+# Stops skip the board queues (ControllerPool.stop)
+STOP_COMMANDS = ('STOP', 'X', 'ESTOP', 'E')
+ESTOP_COMMANDS = ('ESTOP', 'E')
 
 # Setup logging
 logging.basicConfig(
@@ -29,7 +51,6 @@ logging.basicConfig(
 logger = logging.getLogger(__name__)
 
 # Global state
-controller = None
 connected_clients: Set[websockets.WebSocketServerProtocol] = set()
 current_state = {
     'speed': 0,
@@ -38,20 +59,129 @@ current_state = {
 }
 
 
+def setpoint_commands(command: str) -> List[str]:
+    """Firmware commands for one setpoint; MOVE:/DIFF: expand to several"""
+    parts = command.split(':')
+    if parts[0] == 'MOVE':
+        if len(parts) != 3:
+            raise ValueError(f"Invalid MOVE command format: {command}")
+        _, direction, speed = parts
+        return [f"SPEED:{int(speed)}", direction.upper(), "RUN"]
+    if parts[0] == 'DIFF':
+        if len(parts) != 4:
+            raise ValueError(f"Invalid DIFF command format: {command}")
+        _, direction, left_speed, right_speed = parts
+        return [f"M1:SPEED:{int(left_speed)}", f"M2:SPEED:{int(right_speed)}",
+                f"M1:{direction.upper()}", f"M2:{direction.upper()}", "RUN"]
+    return [command]
+
+
 class JoystickServer:
-    def __init__(self, teensy_port: str):
+    def __init__(self, boards: Dict[str, Optional[str]]):
         """Initialize joystick server"""
-        self.controller = DualMotorController(teensy_port)
+        self.pool = ControllerPool(boards)
+        self.recorders: List[TelemetryRecorder] = []
+        self.board_drift: Dict[str, int] = {}
+        self.local_control: Optional[LocalControlServer] = None
+        self.loop: Optional[asyncio.AbstractEventLoop] = None
         self.running = False
         
+        # Boards still working on each browser command, by message id
+        self.command_boards: Dict[object, int] = {}
+        
+        self.metrics = Registry()
+        self.ws_messages = self.metrics.counter(
+            'motor_ws_messages_total', 'WebSocket messages received')
+        self.command_latency = self.metrics.histogram(
+            'motor_command_latency_seconds',
+            'Browser command receipt to Teensy ACK, per board', LATENCY_BUCKETS)
+        self.serial_rtt = self.metrics.histogram(
+            'motor_serial_rtt_seconds', 'Serial write to Teensy ACK', LATENCY_BUCKETS)
+        self.sync_drift = self.metrics.histogram(
+            'motor_sync_drift_steps', 'Position drift per telemetry frame', DRIFT_BUCKETS)
+        self.setpoints_coalesced = self.metrics.counter(
+            'motor_setpoints_coalesced_total', 'Setpoints replaced before reaching the Teensy')
+        self.fw_loop_time = self.metrics.add(ExternalHistogram(
+            'motor_firmware_loop_seconds', 'Teensy loop() period'))
+        self.fw_isr_time = self.metrics.add(ExternalHistogram(
+            'motor_firmware_isr_seconds', 'Teensy step ISR duration'))
+        pool = self.pool
+        self.metrics.add(CounterFunc(
+            'motor_setpoints_dropped_total', 'Commands dropped by the Teensy or never ACKed',
+            lambda: pool.stat_total('rx_dropped') + pool.stat_total('ack_timeouts')))
+        self.metrics.add(CounterFunc(
+            'motor_throttled_sends_total', 'Serial sends that waited for a credit',
+            lambda: pool.stat_total('throttled_sends')))
+        self.metrics.add(CounterFunc(
+            'motor_serial_commands_total', 'Command lines sent to the Teensy',
+            lambda: pool.stat_total('commands_sent')))
+        self.metrics.add(CounterFunc(
+            'motor_serial_writes_total', 'Serial write calls (commands are batched)',
+            lambda: pool.stat_total('tx_writes')))
+        self.metrics.add(Gauge(
+            'motor_serial_credits', 'Free Teensy receive-queue slots (least on any board)',
+            lambda: pool.credits))
+        self.metrics.add(Gauge(
+            'motor_boards', 'Teensy boards in the pool', lambda: len(pool)))
+        # Firmware LINK counters, polled with PERF and summed over boards
+        self.link_stats: List[dict] = []
+        self.metrics.add(CounterFunc(
+            'motor_link_rx_lost_total', 'Lines the Teensy dropped (queue full) or truncated',
+            lambda: self.link_total('dropped') + self.link_total('truncated')))
+        self.metrics.add(CounterFunc(
+            'motor_link_parse_errors_total', 'Commands the Teensy rejected as malformed or unknown',
+            lambda: self.link_total('parse_errors') + self.link_total('unknown')))
+        self.metrics.add(CounterFunc(
+            'motor_link_tx_blocked_seconds_total', 'Time the Teensy spent blocked in serial writes',
+            lambda: self.link_total('tx_blocked_us') / 1e6))
+        self.metrics.add(Gauge(
+            'motor_link_rx_backlog_max_bytes', 'Largest receive backlog seen by any Teensy',
+            lambda: max((stats['rx_backlog_max'] for stats in self.link_stats), default=0)))
+        self.local_handoff = self.metrics.histogram(
+            'motor_local_handoff_seconds',
+            'Local setpoint write to pickup by the setpoint thread', LATENCY_BUCKETS)
+        self.fan_out_skew = self.metrics.histogram(
+            'motor_fan_out_skew_seconds',
+            'Spread of the first serial write across the boards of a group', LATENCY_BUCKETS)
+        pool.skew_callback = self.fan_out_skew.observe
+        for controller in pool.controllers.values():
+            controller.rtt_callback = self.serial_rtt.observe
+        
     async def start(self):
         """Start the server"""
-        # Connect to Teensy
-        if not self.controller.connect():
+        # Connect to every Teensy (concurrently)
+        if not await asyncio.to_thread(self.pool.connect):
             logger.error("Failed to connect to Teensy!")
             return False
         
-        logger.info(f"✓ Connected to Teensy at {TEENSY_PORT}")
+        for name, port in self.pool.ports.items():
+            logger.info(f"✓ Connected to Teensy '{name}' at {port}")
+        self.loop = asyncio.get_running_loop()
+        
+        # Setpoints and telemetry for processes on this Pi, bypassing WebSocket/JSON
+        if LOCAL_CONTROL_NAME:
+            self.local_control = LocalControlServer(
+                lambda command: self.dispatch(command),
+                LOCAL_CONTROL_NAME, self.local_handoff.observe)
+            self.local_control.start()
+        
+        stamp = time.strftime('%Y%m%d_%H%M%S')
+        for index, (name, controller) in enumerate(self.pool.items()):
+            # Record the telemetry stream for offline analysis
+            if TELEMETRY_RECORD_DIR:
+                os.makedirs(TELEMETRY_RECORD_DIR, exist_ok=True)
+                suffix = f"_{name}" if len(self.pool) > 1 else ''
+                path = os.path.join(TELEMETRY_RECORD_DIR, f"run_{stamp}{suffix}.tlm")
+                recorder = TelemetryRecorder(path)
+                self.recorders.append(recorder)
+                controller.telemetry_callbacks.append(recorder.append)
+                logger.info(f"Recording telemetry to {path}")
+            if self.local_control:
+                controller.telemetry_callbacks.append(
+                    lambda frame, index=index: self.local_control.publish_frame(frame, index))
+            controller.start_telemetry(
+                TELEMETRY_INTERVAL_MS, lambda frame, name=name: self.on_telemetry(name, frame))
+        
         self.running = True
         return True
     
@@ -90,7 +220,7 @@ class JoystickServer:
             connected_clients.discard(websocket)
             # Stop motors when client disconnects (non-blocking)
             try:
-                await asyncio.to_thread(self.controller.stop_all)
+                await asyncio.to_thread(self.pool.stop)
                 logger.info(f"Motors stopped - client {client_id} disconnected")
             except Exception as e:
                 logger.error(f"Error stopping motors on disconnect: {e}")
@@ -101,24 +231,19 @@ class JoystickServer:
             data = json.loads(message)
             msg_type = data.get('type')
             
+            self.ws_messages.inc()
+            
             if msg_type == 'command':
-                # Direct serial command
+                # Handed to each board's queue; every board acks it when done
                 command = data.get('command')
-                logger.info(f"Direct command: {command}")
-                
-                # Handle compound commands for smooth real-time control
-                if command.startswith('MOVE:'):
-                    await self.handle_move_command(command)
-                elif command.startswith('DIFF:'):
-                    await self.handle_diff_command(command)
-                else:
-                    # Send direct command to Teensy
-                    response = await asyncio.to_thread(self.controller.send_command, command)
-                
-                await websocket.send(json.dumps({
-                    'type': 'response',
-                    'message': 'Command sent'
-                }))
+                logger.debug(f"Direct command: {command}")
+                try:
+                    await self.submit_command(websocket, command, data.get('id'))
+                except Exception as e:
+                    # The page waits on the id; never leave it without a reply
+                    logger.error(f"Error sending {command}: {e}")
+                    self.command_boards.pop(data.get('id'), None)
+                    await self.send_error(websocket, data.get('id'), str(e))
             
             elif msg_type == 'motor_control':
                 # Joystick motor control
@@ -129,6 +254,7 @@ class JoystickServer:
         
         except json.JSONDecodeError:
             logger.error(f"Invalid JSON: {message}")
+            await self.send_error(websocket, None, "Invalid JSON")
         except Exception as e:
             logger.error(f"Error processing message: {e}")
     
@@ -139,14 +265,14 @@ class JoystickServer:
         try:
             if cmd_type == 'forward':
                 speed = command.get('speed', 2000)
-                await asyncio.to_thread(self.controller.move_forward, speed)
+                await asyncio.to_thread(self.pool.call, 'move_forward', speed)
                 current_state['speed'] = speed
                 current_state['direction'] = 'FORWARD'
                 logger.debug(f"Forward at {speed} steps/sec")
             
             elif cmd_type == 'backward':
                 speed = command.get('speed', 2000)
-                await asyncio.to_thread(self.controller.move_backward, speed)
+                await asyncio.to_thread(self.pool.call, 'move_backward', speed)
                 current_state['speed'] = speed
                 current_state['direction'] = 'BACKWARD'
                 logger.debug(f"Backward at {speed} steps/sec")
@@ -156,10 +282,10 @@ class JoystickServer:
                 speed = command.get('speed', 2000)
                 
                 if direction == 'left':
-                    await asyncio.to_thread(self.controller.spin_left, speed)
+                    await asyncio.to_thread(self.pool.call, 'spin_left', speed)
                     current_state['direction'] = 'SPIN LEFT'
                 elif direction == 'right':
-                    await asyncio.to_thread(self.controller.spin_right, speed)
+                    await asyncio.to_thread(self.pool.call, 'spin_right', speed)
                     current_state['direction'] = 'SPIN RIGHT'
                 
                 current_state['speed'] = speed
@@ -171,25 +297,21 @@ class JoystickServer:
                 left_speed = command.get('leftSpeed', 2000)
                 right_speed = command.get('rightSpeed', 2000)
                 
-                # Set individual motor speeds (run in thread to avoid blocking)
-                await asyncio.to_thread(self.controller.set_motor_speed, 1, int(left_speed))
-                await asyncio.to_thread(self.controller.set_motor_speed, 2, int(right_speed))
-                
+                # Pipeline individual motor commands (run in thread to avoid blocking)
+                commands = [f"M1:SPEED:{int(left_speed)}", f"M2:SPEED:{int(right_speed)}"]
                 if direction == 'forward':
-                    await asyncio.to_thread(self.controller.send_command, "M1:FORWARD")
-                    await asyncio.to_thread(self.controller.send_command, "M2:FORWARD")
+                    commands += ["M1:FORWARD", "M2:FORWARD"]
                 elif direction == 'backward':
-                    await asyncio.to_thread(self.controller.send_command, "M1:BACKWARD")
-                    await asyncio.to_thread(self.controller.send_command, "M2:BACKWARD")
-                
-                await asyncio.to_thread(self.controller.send_command, "RUN")
+                    commands += ["M1:BACKWARD", "M2:BACKWARD"]
+                commands.append("RUN")
+                self.pool.post(commands, coalesce=True)
                 
                 current_state['speed'] = int((left_speed + right_speed) / 2)
                 current_state['direction'] = f"DIFF {direction.upper()}"
                 logger.debug(f"Differential {direction}: L={left_speed}, R={right_speed}")
             
             elif cmd_type == 'stop':
-                await asyncio.to_thread(self.controller.stop_all)
+                await asyncio.to_thread(self.pool.stop)
                 current_state['speed'] = 0
                 current_state['direction'] = 'STOPPED'
                 logger.debug("Motors stopped")
@@ -204,54 +326,128 @@ class JoystickServer:
                 'message': f"Motor control error: {str(e)}"
             }))
     
-    async def handle_move_command(self, command: str):
-        """Handle compound MOVE commands: MOVE:FORWARD:5000 or MOVE:BACKWARD:3000"""
-        try:
-            parts = command.split(':')
-            if len(parts) != 3:
-                logger.error(f"Invalid MOVE command format: {command}")
-                return
-            
-            _, direction, speed = parts
-            speed = int(speed)
-            
-            # Send atomically to Teensy
-            await asyncio.to_thread(self.controller.send_command, f"SPEED:{speed}")
-            await asyncio.to_thread(self.controller.send_command, direction.upper())
-            await asyncio.to_thread(self.controller.send_command, "RUN")
-            
-            current_state['speed'] = speed
+    async def submit_command(self, websocket, command: str, msg_id=None):
+        """Hand a browser command to its boards' queues without waiting
+        
+        Each board acks it separately as it finishes, so one board busy
+        with a long command never holds up the others or the page. Raises
+        ValueError for a missing, malformed or unroutable command.
+        """
+        received_at = time.perf_counter()
+        if not isinstance(command, str) or not command.strip():
+            raise ValueError(f"Missing or invalid command: {command!r}")
+        names, bare = self.route(command)
+        stop = bare.strip().upper() in STOP_COMMANDS
+        commands = None if stop else setpoint_commands(bare)
+        if command.startswith('MOVE:'):
+            _, direction, speed = command.split(':')
+            current_state['speed'] = int(speed)
             current_state['direction'] = direction.upper()
-            logger.debug(f"Move {direction} at {speed} steps/sec")
-            
-        except Exception as e:
-            logger.error(f"Error in handle_move_command: {e}")
+        elif command.startswith('DIFF:'):
+            _, direction, left_speed, right_speed = command.split(':')
+            current_state['speed'] = int((int(left_speed) + int(right_speed)) / 2)
+            current_state['direction'] = f"DIFF {direction.upper()}"
+        
+        self.command_boards[msg_id] = len(names)
+        
+        def done(name, response, superseded):
+            # Board worker thread; the connection belongs to the event loop
+            if superseded:
+                self.setpoints_coalesced.inc()
+            else:
+                self.command_latency.observe(time.perf_counter() - received_at)
+            self.loop.call_soon_threadsafe(
+                self.board_done, websocket, msg_id, name, response is not None or superseded)
+        
+        if stop:
+            # Not awaited: the page's next message must not wait for a STOP ramp
+            asyncio.ensure_future(asyncio.to_thread(self.stop, bare, names, done))
+        else:
+            self.post(bare, names, commands, done)
     
-    async def handle_diff_command(self, command: str):
-        """Handle differential steering: DIFF:FORWARD:4000:6000 or DIFF:BACKWARD:3000:5000"""
+    async def send_error(self, websocket, msg_id, message: str):
+        """Tell the page a command went nowhere (no per-board acks follow)"""
         try:
-            parts = command.split(':')
-            if len(parts) != 4:
-                logger.error(f"Invalid DIFF command format: {command}")
-                return
-            
-            _, direction, left_speed, right_speed = parts
-            left_speed = int(left_speed)
-            right_speed = int(right_speed)
-            
-            # Send atomically to Teensy
-            await asyncio.to_thread(self.controller.send_command, f"M1:SPEED:{left_speed}")
-            await asyncio.to_thread(self.controller.send_command, f"M2:SPEED:{right_speed}")
-            await asyncio.to_thread(self.controller.send_command, f"M1:{direction.upper()}")
-            await asyncio.to_thread(self.controller.send_command, f"M2:{direction.upper()}")
-            await asyncio.to_thread(self.controller.send_command, "RUN")
-            
-            current_state['speed'] = int((left_speed + right_speed) / 2)
-            current_state['direction'] = f"DIFF {direction.upper()}"
-            logger.debug(f"Diff {direction}: L={left_speed}, R={right_speed}")
-            
+            await websocket.send(json.dumps({'type': 'error', 'id': msg_id, 'message': message}))
         except Exception as e:
-            logger.error(f"Error in handle_diff_command: {e}")
+            logger.debug(f"Could not send error reply: {e}")
+    
+    def board_done(self, websocket, msg_id, board: str, ok: bool):
+        """One board finished a browser command (event loop)"""
+        remaining = self.command_boards.get(msg_id, 1) - 1
+        if remaining:
+            self.command_boards[msg_id] = remaining
+        else:
+            self.command_boards.pop(msg_id, None)
+        if not ok:
+            logger.error(f"Board {board}: command {msg_id} failed")
+        asyncio.ensure_future(self.send_ack(websocket, msg_id, board, ok, remaining))
+    
+    async def send_ack(self, websocket, msg_id, board: str, ok: bool, remaining: int):
+        """Tell the page a board is done with a command. Echoes the page's
+        message id (for its RTT measurement), names the board and how many
+        are still working on it, and advertises the least free Teensy queue
+        slots and the longest board backlog so it can size its send window
+        and rate."""
+        try:
+            await websocket.send(json.dumps({
+                'type': 'ack',
+                'id': msg_id,
+                'board': board,
+                'ok': ok,
+                'pending': remaining,
+                'credits': self.pool.credits,
+                'queue': self.pool.backlog
+            }))
+        except websockets.exceptions.ConnectionClosed:
+            pass
+    
+    def route(self, command: str):
+        """Boards for one page/local command and the command itself;
+        @<board>: limits it to that board"""
+        names = self.pool.names
+        if command.startswith('@'):
+            board, _, command = command[1:].partition(':')
+            if board not in self.pool.controllers:
+                raise ValueError(f"Unknown board {board}")
+            names = [board]
+        return names, command
+    
+    def post(self, command: str, names: List[str], commands: List[str], done=None):
+        """Queue commands on the boards; a newer setpoint replaces one not yet started"""
+        self.pool.post(commands, names, coalesce=command.startswith(SETPOINT_PREFIXES), done=done)
+    
+    def stop(self, command: str, names: List[str], done=None):
+        """STOP/ESTOP the boards from this thread, ahead of their queues, and
+        wait for the ACKs"""
+        emergency = command.strip().upper() in ESTOP_COMMANDS
+        for name, ok in self.pool.stop(names, emergency).items():
+            if done:
+                done(name, '' if ok else None, False)
+    
+    def dispatch(self, command: str):
+        """Send one local setpoint/command (setpoint thread); only stops wait,
+        for their ACKs"""
+        names, command = self.route(command)
+        if command.strip().upper() in STOP_COMMANDS:
+            self.stop(command, names)
+        else:
+            self.post(command, names, setpoint_commands(command))
+    
+    def on_telemetry(self, board: str, frame: dict):
+        """Telemetry frame callback (that board's serial reader thread)"""
+        drift = abs(position_diff(frame['position1'], frame['position2']))
+        self.sync_drift.observe(drift)
+        self.board_drift[board] = drift
+        current_state['syncDrift'] = max(self.board_drift.values())
+        
+        if TELEMETRY_TO_PAGES and connected_clients:
+            # broadcast() queues without waiting for slow pages; it must run
+            # on the event loop, which owns the connections
+            message = json.dumps({'type': 'telemetry', 'board': board, 'millis': frame['millis'],
+                                  'speed1': frame['speed1'], 'speed2': frame['speed2'],
+                                  'drift': drift})
+            self.loop.call_soon_threadsafe(websockets.broadcast, connected_clients, message)
     
     async def broadcast_status(self):
         """Broadcast current status to all connected clients"""
@@ -277,20 +473,17 @@ class JoystickServer:
         connected_clients.difference_update(disconnected)
     
     async def status_update_loop(self):
-        """Periodically request status from Teensy and broadcast to clients"""
+        """Periodically pull firmware timing and link counters and broadcast status"""
         while self.running:
             try:
-                # Request status from Teensy (non-blocking)
-                status = await asyncio.to_thread(self.controller.get_status)
-                
-                if status and 'Sync Drift:' in status:
-                    # Parse sync drift from status
-                    lines = status.split('\n')
-                    for line in lines:
-                        if 'Sync Drift:' in line:
-                            drift_str = line.split(':')[1].strip().split()[0]
-                            current_state['syncDrift'] = int(drift_str)
-                            break
+                # Sync drift arrives with telemetry; PERF feeds the timing histograms,
+                # LINK the serial link counters
+                perfs = await asyncio.to_thread(self.pool.call, 'get_perf')
+                perfs = [perf for perf in perfs.values() if perf]
+                if perfs:
+                    self.update_firmware_metrics(perfs)
+                links = await asyncio.to_thread(self.pool.call, 'get_link_stats')
+                self.link_stats = [link for link in links.values() if link]
                 
                 # Broadcast status to all clients
                 await self.broadcast_status()
@@ -298,16 +491,34 @@ class JoystickServer:
             except Exception as e:
                 logger.error(f"Status update error: {e}")
             
-            # Update every 2 seconds
-            await asyncio.sleep(2)
+            await asyncio.sleep(PERF_POLL_INTERVAL)
+    
+    def link_total(self, key: str) -> int:
+        return sum(stats[key] for stats in self.link_stats)
+    
+    def update_firmware_metrics(self, perfs: List[dict]):
+        """Convert the Teensys' power-of-two PERF buckets to seconds, summed
+        over boards (all boards run the same firmware and clock)"""
+        perf = perfs[0]
+        loop_buckets = [sum(b) for b in zip(*(p['loop_buckets'] for p in perfs))]
+        self.fw_loop_time.set(
+            [2 ** i / 1e6 for i in range(len(loop_buckets) - 1)],
+            loop_buckets, sum(p['loop_total_us'] for p in perfs) / 1e6)
+        
+        isr_buckets = [sum(b) for b in zip(*(p['isr_buckets'] for p in perfs))]
+        hz = perf['cpu_hz'] or 1
+        self.fw_isr_time.set(
+            [2 ** (i + perf['isr_shift']) / hz for i in range(len(isr_buckets) - 1)],
+            isr_buckets, sum(p['isr_total_cycles'] for p in perfs) / hz)
     
     async def run_server(self):
         """Run the WebSocket server"""
         if not await self.start():
             return
         
-        # Start status update loop
+        # Start status update loop and metrics endpoint
         status_task = asyncio.create_task(self.status_update_loop())
+        metrics_server = await self.metrics.serve(METRICS_HOST, METRICS_PORT)
         
         logger.info(f"WebSocket server starting on {WEBSOCKET_HOST}:{WEBSOCKET_PORT}")
         
@@ -333,8 +544,13 @@ class JoystickServer:
         finally:
             self.running = False
             status_task.cancel()
-            self.controller.emergency_stop()
-            self.controller.close()
+            metrics_server.close()
+            if self.local_control:
+                self.local_control.close()
+            self.pool.stop(emergency=True)
+            for recorder in self.recorders:
+                recorder.close()
+            self.pool.disconnect()
             logger.info("Server stopped")
 
 
@@ -345,7 +561,7 @@ def main():
     logger.info("=" * 60)
     
     # Create server
-    server = JoystickServer(TEENSY_PORT)
+    server = JoystickServer(TEENSY_BOARDS)
     
     # Run server
     try:
@@ -0,0 +1,244 @@
+/*
+ * Host Arduino/Teensyduino shim
+ * Just enough of the Teensy 4.1 core API to build main.cpp on a PC, driven
+ * by the virtual clock in teensy_sim.cpp. Never used by the firmware build
+ * (the Arduino IDE only compiles the sketch folder and src/).
+ *
+ * Differences from the target worth knowing:
+ * - Time only moves when the firmware waits (delay, delayMicroseconds),
+ *   prints, or finishes a loop() pass; ISRs fire at those points.
+ * - noInterrupts()/interrupts() are no-ops because ISRs never preempt
+ *   straight-line code.
+ *
+ * Defining SIM_COUNT_STRING_WORK makes every String operation, and the
+ * firmware's own CmdText slices, add the bytes they scan or copy to
+ * sim_string_work (parser_fuzz.cpp's parse cost).
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <string>
+#include <type_traits>
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define LED_BUILTIN 13
+#define DEC 10
+#define PI 3.1415926535897932384626433832795
+
+#define F(string_literal) (string_literal)
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+using std::max;  // Templates on Teensyduino too, not macros
+using std::min;
+
+// Timing
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t msec);
+void delayMicroseconds(uint32_t usec);
+
+// Digital I/O
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+uint8_t digitalRead(uint8_t pin);
+void digitalWriteFast(uint8_t pin, uint8_t val);
+void digitalToggleFast(uint8_t pin);
+
+// Interrupts
+void noInterrupts();
+void interrupts();
+
+// Cycle counter and clock (600 MHz Teensy 4.1)
+uint32_t sim_cycle_count();
+extern volatile uint32_t ARM_DEMCR;
+extern volatile uint32_t ARM_DWT_CTRL;
+extern volatile uint32_t F_CPU_ACTUAL;
+#define ARM_DWT_CYCCNT (sim_cycle_count())
+#define ARM_DEMCR_TRCENA (1 << 24)
+#define ARM_DWT_CTRL_CYCCNTENA (1 << 0)
+
+#ifdef SIM_COUNT_STRING_WORK
+extern uint64_t sim_string_work;
+#define STRING_WORK(bytes) (sim_string_work += (bytes))
+#else
+#define STRING_WORK(bytes) ((void)0)
+#endif
+
+class String {
+public:
+  String(const char *cstr = "") : buffer(cstr ? cstr : "") { STRING_WORK(buffer.size()); }
+  String(const String &str) : buffer(str.buffer) { STRING_WORK(buffer.size()); }
+  String(const std::string &str) : buffer(str) { STRING_WORK(buffer.size()); }
+  explicit String(char c) : buffer(1, c) {}
+  String &operator=(const String &rhs) {
+    buffer = rhs.buffer;
+    STRING_WORK(buffer.size());
+    return *this;
+  }
+
+  unsigned int length() const { return buffer.size(); }
+  bool reserve(unsigned int size) { buffer.reserve(size); return true; }
+  const char *c_str() const { return buffer.c_str(); }
+  char operator[](unsigned int index) const { return index < buffer.size() ? buffer[index] : 0; }
+  char charAt(unsigned int index) const { return (*this)[index]; }
+
+  String &operator+=(char c) { buffer += c; STRING_WORK(1); return *this; }
+  String &operator+=(const char *cstr) { buffer += cstr; STRING_WORK(strlen(cstr)); return *this; }
+  String &operator+=(const String &str) { buffer += str.buffer; STRING_WORK(str.length()); return *this; }
+
+  bool operator==(const char *cstr) const { STRING_WORK(compareWork(cstr)); return buffer == cstr; }
+  bool operator==(const String &rhs) const { STRING_WORK(compareWork(rhs.c_str())); return buffer == rhs.buffer; }
+  bool operator!=(const char *cstr) const { return !(*this == cstr); }
+  bool equals(const String &rhs) const { return *this == rhs; }
+
+  bool startsWith(const String &prefix) const {
+    STRING_WORK(prefix.length());
+    return buffer.compare(0, prefix.buffer.size(), prefix.buffer) == 0;
+  }
+  bool endsWith(const String &suffix) const {
+    STRING_WORK(suffix.length());
+    return buffer.size() >= suffix.buffer.size() &&
+           buffer.compare(buffer.size() - suffix.buffer.size(), suffix.buffer.size(), suffix.buffer) == 0;
+  }
+
+  int indexOf(char c, unsigned int fromIndex = 0) const {
+    size_t pos = buffer.find(c, fromIndex);
+    STRING_WORK(scanWork(fromIndex, pos, 1));
+    return pos == std::string::npos ? -1 : (int)pos;
+  }
+  int indexOf(const String &str, unsigned int fromIndex = 0) const {
+    size_t pos = buffer.find(str.buffer, fromIndex);
+    STRING_WORK(scanWork(fromIndex, pos, str.length()) * (str.length() ? str.length() : 1));
+    return pos == std::string::npos ? -1 : (int)pos;
+  }
+
+  // Same clamping as the Teensy core: negative indexes wrap to huge unsigned
+  // values and are clamped to the end, reversed bounds are swapped
+  String substring(unsigned int beginIndex) const { return substring(beginIndex, length()); }
+  String substring(unsigned int left, unsigned int right) const {
+    if (left > right) {
+      unsigned int temp = right;
+      right = left;
+      left = temp;
+    }
+    if (left >= buffer.size()) return String();
+    if (right > buffer.size()) right = buffer.size();
+    return String(buffer.substr(left, right - left));
+  }
+
+  void trim() {
+    STRING_WORK(buffer.size());
+    size_t begin = buffer.find_first_not_of(" \t\r\n\f\v");
+    if (begin == std::string::npos) {
+      buffer.clear();
+      return;
+    }
+    size_t end = buffer.find_last_not_of(" \t\r\n\f\v");
+    buffer = buffer.substr(begin, end - begin + 1);
+  }
+  void toUpperCase() {
+    STRING_WORK(buffer.size());
+    for (char &c : buffer) {
+      if (c >= 'a' && c <= 'z') c -= 'a' - 'A';
+    }
+  }
+
+  long toInt() const { STRING_WORK(buffer.size()); return atol(buffer.c_str()); }
+  float toFloat() const { STRING_WORK(buffer.size()); return (float)atof(buffer.c_str()); }
+
+private:
+  std::string buffer;
+
+  // Bytes a compare or search looks at before it can stop
+  size_t compareWork(const char *cstr) const {
+    size_t n = 0;
+    while (n < buffer.size() && cstr[n] && cstr[n] == buffer[n]) n++;
+    return n + 1;
+  }
+  size_t scanWork(size_t from, size_t found, size_t needle) const {
+    if (from >= buffer.size()) return 1;
+    return (found == std::string::npos ? buffer.size() : found + needle) - from;
+  }
+};
+
+// No virtual destructor, as in the Teensy core: a Print subclass in the
+// firmware must not pull operator delete in through its vtable
+class Print {
+public:
+  virtual size_t write(uint8_t b) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size) {
+    for (size_t i = 0; i < size; i++) write(buffer[i]);
+    return size;
+  }
+  size_t write(const char *str) { return write((const uint8_t *)str, strlen(str)); }
+  size_t write(const char *buffer, size_t size) { return write((const uint8_t *)buffer, size); }
+
+  size_t print(const char *s) { return write(s); }
+  size_t print(const String &s) { return write(s.c_str(), s.length()); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(uint8_t n) { return printNumber(n); }
+  size_t print(int n) { return printNumber(n); }
+  size_t print(unsigned int n) { return printNumber(n); }
+  size_t print(long n) { return printNumber(n); }
+  size_t print(unsigned long n) { return printNumber(n); }
+  size_t print(long long n) { return printNumber(n); }
+  size_t print(unsigned long long n) { return printNumber(n); }
+  size_t print(double n, int digits = 2) {
+    char buf[64];
+    int len = snprintf(buf, sizeof(buf), "%.*f", digits, n);
+    return write(buf, len);
+  }
+
+  size_t println() { return write("\r\n", 2); }
+  template <typename T> size_t println(T value) { size_t n = print(value); return n + println(); }
+  size_t println(double n, int digits) { size_t len = print(n, digits); return len + println(); }
+
+private:
+  // Stack buffer like the Teensy core's, so printing never allocates
+  template <typename T> size_t printNumber(T n) {
+    char buf[24];
+    int len = std::is_signed<T>::value ? snprintf(buf, sizeof(buf), "%lld", (long long)n)
+                                       : snprintf(buf, sizeof(buf), "%llu", (unsigned long long)n);
+    return write(buf, len);
+  }
+};
+
+class usb_serial_class : public Print {
+public:
+  void begin(long) {}
+  operator bool() { return true; }
+  int available();
+  int read();
+  int peek();
+  int availableForWrite();
+  void flush() {}
+  size_t write(uint8_t b) override;
+  size_t write(const uint8_t *buffer, size_t size) override;
+  using Print::write;
+};
+
+extern usb_serial_class Serial;
+
+class IntervalTimer {
+public:
+  IntervalTimer() : channel(-1) {}
+  bool begin(void (*funct)(), float microseconds);
+  bool begin(void (*funct)(), double microseconds) { return begin(funct, (float)microseconds); }
+  bool begin(void (*funct)(), unsigned int microseconds) { return begin(funct, (float)microseconds); }
+  bool begin(void (*funct)(), int microseconds) { return begin(funct, (float)microseconds); }
+  void update(float microseconds);
+  void end();
+  void priority(uint8_t) {}
+
+private:
+  int channel;
+};
@@ -0,0 +1,91 @@
+/*
+ * Host Microbenchmarks for the Firmware Kernels
+ * Times the firmware's hot functions (kernels.h) on the host: command
+ * tokenize/dispatch per verb and for a joystick session mix, updateSpeed in
+ * each ramp regime, step period computation, the step ISRs, the sync check
+ * and the status/telemetry formatters. Builds the same main.cpp + Arduino
+ * shim as the simulator.
+ *
+ * Each benchmark is calibrated to BATCH_MIN_NS per batch and run BATCHES
+ * times; the median batch gives ns/op. Results go to stdout as one JSON
+ * document. raspberry_pi_control/kernel_bench.py builds, runs and compares
+ * them against a baseline.
+ *
+ * Host numbers rank changes, they do not predict Cortex-M7 cycles.
+ *
+ * Usage: kernel_bench [name-filter]
+ */
+
+#include "teensy_sim.cpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+#define BATCHES 9
+#define BATCH_MIN_NS 2000000ULL     // Calibrate each batch to at least 2 ms
+
+struct BenchResult {
+  std::string name;
+  uint64_t opsPerBatch;
+  double nsPerOp;      // Median batch
+  double minNsPerOp;   // Fastest batch
+};
+
+static std::vector<BenchResult> results;
+static const char *filter = nullptr;
+
+static uint64_t nowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Run op(i) in calibrated batches; op must be repeatable from the state
+// setup() leaves behind
+static void bench(const std::string &name, const std::function<void()> &setup,
+                  const std::function<void(uint64_t)> &op) {
+  if (filter && name.find(filter) == std::string::npos) return;
+  setup();
+
+  uint64_t ops = 1;
+  while (true) {
+    uint64_t start = nowNs();
+    for (uint64_t i = 0; i < ops; i++) op(i);
+    uint64_t elapsed = nowNs() - start;
+    txBytes.clear();
+    if (elapsed >= BATCH_MIN_NS) break;
+    ops = elapsed ? std::max<uint64_t>(ops * 2, ops * BATCH_MIN_NS / elapsed + 1) : ops * 2;
+  }
+
+  std::vector<double> perOp;
+  for (int b = 0; b < BATCHES; b++) {
+    uint64_t start = nowNs();
+    for (uint64_t i = 0; i < ops; i++) op(i);
+    perOp.push_back((double)(nowNs() - start) / ops);
+    txBytes.clear();
+  }
+  std::sort(perOp.begin(), perOp.end());
+  results.push_back({name, ops, perOp[BATCHES / 2], perOp[0]});
+  fprintf(stderr, "%-36s %10.1f ns/op\n", name.c_str(), perOp[BATCHES / 2]);
+}
+
+#include "kernels.h"
+
+int main(int argc, char **argv) {
+  if (argc > 1) filter = argv[1];
+  setup();
+
+  runKernels();
+
+  printf("{\n  \"unit\": \"ns/op\",\n  \"batches\": %d,\n  \"benchmarks\": [", BATCHES);
+  for (size_t i = 0; i < results.size(); i++) {
+    const BenchResult &r = results[i];
+    printf("%s\n    {\"name\": \"%s\", \"ns_per_op\": %.2f, \"min_ns_per_op\": %.2f, \"ops_per_batch\": %llu}",
+           i ? "," : "", r.name.c_str(), r.nsPerOp, r.minNsPerOp, (unsigned long long)r.opsPerBatch);
+  }
+  printf("\n  ]\n}\n");
+  return 0;
+}
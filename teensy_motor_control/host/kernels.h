@@ -0,0 +1,285 @@
+/*
+ * Firmware Kernels for the Host Benchmark
+ * The hot functions the benchmark harness times, each as a setup and an
+ * op. Included after teensy_sim.cpp by a harness that defines
+ *   static void bench(const std::string &name, const std::function<void()> &setup,
+ *                     const std::function<void(uint64_t)> &op);
+ * which runs setup() once (from resetFirmware() state) and op(i) repeatedly.
+ * kernel_bench.cpp times them in ns on the host.
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+#define JOYSTICK_LINES 4096
+#define JOYSTICK_SEED 0x5EEDu
+
+// Firmware state every benchmark starts from: idle, defaults, no output
+static void resetFirmware() {
+  for (Motor *m : {&motor1, &motor2}) {
+    m->timer.end();
+    m->position = 0;
+    m->currentSpeed = 0;
+    m->targetSpeed = 0;
+    m->isRunning = false;
+    m->direction = 1;
+    m->boostActive = false;
+    resetShaper(*m);
+  }
+  configureShaper(SHAPER_OFF, 0, 0);
+  accelRate = ACCEL_RATE;
+  feedOverride = 100;
+  paused = false;
+  pvtState = PVT_IDLE;
+  pvtCount = 0;
+  telemetryInterval = 0;
+  txBytes.clear();
+}
+
+static void kernel(const std::string &name, const std::function<void()> &setup,
+                   const std::function<void(uint64_t)> &op) {
+  bench(name, [&setup] {
+    resetFirmware();
+    setup();
+  }, op);
+}
+
+// Keep the serial output from growing without bound inside a batch
+static inline void drainSerial() {
+  if (txBytes.size() > 65536) txBytes.clear();
+}
+
+// Command Dispatch
+
+// One representative line per processCommand verb. Motors are idle, so
+// direction changes and stops take their non-blocking paths and the cost
+// measured is parsing, dispatch and the reply text.
+static const char *const VERBS[][2] = {
+  {"SPEED", "SPEED:4000"},
+  {"M1_SPEED", "M1:SPEED:3500"},
+  {"FORWARD", "FORWARD"},
+  {"M2_BACKWARD", "M2:BACKWARD"},
+  {"RUN", "RUN"},
+  {"STOP", "STOP"},
+  {"RESET", "RESET"},
+  {"STATUS", "STATUS"},
+  {"STATUS_C", "STATUS:C"},
+  {"SYNC", "SYNC"},
+  {"TELEMETRY", "TEL:0"},
+  {"PERF", "PERF"},
+  {"OVERRIDE", "OV:80"},
+  {"PAUSE", "PAUSE"},
+  {"RESUME", "RESUME"},
+  {"PVT_QUERY", "PVT:?"},
+  {"HELLO", "HELLO:1a2b3c"},
+  {"CONFIG_ACCEL", "CONFIG:ACCEL:8000"},
+  {"CONFIG_SHAPER", "CONFIG:SHAPER:ZVD:1.5:0.05"},
+  {"HELP", "HELP"},
+  {"UNKNOWN", "FROB:1"},
+};
+
+// Lines a joystick session sends (see websocket_server.py): a differential
+// speed pair, both directions and RUN per stick update, with an occasional
+// compact status poll, feed override nudge or stop.
+static std::vector<std::string> joystickSession() {
+  std::vector<std::string> lines;
+  uint32_t rng = JOYSTICK_SEED;
+  auto next = [&rng]() {
+    rng = rng * 1664525u + 1013904223u;
+    return rng >> 8;
+  };
+  char line[RX_LINE_MAX];
+  while (lines.size() < JOYSTICK_LINES) {
+    uint32_t left = next() % MAX_SPEED;
+    uint32_t right = next() % MAX_SPEED;
+    const char *dir = next() % 8 ? "FORWARD" : "BACKWARD";
+    snprintf(line, sizeof(line), "M1:SPEED:%lu", (unsigned long)left);
+    lines.push_back(line);
+    snprintf(line, sizeof(line), "M2:SPEED:%lu", (unsigned long)right);
+    lines.push_back(line);
+    lines.push_back(std::string("M1:") + dir);
+    lines.push_back(std::string("M2:") + dir);
+    lines.push_back("RUN");
+    uint32_t extra = next() % 20;
+    if (extra == 0) {
+      lines.push_back("STATUS:C");
+    } else if (extra == 1) {
+      snprintf(line, sizeof(line), "OV:%lu", (unsigned long)(50 + next() % 100));
+      lines.push_back(line);
+    } else if (extra == 2) {
+      lines.push_back("STOP");
+    }
+  }
+  lines.resize(JOYSTICK_LINES);
+  return lines;
+}
+
+static void benchDispatch() {
+  for (const auto &verb : VERBS) {
+    const char *line = verb[1];
+    kernel(std::string("dispatch/") + verb[0], [] {}, [line](uint64_t) {
+      processCommand(line);
+      drainSerial();
+    });
+  }
+
+  static const std::vector<std::string> session = joystickSession();
+  kernel("dispatch/joystick_mix", [] {}, [](uint64_t i) {
+    processCommand(session[i % session.size()].c_str());
+    drainSerial();
+  });
+
+  // The whole receive path for the same mix: bytes -> queue -> dispatch -> ACK
+  kernel("dispatch/joystick_mix_rx_ack", [] {}, [](uint64_t i) {
+    const std::string &line = session[i % session.size()];
+    for (char c : line) rxBytes.push_back((uint8_t)c);
+    rxBytes.push_back('\n');
+    readSerial();
+    processCommand(rxQueue[rxTail]);
+    rxTail = (rxTail + 1) % RX_QUEUE_DEPTH;
+    rxCount--;
+    sendAck();
+    drainSerial();
+  });
+}
+
+// Ramp
+
+struct RampRegime {
+  const char *name;
+  float rampFrom;      // Ramp speed restored before every call
+  float target;
+  bool boost;
+  uint8_t shaper;
+  uint8_t feed;
+};
+
+static const RampRegime REGIMES[] = {
+  {"idle", 0, 0, false, SHAPER_OFF, 100},
+  {"accelerating", 2000, 12000, false, SHAPER_OFF, 100},
+  {"cruising", 8000, 8000, false, SHAPER_OFF, 100},
+  {"decelerating", 12000, 2000, false, SHAPER_OFF, 100},
+  {"boost", 8000, 12000, true, SHAPER_OFF, 100},
+  {"override_60", 8000, 12000, false, SHAPER_OFF, 60},
+  {"zv_accelerating", 2000, 12000, false, SHAPER_ZV, 100},
+  {"zvd_accelerating", 2000, 12000, false, SHAPER_ZVD, 100},
+  {"zvd_cruising", 8000, 8000, false, SHAPER_ZVD, 100},
+};
+
+static void benchRamp() {
+  for (const RampRegime &r : REGIMES) {
+    const RampRegime *regime = &r;
+    kernel(std::string("ramp/updateSpeed/") + r.name, [regime] {
+      if (regime->shaper != SHAPER_OFF) configureShaper(regime->shaper, 1.5, 0.05);
+      feedOverride = regime->feed;
+      motor1.targetSpeed = regime->target;
+      motor1.isRunning = regime->target > 0;
+      motor1.boostActive = regime->boost;
+      motor1.boostStartTime = millis();
+      motor1.normalSpeed = regime->target;
+      resetShaper(motor1, regime->rampFrom);
+    }, [regime](uint64_t) {
+      motor1.rampSpeed = regime->rampFrom;
+      updateSpeed(motor1);
+    });
+  }
+}
+
+// Step Period
+
+static void benchPeriod() {
+  // Speeds a ramp walks through, so the timer period changes every call
+  kernel("period/updateTimers", [] {
+    motor1.isRunning = motor2.isRunning = true;
+  }, [](uint64_t i) {
+    float speed = MIN_SPEED + (float)(i % 128) * (MAX_SPEED - MIN_SPEED) / 128;
+    motor1.currentSpeed = speed;
+    motor2.currentSpeed = speed * 0.9f;
+    updateTimers();
+  });
+
+  kernel("period/setStepRate", [] {}, [](uint64_t i) {
+    float rate = (float)((int)(i % 256) - 128) * (MAX_SPEED / 128.0f);
+    setStepRate(motor1, stepISR_M1, rate);
+  });
+}
+
+// Sync Check
+
+static void benchSync() {
+  kernel("sync/checkSync/in_sync", [] {
+    motor1.isRunning = true;
+    motor1.position = 10000;
+    motor2.position = 10002;
+  }, [](uint64_t) { checkSync(); });
+
+  kernel("sync/checkSync/drifting", [] {
+    motor1.isRunning = true;
+    motor1.position = 10000;
+    motor2.position = 10000 + SYNC_THRESHOLD * 4;
+  }, [](uint64_t) {
+    checkSync();
+    drainSerial();
+  });
+}
+
+// Status Formatting
+
+static void runningState() {
+  motor1.isRunning = motor2.isRunning = true;
+  motor1.currentSpeed = 7984.5f;
+  motor2.currentSpeed = 7991.0f;
+  motor1.targetSpeed = motor2.targetSpeed = 8000;
+  motor1.position = 1234567;
+  motor2.position = 1234561;
+  motor2.direction = -1;
+}
+
+// Step ISRs
+// On the target each also busy-waits delayMicroseconds(5) for the pulse
+// width (3000 cycles at 600 MHz); the shim's delay is a clock advance.
+
+static void benchIsr() {
+  kernel("isr/stepISR_M1", [] {}, [](uint64_t) { stepISR_M1(); });
+  kernel("isr/stepISR_M2", [] {
+    motor2.direction = -1;
+  }, [](uint64_t) { stepISR_M2(); });
+}
+
+static void benchFormat() {
+  kernel("format/printStatus", runningState, [](uint64_t) {
+    printStatus();
+    drainSerial();
+  });
+  kernel("format/printStatusCompact", runningState, [](uint64_t) {
+    printStatusCompact();
+    drainSerial();
+  });
+  kernel("format/sendTelemetry", runningState, [](uint64_t) {
+    sendTelemetry();
+    drainSerial();
+  });
+  kernel("format/sendAck", [] {}, [](uint64_t) {
+    sendAck();
+    drainSerial();
+  });
+  kernel("format/printPerf", [] {}, [](uint64_t) {
+    printPerf();
+    drainSerial();
+  });
+}
+
+// Every kernel, in report order
+static void runKernels() {
+  benchDispatch();
+  benchRamp();
+  benchPeriod();
+  benchIsr();
+  benchSync();
+  benchFormat();
+  resetFirmware();
+}
@@ -0,0 +1,342 @@
+/*
+ * Command Parser Fuzzer
+ * Feeds mutated command lines through the firmware's real receive path
+ * (readSerial, then processCommand for each queued line) and checks after
+ * every input that:
+ * - nothing crashed or read out of bounds (build with ASan/UBSan)
+ * - the state a command can set stays sane: finite speeds within
+ *   0..MAX_SPEED, a positive acceleration, a valid boost and shaper
+ *   config, bounded queues and line buffer
+ * - no command blocks for more than MAX_BLOCK_MS of virtual time
+ * and records each input's parse cost: the bytes the parser's text
+ * operations (CmdText in main.cpp) scan or copy (SIM_COUNT_STRING_WORK,
+ * deterministic) and the wall time, both
+ * per input byte. Mutations start from valid commands and keep climbing
+ * from the costliest inputs found so far.
+ *
+ * Results go to stdout as one JSON document;
+ * raspberry_pi_control/parser_fuzz.py builds it with sanitizers, runs it
+ * and enforces the parse cost limit. Runs are deterministic per seed, so
+ * after a sanitizer abort the same run with "trace" (every input echoed to
+ * stderr) names the input.
+ *
+ * Usage: parser_fuzz [iterations] [seed] [trace]
+ */
+
+#ifndef SIM_COUNT_STRING_WORK
+#define SIM_COUNT_STRING_WORK
+#endif
+#include "teensy_sim.cpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#define DEFAULT_ITERATIONS 200000
+#define RESET_EVERY 64           // Inputs between firmware resets
+#define SETTLE_MS 30             // Virtual time run after each input (ramps see the new state)
+#define SIM_LOOP_COST_US 100     // Coarse loop() passes; only the ramp ticks matter here
+#define TOP_INPUTS 16            // Costliest inputs kept to mutate and report
+#define MAX_FAILURES 32
+#define MAX_BLOCK_MS 25000       // Longest one input may hold up loop() (STOP at MIN_ACCEL_RATE)
+#define MAX_INPUT_BYTES 256      // Mutated inputs are cut to this (a few lines)
+#define LONG_LINE_BYTES 100000   // Unterminated line fed by the overflow check
+
+struct CostRecord {
+  std::string input;
+  uint64_t work;
+  double workPerByte;
+  double nsPerByte;
+};
+
+static std::mt19937 rng;
+static std::string currentInput;
+static std::vector<CostRecord> costliest;   // By work per byte, highest first
+static std::vector<std::string> failures;
+static CostRecord worstNs = {"", 0, 0, 0};
+static CostRecord heaviest = {"", 0, 0, 0};    // Most work in one input
+
+static const char *const SEEDS[] = {
+  "SPEED:4000", "M1:SPEED:3500", "2:S:100", "FORWARD", "M2:BACKWARD", "RUN", "STOP",
+  "ESTOP", "RESET", "M1:RESET", "STATUS", "STATUS:C", "?", "SYNC", "TEL:50", "PERF",
+  "OV:80", "PAUSE", "RESUME", "PVT:100:200:1000:-200:-1000", "PVT:GO", "PVT:?",
+  "HELLO:1a2b3c", "CONFIG:BOOST:1.5:200:1", "CONFIG:ACCEL:8000",
+  "CONFIG:SHAPER:ZV:2:0.1", "CONFIG:SHAPER:OFF", "CONFIG", "SPIN:LEFT:2000",
+  "BOOST:FORWARD:3000", "BOOST:R:100", "BENCH",
+};
+
+static const char *const TOKENS[] = {
+  ":", "::", "M1:", "M2:", "1:", "2:", "SPEED", "S", "FORWARD", "BACKWARD", "RUN", "STOP",
+  "ESTOP", "RESET", "STATUS", "SYNC", "TEL", "OV", "PAUSE", "RESUME", "PVT", "GO", "HELLO",
+  "CONFIG", "BOOST", "ACCEL", "SHAPER", "ZV", "ZVD", "OFF", "SPIN", "LEFT", "RIGHT", "F",
+  "B", "L", "R", "C", "?", "0", "1", "-1", "-0", "0.5", "20000", "65536", "1e38", "-1e38",
+  "99999999999", "NAN", "INF", "-INF", "0X1F", " ", "\t", "\r", "\n", ".", "-", "+", "E",
+};
+
+// Firmware state every run starts from: idle, defaults, nothing buffered
+static void resetFirmware() {
+  for (Motor *m : {&motor1, &motor2}) {
+    m->timer.end();
+    m->position = 0;
+    m->currentSpeed = 0;
+    m->targetSpeed = 0;
+    m->isRunning = false;
+    m->direction = 1;
+    m->boostActive = false;
+    resetShaper(*m);
+  }
+  configureShaper(SHAPER_OFF, 0, 0);
+  boostConfig = {BOOST_MULTIPLIER, BOOST_DURATION, true};
+  accelRate = ACCEL_RATE;
+  feedOverride = 100;
+  paused = false;
+  pvtState = PVT_IDLE;
+  pvtCount = 0;
+  telemetryInterval = 0;
+  rxLineLen = 0;
+  rxCount = 0;
+  rxHead = rxTail = 0;
+  rxBytes.clear();
+  txBytes.clear();
+}
+
+static std::string escaped(const std::string &s) {
+  std::string out;
+  for (unsigned char c : s) {
+    char buf[8];
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if (c >= 0x20 && c < 0x7f) {
+      out += c;
+    } else {
+      snprintf(buf, sizeof(buf), "\\u%04x", c);
+      out += buf;
+    }
+  }
+  return out;
+}
+
+static void fail(const std::string &what) {
+  if (failures.size() < MAX_FAILURES) {
+    failures.push_back(what + " after \"" + currentInput + "\"");
+  }
+}
+
+static bool saneSpeed(float speed) {
+  return speed >= 0 && speed <= MAX_SPEED;  // False for NaN
+}
+
+static void checkState(const char *when) {
+  std::string at = std::string(" (") + when + ")";
+  for (Motor *m : {&motor1, &motor2}) {
+    if (!saneSpeed(m->targetSpeed) || !saneSpeed(m->currentSpeed) || !saneSpeed(m->rampSpeed)) {
+      fail(std::string(m->name) + " speed out of range: target " + std::to_string(m->targetSpeed) +
+           ", current " + std::to_string(m->currentSpeed) + at);
+    }
+    if (m->boostActive && (!saneSpeed(m->boostSpeed) || !saneSpeed(m->normalSpeed))) {
+      fail(std::string(m->name) + " boost speeds out of range" + at);
+    }
+    if (m->direction != 1 && m->direction != -1) {
+      fail(std::string(m->name) + " direction " + std::to_string(m->direction) + at);
+    }
+  }
+  if (!(accelRate >= MIN_ACCEL_RATE) || !isfinite(accelRate)) {
+    fail("acceleration " + std::to_string(accelRate) + at);
+  }
+  if (!(boostConfig.multiplier > 0 && boostConfig.multiplier <= MAX_BOOST_MULTIPLIER)) {
+    fail("boost multiplier " + std::to_string(boostConfig.multiplier) + at);
+  }
+  if (shaper.impulses < 1 || shaper.impulses > 3) {
+    fail("shaper impulses " + std::to_string(shaper.impulses) + at);
+  } else {
+    for (uint8_t i = 0; i < shaper.impulses; i++) {
+      if (!(shaper.delayTicks[i] >= 0 && shaper.delayTicks[i] <= SHAPER_HISTORY - 2)) {
+        fail("shaper delay " + std::to_string(shaper.delayTicks[i]) + at);
+      }
+    }
+  }
+  if (feedOverride > MAX_FEED_OVERRIDE) {
+    fail("feed override " + std::to_string(feedOverride) + at);
+  }
+  if (pvtCount > PVT_DEPTH) {
+    fail("PVT count " + std::to_string(pvtCount) + at);
+  }
+  for (uint8_t i = 0; i < pvtCount; i++) {
+    const PvtPoint &p = pvtBuffer[(pvtTail + i) % PVT_DEPTH];
+    if (!saneSpeed(fabsf(p.velocity[0])) || !saneSpeed(fabsf(p.velocity[1]))) {
+      fail("PVT velocity out of range" + at);
+    }
+  }
+  if (rxLineLen >= RX_LINE_MAX || rxCount > RX_QUEUE_DEPTH) {
+    fail("receive buffers overran" + at);
+  }
+}
+
+// The receive half of loop(): read, then run every queued line. Returns the
+// text work spent on parsing and dispatch.
+static uint64_t receive(const std::string &bytes, double *ns) {
+  uint64_t work = sim_string_work;
+  auto start = std::chrono::steady_clock::now();
+  sim_write(bytes.data(), bytes.size());
+  readSerial();
+  while (rxCount > 0) {
+    processCommand(rxQueue[rxTail]);
+    rxTail = (rxTail + 1) % RX_QUEUE_DEPTH;
+    rxCount--;
+    sendAck();
+  }
+  *ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  return sim_string_work - work;
+}
+
+static std::string pick(const std::vector<std::string> &pool) {
+  return pool[rng() % pool.size()];
+}
+
+static std::string mutate(std::string s) {
+  int rounds = 1 + rng() % 4;
+  for (int r = 0; r < rounds; r++) {
+    size_t pos = s.empty() ? 0 : rng() % (s.size() + 1);
+    switch (rng() % 7) {
+      case 0:  // Insert a token
+        s.insert(pos, TOKENS[rng() % (sizeof(TOKENS) / sizeof(TOKENS[0]))]);
+        break;
+      case 1:  // Delete a span
+        if (!s.empty()) s.erase(pos < s.size() ? pos : s.size() - 1, 1 + rng() % 8);
+        break;
+      case 2:  // Overwrite a byte with anything
+        if (!s.empty()) s[rng() % s.size()] = (char)(rng() % 256);
+        break;
+      case 3:  // Repeat a span
+        if (!s.empty()) {
+          size_t from = rng() % s.size();
+          std::string span = s.substr(from, 1 + rng() % 8);
+          for (int n = rng() % 8; n >= 0; n--) s.insert(pos, span);
+        }
+        break;
+      case 4:  // Splice another seed
+        s.insert(pos, SEEDS[rng() % (sizeof(SEEDS) / sizeof(SEEDS[0]))]);
+        break;
+      case 5:  // Truncate
+        s.resize(pos);
+        break;
+      default:  // Flip case
+        if (!s.empty()) s[rng() % s.size()] ^= 0x20;
+        break;
+    }
+  }
+  if (s.size() > MAX_INPUT_BYTES) s.resize(MAX_INPUT_BYTES);
+  return s;
+}
+
+// BENCH:RUN pulses the STEP pins for two virtual seconds; it takes no
+// parameters worth fuzzing
+static bool runsBench(const std::string &input) {
+  std::string upper = input;
+  for (char &c : upper) c = toupper((unsigned char)c);
+  return upper.find("BENCH:RUN") != std::string::npos;
+}
+
+static void record(const std::string &input, uint64_t work, double ns) {
+  // Per byte received, including the line ending
+  double bytes = input.size() + 1;
+  CostRecord r = {input, work, work / bytes, ns / bytes};
+  if (r.nsPerByte > worstNs.nsPerByte) worstNs = r;
+  if (r.work > heaviest.work) heaviest = r;
+  if (costliest.size() < TOP_INPUTS || r.workPerByte > costliest.back().workPerByte) {
+    for (const CostRecord &c : costliest) {
+      if (c.input == input) return;
+    }
+    costliest.push_back(r);
+    std::sort(costliest.begin(), costliest.end(),
+              [](const CostRecord &a, const CostRecord &b) { return a.workPerByte > b.workPerByte; });
+    if (costliest.size() > TOP_INPUTS) costliest.pop_back();
+  }
+}
+
+// A line with no newline must not grow the buffer, and once it ends it
+// costs what its truncated first RX_LINE_MAX - 1 bytes cost
+static void checkLongLine() {
+  std::string line = std::string("SPEED:") + std::string(LONG_LINE_BYTES, '9');
+  double ns;
+  currentInput = line.substr(0, RX_LINE_MAX - 1);
+  resetFirmware();
+  uint64_t truncated = receive(currentInput + "\n", &ns);
+
+  currentInput = line;
+  resetFirmware();
+  uint64_t work = receive(line, &ns);
+  if (rxLineLen != RX_LINE_MAX - 1) {
+    fail("line buffer holds " + std::to_string(rxLineLen) + " bytes after an unterminated line");
+  }
+  work += receive("\n", &ns);
+  checkState("long line");
+  if (work > truncated) {
+    fail("unterminated line cost " + std::to_string(work) + ", truncated " + std::to_string(truncated));
+  }
+}
+
+int main(int argc, char **argv) {
+  uint64_t iterations = argc > 1 ? strtoull(argv[1], nullptr, 10) : DEFAULT_ITERATIONS;
+  uint32_t seed = argc > 2 ? strtoul(argv[2], nullptr, 10) : 1;
+  bool trace = argc > 3 && strcmp(argv[3], "trace") == 0;
+  rng.seed(seed);
+  sim_set_costs(SIM_LOOP_COST_US * PS_PER_US, 0);
+  setup();
+  checkLongLine();
+
+  std::vector<std::string> seeds(std::begin(SEEDS), std::end(SEEDS));
+  uint64_t inputs = 0, bytes = 0, skipped = 0;
+  for (uint64_t i = 0; i < iterations && failures.size() < MAX_FAILURES; i++) {
+    if (i % RESET_EVERY == 0) resetFirmware();
+
+    std::string base = i < seeds.size() ? seeds[i] :
+                       !costliest.empty() && rng() % 3 == 0 ? costliest[rng() % costliest.size()].input :
+                       heaviest.work && rng() % 3 == 0 ? heaviest.input :
+                       pick(seeds);
+    currentInput = i < seeds.size() ? base : mutate(base);
+    if (runsBench(currentInput)) {
+      skipped++;
+      continue;
+    }
+
+    if (trace) fprintf(stderr, "INPUT \"%s\"\n", escaped(currentInput).c_str());
+    double ns;
+    uint64_t started = sim_now_ps();
+    uint64_t work = receive(currentInput + (rng() % 4 ? "\n" : "\r\n"), &ns);
+    if (sim_now_ps() - started > MAX_BLOCK_MS * PS_PER_MS) {
+      fail("blocked for " + std::to_string((sim_now_ps() - started) / PS_PER_MS) + " ms");
+    }
+    checkState("parse");
+    sim_advance_ps(SETTLE_MS * PS_PER_MS);
+    checkState("settle");
+    txBytes.clear();
+
+    record(currentInput, work, ns);
+    inputs++;
+    bytes += currentInput.size() + 1;
+  }
+
+  printf("{\n  \"seed\": %u,\n  \"inputs\": %llu,\n  \"bytes\": %llu,\n  \"skipped\": %llu,\n",
+         seed, (unsigned long long)inputs, (unsigned long long)bytes, (unsigned long long)skipped);
+  printf("  \"max_work_per_byte\": %.2f,\n  \"max_ns_per_byte\": %.1f,\n",
+         costliest.empty() ? 0.0 : costliest[0].workPerByte, worstNs.nsPerByte);
+  printf("  \"slowest_input\": \"%s\",\n", escaped(worstNs.input).c_str());
+  printf("  \"max_work\": %llu,\n  \"heaviest_input\": \"%s\",\n  \"costliest\": [",
+         (unsigned long long)heaviest.work, escaped(heaviest.input).c_str());
+  for (size_t i = 0; i < costliest.size(); i++) {
+    const CostRecord &r = costliest[i];
+    printf("%s\n    {\"input\": \"%s\", \"work\": %llu, \"work_per_byte\": %.2f, \"ns_per_byte\": %.1f}",
+           i ? "," : "", escaped(r.input).c_str(), (unsigned long long)r.work, r.workPerByte, r.nsPerByte);
+  }
+  printf("\n  ],\n  \"failures\": [");
+  for (size_t i = 0; i < failures.size(); i++) {
+    printf("%s\n    \"%s\"", i ? "," : "", escaped(failures[i]).c_str());
+  }
+  printf("\n  ]\n}\n");
+  return 0;
+}
@@ -0,0 +1,269 @@
+/*
+ * Host Simulator for the Dual Motor Firmware
+ * Builds the unmodified main.cpp against the Arduino shim and runs it on a
+ * virtual clock, exposing a C ABI for raspberry_pi_control/teensy_sim.py.
+ *
+ * Time model (picoseconds, wraps after ~213 days of virtual time):
+ * - Every loop() pass costs loopCostPs; every byte written to Serial costs
+ *   txByteCostPs; delay()/delayMicroseconds() cost what they say.
+ * - IntervalTimer channels run on the 24 MHz PIT clock like the target and
+ *   fire whenever time moves forward. ISRs do not nest: a timer that comes
+ *   due while another ISR runs fires late, exactly as on the shared PIT IRQ.
+ * - Pin changes are optionally traced with their timestamps.
+ * - Axes pair a STEP pin with its DIR pin and count net steps (DIR low =
+ *   forward) in 64 bits, like an encoder that never wraps.
+ *
+ * Each process image holds one firmware instance; teensy_sim.py loads a
+ * private copy of the shared library per simulator.
+ */
+
+#include "Arduino.h"
+
+#include <deque>
+#include <vector>
+
+#define SIM_TIMER_CHANNELS 4       // PIT channels on the i.MX RT1062
+#define SIM_PIT_HZ 24000000ULL     // IntervalTimer clock
+#define SIM_PINS 64
+#define SIM_AXES 4
+#define PS_PER_US 1000000ULL
+#define PS_PER_MS 1000000000ULL
+
+struct SimTimer {
+  bool active;
+  void (*isr)();
+  uint64_t periodPs;
+  uint64_t nextFirePs;
+};
+
+struct SimAxis {
+  bool active;
+  uint8_t stepPin;
+  uint8_t dirPin;
+  int64_t steps;
+};
+
+struct SimTraceEvent {
+  uint64_t timePs;
+  uint8_t pin;
+  uint8_t level;
+};
+
+static uint64_t nowPs = 0;
+static uint64_t loopCostPs = 2 * PS_PER_US;
+static uint64_t txByteCostPs = 0;
+static bool inIsr = false;
+static SimTimer timers[SIM_TIMER_CHANNELS];
+static uint8_t pinLevel[SIM_PINS];
+static uint64_t risingEdges[SIM_PINS];
+static SimAxis axes[SIM_AXES];
+static bool tracing = false;
+static std::vector<SimTraceEvent> trace;
+static std::deque<uint8_t> rxBytes;
+static std::string txBytes;
+
+volatile uint32_t ARM_DEMCR = 0;
+volatile uint32_t ARM_DWT_CTRL = 0;
+volatile uint32_t F_CPU_ACTUAL = 600000000;
+usb_serial_class Serial;
+#ifdef SIM_COUNT_STRING_WORK
+uint64_t sim_string_work = 0;
+#endif
+
+// Fire every timer that is due at or before untilPs, earliest first
+static void runDueTimers(uint64_t untilPs) {
+  while (true) {
+    SimTimer *next = nullptr;
+    for (SimTimer &t : timers) {
+      if (t.active && t.nextFirePs <= untilPs && (!next || t.nextFirePs < next->nextFirePs)) {
+        next = &t;
+      }
+    }
+    if (!next) return;
+
+    if (next->nextFirePs > nowPs) nowPs = next->nextFirePs;
+    next->nextFirePs += next->periodPs;  // PIT reloads on its own schedule
+    inIsr = true;
+    next->isr();
+    inIsr = false;
+  }
+}
+
+static void advance(uint64_t ps) {
+  uint64_t target = nowPs + ps;
+  if (!inIsr) runDueTimers(target);
+  if (target > nowPs) nowPs = target;
+}
+
+// Timing
+
+uint32_t millis() { return (uint32_t)(nowPs / PS_PER_MS); }
+uint32_t micros() { return (uint32_t)(nowPs / PS_PER_US); }
+void delay(uint32_t msec) { advance(msec * PS_PER_MS); }
+void delayMicroseconds(uint32_t usec) { advance(usec * PS_PER_US); }
+uint32_t sim_cycle_count() { return (uint32_t)(nowPs / (1000000000000ULL / 600000000ULL)); }
+
+// Digital I/O
+
+void pinMode(uint8_t, uint8_t) {}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+  if (pin >= SIM_PINS) return;
+  uint8_t level = val ? HIGH : LOW;
+  if (level == pinLevel[pin]) return;
+  pinLevel[pin] = level;
+  if (level == HIGH) {
+    risingEdges[pin]++;
+    for (SimAxis &a : axes) {
+      if (a.active && a.stepPin == pin) a.steps += pinLevel[a.dirPin] == LOW ? 1 : -1;
+    }
+  }
+  if (tracing) trace.push_back({nowPs, pin, level});
+}
+
+uint8_t digitalRead(uint8_t pin) { return pin < SIM_PINS ? pinLevel[pin] : LOW; }
+void digitalWriteFast(uint8_t pin, uint8_t val) { digitalWrite(pin, val); }
+void digitalToggleFast(uint8_t pin) { digitalWrite(pin, !digitalRead(pin)); }
+
+void noInterrupts() {}
+void interrupts() {}
+
+// USB serial
+
+int usb_serial_class::available() { return (int)rxBytes.size(); }
+
+int usb_serial_class::read() {
+  if (rxBytes.empty()) return -1;
+  uint8_t b = rxBytes.front();
+  rxBytes.pop_front();
+  return b;
+}
+
+int usb_serial_class::peek() { return rxBytes.empty() ? -1 : rxBytes.front(); }
+int usb_serial_class::availableForWrite() { return 4096; }
+
+size_t usb_serial_class::write(uint8_t b) {
+  txBytes.push_back((char)b);
+  if (txByteCostPs) advance(txByteCostPs);
+  return 1;
+}
+
+size_t usb_serial_class::write(const uint8_t *buffer, size_t size) {
+  txBytes.append((const char *)buffer, size);
+  if (txByteCostPs) advance(txByteCostPs * size);
+  return size;
+}
+
+// IntervalTimer (PIT periods are whole 24 MHz cycles, as on the target)
+
+bool IntervalTimer::begin(void (*funct)(), float microseconds) {
+  if (microseconds <= 0 || microseconds > 178956970.0f) return false;
+  if (channel < 0) {
+    for (int i = 0; i < SIM_TIMER_CHANNELS; i++) {
+      if (!timers[i].active) {
+        channel = i;
+        break;
+      }
+    }
+    if (channel < 0) return false;
+  }
+  uint64_t cycles = (uint64_t)((float)(SIM_PIT_HZ / 1000000) * microseconds - 0.5f) + 1;
+  SimTimer &t = timers[channel];
+  t.active = true;
+  t.isr = funct;
+  t.periodPs = cycles * (1000000000000ULL / SIM_PIT_HZ) + (cycles * (1000000000000ULL % SIM_PIT_HZ)) / SIM_PIT_HZ;
+  t.nextFirePs = nowPs + t.periodPs;
+  return true;
+}
+
+void IntervalTimer::update(float microseconds) {
+  if (channel < 0 || !timers[channel].active) return;
+  uint64_t cycles = (uint64_t)((float)(SIM_PIT_HZ / 1000000) * microseconds - 0.5f) + 1;
+  timers[channel].periodPs = cycles * (1000000000000ULL / SIM_PIT_HZ) + (cycles * (1000000000000ULL % SIM_PIT_HZ)) / SIM_PIT_HZ;
+}
+
+void IntervalTimer::end() {
+  if (channel < 0) return;
+  timers[channel].active = false;
+  channel = -1;
+}
+
+// The firmware itself (SIM_FIRMWARE builds another copy, e.g. an older
+// main.cpp for A/B comparisons)
+#ifdef SIM_FIRMWARE
+#include SIM_FIRMWARE
+#else
+#include "../main.cpp"
+#endif
+
+// C ABI
+
+extern "C" {
+
+void sim_set_costs(uint64_t loop_ps, uint64_t tx_byte_ps) {
+  loopCostPs = loop_ps;
+  txByteCostPs = tx_byte_ps;
+}
+
+void sim_set_time_ps(uint64_t ps) { nowPs = ps; }
+uint64_t sim_now_ps() { return nowPs; }
+
+void sim_setup() { setup(); }
+
+// Run loop() until virtual time has moved forward by ps
+void sim_advance_ps(uint64_t ps) {
+  uint64_t end = nowPs + ps;
+  while (nowPs < end) {
+    loop();
+    advance(loopCostPs);
+  }
+}
+
+void sim_write(const char *data, size_t size) { rxBytes.insert(rxBytes.end(), data, data + size); }
+
+// Drain up to max_size bytes of firmware output into buffer
+size_t sim_read(char *buffer, size_t max_size) {
+  size_t n = txBytes.size() < max_size ? txBytes.size() : max_size;
+  memcpy(buffer, txBytes.data(), n);
+  txBytes.erase(0, n);
+  return n;
+}
+
+size_t sim_output_pending() { return txBytes.size(); }
+size_t sim_input_pending() { return rxBytes.size(); }
+
+uint64_t sim_rising_edges(uint8_t pin) { return pin < SIM_PINS ? risingEdges[pin] : 0; }
+uint8_t sim_pin_level(uint8_t pin) { return digitalRead(pin); }
+
+void sim_axis_track(uint8_t axis, uint8_t step_pin, uint8_t dir_pin) {
+  if (axis >= SIM_AXES || step_pin >= SIM_PINS || dir_pin >= SIM_PINS) return;
+  axes[axis] = {true, step_pin, dir_pin, 0};
+}
+
+int64_t sim_axis_steps(uint8_t axis) { return axis < SIM_AXES ? axes[axis].steps : 0; }
+
+// Start both motors (and their axis counts) at the given positions, e.g.
+// just short of the 32-bit wrap; call while stopped
+void sim_set_positions(int32_t pos1, int32_t pos2) {
+  motor1.position = pos1;
+  motor2.position = pos2;
+  axes[0].steps = pos1;
+  axes[1].steps = pos2;
+}
+
+void sim_trace_enable(int enable) { tracing = enable != 0; }
+size_t sim_trace_count() { return trace.size(); }
+
+// Drain up to max_events trace events into the three arrays
+size_t sim_trace_read(uint64_t *time_ps, uint8_t *pin, uint8_t *level, size_t max_events) {
+  size_t n = trace.size() < max_events ? trace.size() : max_events;
+  for (size_t i = 0; i < n; i++) {
+    time_ps[i] = trace[i].timePs;
+    pin[i] = trace[i].pin;
+    level[i] = trace[i].level;
+  }
+  trace.erase(trace.begin(), trace.begin() + n);
+  return n;
+}
+
+}  // extern "C"
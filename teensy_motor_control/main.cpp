@@ -18,6 +18,9 @@
 
 #include <Arduino.h>
 
+// Strings allocate on every copy and concatenation (see Memory below)
+#pragma GCC poison String
+
 // Motor 1 Pin Definitions (Left/Port)
 #define M1_PWM_PIN 2
 #define M1_DIR_PIN 3
@@ -32,10 +35,15 @@
 #define MAX_SPEED 20000       // Maximum steps/second with 8x microstepping (2500 RPM)
 #define MIN_SPEED 100         // Minimum steps/second
 #define ACCEL_RATE 8000       // Steps/second^2 acceleration (scaled for 8x microstepping)
+#define MIN_ACCEL_RATE 1000   // Slowest CONFIG:ACCEL accepts (STOP from MAX_SPEED blocks 20 s per motor)
 
 // Boost Parameters
 #define BOOST_MULTIPLIER 1.5  // 50% speed boost
 #define BOOST_DURATION 800    // Boost duration in milliseconds (longer for 8x microstepping acceleration)
+#define MAX_BOOST_MULTIPLIER 4.0  // Largest CONFIG:BOOST accepts
+
+// Status LED
+#define STARTUP_BLINK_MS 600  // Fast blink after power-up (100 ms), then 1 s heartbeat
 
 // Sync Parameters
 #define SYNC_CHECK_INTERVAL 1000  // Check sync every 1 second
@@ -43,6 +51,11 @@
 
 // Serial Communication
 #define SERIAL_BAUD 115200
+#define PROTOCOL_VERSION 1    // Bumped when HELLO/ACK/telemetry formats change
+#define FIRMWARE_VERSION "1.1"
+#define CAPABILITIES "ACK,TEL,PERF,ACCEL,BOOST,SHAPE,PVT,FEED,BENCH,MEM,LINK"
+#define RX_QUEUE_DEPTH 8      // Command lines buffered ahead of processCommand
+#define RX_LINE_MAX 64        // Longest accepted command line (longer lines are truncated)
 
 // Boost Configuration
 struct BoostConfig {
@@ -53,11 +66,37 @@ struct BoostConfig {
 
 BoostConfig boostConfig = {BOOST_MULTIPLIER, BOOST_DURATION, true};
 
+// Input Shaping
+// Optional ZV/ZVD shaper on each motor's ramp output: the speed sent to the
+// step timer is a weighted sum of past ramp speeds, timed so the sway each
+// speed change excites at the configured frequency cancels itself out. The
+// weights are positive and sum to 1, so the shaped speed never accelerates
+// faster than accelRate.
+#define SHAPER_OFF 0
+#define SHAPER_ZV 1            // 2 impulses, delay of half a sway period
+#define SHAPER_ZVD 2           // 3 impulses, delay of one period, tolerates frequency error
+#define SHAPER_HISTORY 256     // Control ticks of ramp history (limits the lowest frequency)
+
+struct ShaperConfig {
+  uint8_t type;
+  float frequency;       // Natural frequency to cancel (Hz)
+  float damping;         // Damping ratio of that mode (0 to <1)
+  uint8_t impulses;
+  float amplitude[3];
+  float delayTicks[3];   // Impulse times in control ticks
+};
+
+ShaperConfig shaper = {SHAPER_OFF, 0, 0, 1, {1, 0, 0}, {0, 0, 0}};
+
 // Motor Structure
+// Positions are 32-bit on the target and wrap after 2^31 steps (about 30
+// hours at MAX_SPEED); the ISRs wrap them explicitly and every difference
+// goes through positionDiff(), so drift and PVT errors stay right across
+// the wrap. Timestamps are uint32_t millis()/micros() for the same reason.
 struct Motor {
   uint8_t pwmPin;
   uint8_t dirPin;
-  volatile long position;
+  volatile int32_t position;
   volatile float currentSpeed;
   volatile float targetSpeed;
   volatile bool isRunning;
@@ -66,32 +105,293 @@ struct Motor {
   const char* name;
   // Boost parameters
   bool boostActive;
-  unsigned long boostStartTime;
+  uint32_t boostStartTime;
   float boostSpeed;
   float normalSpeed;
+  // Input shaping (currentSpeed is the shaped rampSpeed)
+  float rampSpeed;
+  float shaperHistory[SHAPER_HISTORY];
+  uint8_t shaperHead;
 };
 
 // Create two motor instances
-Motor motor1 = {M1_PWM_PIN, M1_DIR_PIN, 0, 0, 0, false, 1, IntervalTimer(), "Motor1", false, 0, 0, 0};
-Motor motor2 = {M2_PWM_PIN, M2_DIR_PIN, 0, 0, 0, false, 1, IntervalTimer(), "Motor2", false, 0, 0, 0};
+Motor motor1 = {M1_PWM_PIN, M1_DIR_PIN, 0, 0, 0, false, 1, IntervalTimer(), "Motor1", false, 0, 0, 0, 0, {0}, 0};
+Motor motor2 = {M2_PWM_PIN, M2_DIR_PIN, 0, 0, 0, false, 1, IntervalTimer(), "Motor2", false, 0, 0, 0, 0, {0}, 0};
 
 // Acceleration/Deceleration
-unsigned long lastAccelUpdate = 0;
-const unsigned long accelUpdateInterval = 10; // Update speed every 10ms
+float accelRate = ACCEL_RATE;  // Steps/second^2, adjustable with CONFIG:ACCEL
+uint32_t lastAccelUpdate = 0;
+const uint32_t accelUpdateInterval = 10; // Update speed every 10ms
+
+// Feed Override
+// Scales every motion without the host resending it: speed targets go
+// through the ramp at feedOverride percent, PVT moves run their clock at
+// that rate. PAUSE brings the scale to 0 along the same ramp/path and
+// RESUME brings it back, so the move carries on where it stopped.
+#define MAX_FEED_OVERRIDE 200
+uint8_t feedOverride = 100;      // Percent, set with OVERRIDE
+bool paused = false;
+
+// PVT (Position-Velocity-Time) Buffer
+// Timed waypoints from the host's planner, joined by cubic Hermite segments.
+// Every control tick each motor gets the step rate that puts it on the curve
+// at the next tick, measured from its actual step count, so errors never add
+// up. The tick before each waypoint instead times the steps left to it, so
+// the waypoint is hit to the step on time. The host refills while a move runs;
+// if the buffer runs dry at non-zero velocity the motors ramp to a stop.
+#define PVT_DEPTH 32
+#define PVT_MIN_SEGMENT_MS 10    // One control tick at 100% feed
+#define PVT_AIM_TICKS 1.5        // Aim at a waypoint this close (control ticks)
+#define PVT_AIM_MARGIN 0.25      // Last step before a waypoint leads it by this share of a period
+#define PVT_IDLE 0
+#define PVT_RUN 1
+#define PVT_DONE 2               // Reached a zero-velocity final point
+#define PVT_UNDERFLOW 3          // Ran out of points while moving
+#define PVT_ABORTED 4            // Another motion command took over
+
+struct PvtPoint {
+  uint16_t durationMs;   // From the previous point
+  int32_t position[2];   // Absolute, steps
+  float velocity[2];     // Signed, steps/sec
+};
+
+PvtPoint pvtBuffer[PVT_DEPTH];
+uint8_t pvtTail = 0;           // Point the current segment ends at
+uint8_t pvtCount = 0;
+PvtPoint pvtFrom;              // Point the current segment starts from
+uint32_t pvtClockUs = 0;       // Plan time, advances at the feed rate
+uint32_t pvtLastTickUs = 0;
+float pvtFeed = 1.0;           // Feed scale in effect, slews toward feedScale()
+uint32_t pvtSegmentStartUs = 0;
+uint8_t pvtState = PVT_IDLE;
+uint32_t pvtPointsDone = 0;
+bool pvtAiming = false;        // Step timers are set to land on the next waypoint
+uint32_t pvtAimEndUs = 0;      // micros() it is due at
 
 // Sync Tracking
-unsigned long lastSyncCheck = 0;
+uint32_t lastSyncCheck = 0;
+
+// Command Queue
+// Free slots are advertised to the host as credits in every ACK and telemetry
+// frame, so the host never sends more lines than the queue can hold.
+char rxLine[RX_LINE_MAX];
+uint8_t rxLineLen = 0;
+bool rxLineCut = false;         // Current line ran past RX_LINE_MAX
+char rxQueue[RX_QUEUE_DEPTH][RX_LINE_MAX];
+uint8_t rxHead = 0;
+uint8_t rxTail = 0;
+uint8_t rxCount = 0;
+uint16_t rxLinesReceived = 0;  // Wrapping count of complete lines, lets the host account for lines in flight
+// An ESTOP is spotted as it is received: the lines queued ahead of it are
+// dropped (each still ACKed, in order) and a blocking STOP or direction
+// change in progress gives up, so it runs next. The host keeps a credit
+// back for it, so it always finds a free slot.
+bool estopRequested = false;
+
+// Command Text
+// processCommand parses slices of a trimmed, upper-case copy of its line on
+// the stack instead of Arduino Strings, so no command touches the heap. The
+// methods follow String's (substring clamps out-of-range and reversed
+// bounds the same way), so the parser reads as it did.
+#ifndef STRING_WORK
+#define STRING_WORK(bytes) ((void)0)  // The host fuzzer counts parse work (host/Arduino.h)
+#endif
+
+struct CmdText {
+  const char *ptr = "";
+  uint8_t len = 0;
+
+  bool operator==(const char *s) const {
+    uint8_t n = 0;
+    while (n < len && s[n] == ptr[n]) n++;
+    STRING_WORK(n + 1);
+    return n == len && s[n] == '\0';
+  }
+  bool operator!=(const char *s) const { return !(*this == s); }
+  bool startsWith(const char *prefix) const {
+    size_t n = strlen(prefix);
+    STRING_WORK(n);
+    return n <= len && memcmp(ptr, prefix, n) == 0;
+  }
+  int indexOf(char c, unsigned int from = 0) const {
+    for (unsigned int i = from; i < len; i++) {
+      if (ptr[i] == c) {
+        STRING_WORK(i + 1 - from);
+        return i;
+      }
+    }
+    STRING_WORK(from < len ? len - from : 1);
+    return -1;
+  }
+  CmdText substring(unsigned int left) const { return substring(left, len); }
+  CmdText substring(unsigned int left, unsigned int right) const {
+    if (left > right) {
+      unsigned int temp = right;
+      right = left;
+      left = temp;
+    }
+    CmdText slice;
+    if (left < len) {
+      slice.ptr = ptr + left;
+      slice.len = (right > len ? len : right) - left;
+    }
+    return slice;
+  }
+  // NUL-terminated copy for the C parsers; out holds at least RX_LINE_MAX
+  const char *copyTo(char *out) const {
+    STRING_WORK(len);
+    memcpy(out, ptr, len);
+    out[len] = '\0';
+    return out;
+  }
+  long toInt() const {
+    char buf[RX_LINE_MAX];
+    return atol(copyTo(buf));
+  }
+  float toFloat() const;
+};
+
+// Command Opcodes
+// Each line's verb is looked up once in verbs[] (canonical name first, then
+// its aliases, most frequent verbs first); dispatch and the per-opcode
+// counters work on the number.
+enum Opcode : uint8_t {
+  OP_UNKNOWN, OP_SPEED, OP_FORWARD, OP_BACKWARD, OP_STOP, OP_ESTOP, OP_RUN, OP_STATUS,
+  OP_RESET, OP_SPIN, OP_BOOST, OP_SYNC, OP_TELEMETRY, OP_PERF, OP_BENCH, OP_OVERRIDE,
+  OP_PAUSE, OP_RESUME, OP_PVT, OP_MEM, OP_LINK, OP_HELLO, OP_CONFIG, OP_COUNT
+};
+
+struct Verb {
+  const char *name;
+  uint8_t op;
+};
+
+const Verb verbs[] = {
+  {"SPEED", OP_SPEED}, {"S", OP_SPEED}, {"FORWARD", OP_FORWARD}, {"FWD", OP_FORWARD},
+  {"F", OP_FORWARD}, {"BACKWARD", OP_BACKWARD}, {"BACK", OP_BACKWARD}, {"B", OP_BACKWARD},
+  {"RUN", OP_RUN}, {"R", OP_RUN}, {"STOP", OP_STOP}, {"X", OP_STOP}, {"SPIN", OP_SPIN},
+  {"PVT", OP_PVT}, {"OVERRIDE", OP_OVERRIDE}, {"OV", OP_OVERRIDE}, {"STATUS", OP_STATUS},
+  {"?", OP_STATUS}, {"ESTOP", OP_ESTOP}, {"E", OP_ESTOP}, {"PAUSE", OP_PAUSE}, {"P", OP_PAUSE},
+  {"RESUME", OP_RESUME}, {"BOOST", OP_BOOST}, {"RESET", OP_RESET}, {"RST", OP_RESET},
+  {"SYNC", OP_SYNC}, {"TELEMETRY", OP_TELEMETRY}, {"TEL", OP_TELEMETRY}, {"HELLO", OP_HELLO},
+  {"CONFIG", OP_CONFIG}, {"PERF", OP_PERF}, {"MEM", OP_MEM}, {"LINK", OP_LINK},
+  {"BENCH", OP_BENCH},
+};
+
+// Verbs that take over from a PVT move
+const uint32_t MOTION_OPS = 1UL << OP_SPEED | 1UL << OP_FORWARD | 1UL << OP_BACKWARD |
+                            1UL << OP_STOP | 1UL << OP_ESTOP | 1UL << OP_RUN | 1UL << OP_RESET |
+                            1UL << OP_SPIN | 1UL << OP_BOOST | 1UL << OP_SYNC;
+
+// USB Link Health (LINK, and the tail of every telemetry frame)
+// All USB serial I/O goes through Link, which counts it. Counters run from
+// boot and the host diffs them, so a laggy session can be pinned on lost
+// input (lines dropped with the queue full or cut at RX_LINE_MAX), a host
+// that reads slowly (writes stall once the USB buffers are full) or input
+// arriving in bursts (RX backlog).
+#define TX_STALL_US 100   // A write that took this long was waiting on the host
+
+struct LinkStats {
+  uint32_t rxBytes;
+  uint32_t txBytes;
+  uint32_t lines;          // Complete lines received
+  uint32_t parseErrors;    // Known command, malformed arguments
+  uint32_t unknown;        // Unknown commands
+  uint32_t rxTruncated;    // Lines cut at RX_LINE_MAX or fragments dropped by HELLO
+  uint32_t rxDropped;      // Lines dropped with the queue full
+  uint32_t rxBacklogMax;   // Most bytes seen waiting in the USB receive buffer
+  uint32_t txWrites;
+  uint32_t txStalls;       // Writes that took TX_STALL_US or more
+  uint32_t txBlockedUs;    // Time spent in those
+  uint32_t opcodes[OP_COUNT];
+};
+
+LinkStats linkStats = {};
+
+class LinkSerial : public Print {
+public:
+  void begin(uint32_t baud) { Serial.begin(baud); }
+  int available();
+  int read();
+  size_t write(uint8_t b) override { return write(&b, 1); }
+  size_t write(const uint8_t *buffer, size_t size) override;
+  using Print::write;
+};
+
+LinkSerial Link;
+
+// Performance Counters (reported by PERF)
+// Power-of-two histograms: loop bucket i counts periods < 2^i us,
+// ISR bucket i counts durations < 2^(i + ISR_HIST_SHIFT) CPU cycles.
+// The last bucket of each also collects everything larger.
+#define PERF_BUCKETS 12
+#define ISR_HIST_SHIFT 6
+uint32_t loopHist[PERF_BUCKETS];
+uint32_t loopCount = 0;
+uint64_t loopTotalUs = 0;
+uint32_t lastLoopMicros = 0;
+volatile uint32_t isrHist[PERF_BUCKETS];
+volatile uint32_t isrCount = 0;
+volatile uint64_t isrTotalCycles = 0;
 
-// Command Buffer
-String inputBuffer = "";
-bool commandReady = false;
+// Self-Benchmark (BENCH:RUN)
+// Steps both motors through a sweep of rates with the real step ISRs and
+// measures ISR cost, loop latency and pulse timing at each. There is no
+// driver enable line, so the drivers must be powered down or unplugged.
+// A rate is sustainable if every pulse arrives, no period is off by more
+// than BENCH_MAX_JITTER_PCT and the ISRs leave loop() enough CPU.
+#define BENCH_WINDOW_MS 200
+#define BENCH_MAX_CPU_PCT 80
+#define BENCH_MAX_JITTER_PCT 25
+const uint32_t benchRates[] = {1000, 2000, 5000, 10000, 20000, 40000, 60000, 80000, 100000};
+volatile bool benchActive = false;
+volatile uint32_t benchPulses[2];
+volatile uint32_t benchLastPulse[2];
+volatile uint32_t benchJitterMax = 0;   // CPU cycles
+volatile uint32_t benchIsrMax = 0;      // CPU cycles
+volatile uint64_t benchIsrCycles = 0;
+uint32_t benchPeriodCycles = 0;
+
+// Telemetry
+uint32_t telemetryInterval = 0;  // Milliseconds between telemetry frames (0 = off)
+uint32_t lastTelemetry = 0;
+
+// Response Buffer
+// Multi-field responses are built here with integer formatting and sent with
+// a single Link.write, instead of one Link.print (and float conversion)
+// per field. Text that does not fit is cut off, never overflowed.
+#define RESP_BUFFER_SIZE 640
+char respBuf[RESP_BUFFER_SIZE];
+uint16_t respLen = 0;
+
+// Memory
+// Nothing allocates once setup() has run: a String or a library buffer
+// created mid-session fragments the heap until a long run locks up. On the
+// Teensy the malloc family below is linked instead of newlib's (the core's
+// operator new calls malloc, so it is covered too). At run time, until
+// setup() finishes it hands out a small static pool that is never freed;
+// after that any allocation stops the motors and halts with a fast-blinking
+// LED. The build is checked as well: ram_report.py fails if main.cpp
+// references the heap, and with --elf if anything in the linked image (core
+// and libraries included) calls the malloc family or operator new, or if
+// newlib's allocator ended up in it next to this one.
+// The stack (top of DTCM, down to the last static variable) is painted at
+// boot and MEM reports how deep it has ever reached.
+#define BOOT_HEAP_SIZE 1024
+#define STACK_PAINT 0xC5C5C5C5
+#define STACK_PAINT_MARGIN 256   // Bytes below stackPaint()'s frame left unpainted
+bool setupDone = false;
+uint16_t bootHeapUsed = 0;
+#if defined(__IMXRT1062__)
+extern unsigned long _sdata, _ebss, _estack;  // Teensy 4 linker script: DTCM layout
+#endif
 
 // Function Prototypes
 void stepISR_M1();
 void stepISR_M2();
 void updateSpeed(Motor &m);
 void updateTimers();
-void processCommand(String cmd);
+void processCommand(const char *line);
 void setSpeed(Motor &m, float speed);
 void setDirection(Motor &m, int dir);
 void stopMotor(Motor &m);
@@ -99,8 +399,50 @@ void emergencyStop();
 void printStatus();
 void applyBoost(Motor &m, float targetSpeed);
 void checkSync();
+void readSerial();
+bool isEstopLine(const char *line);
+uint8_t rxCredits();
+void sendAck();
+void sendTelemetry();
+void recordLoopTime();
+void recordIsrTime(uint32_t cycles);
+void printPerf();
+void runBench();
+void benchPulse(uint8_t axis, uint32_t cycles);
+void printHello(const CmdText &nonce);
+void printStatusCompact();
+bool configureShaper(uint8_t type, float frequency, float damping);
+float shapeSpeed(Motor &m, float speed);
+void resetShaper(Motor &m, float speed = 0);
+uint8_t lookupVerb(const CmdText &command);
+void printLink();
+bool pvtAppend(const CmdText &params);
+void pvtStart();
+void updatePvt();
+int32_t pvtTarget(uint8_t axis, uint32_t t);
+float pvtVelocity(uint8_t axis, uint32_t t);
+float feedScale();
+void pvtHandOver(uint8_t state);
+void setStepRate(Motor &m, void (*isr)(), float rate, bool restart = false);
+void printPvt();
+void respChar(char c);
+void respStr(const char *s);
+void respText(const CmdText &text);
+void respUInt(uint64_t value);
+void respInt(int32_t value);
+void respFixed(float value, uint8_t decimals);
+void respLine(const char *s);
+void respSend();
+int32_t positionDiff(int32_t a, int32_t b);
+int32_t positionOffset(int32_t position, int32_t steps);
+float parseFloat(const char *s, const char **end);
+void printMem();
+void stackPaint();
+uint32_t stackUsed();
 
 void setup() {
+  stackPaint();
+  
   // Initialize Motor 1 pins
   pinMode(M1_PWM_PIN, OUTPUT);
   pinMode(M1_DIR_PIN, OUTPUT);
@@ -117,55 +459,57 @@ void setup() {
   pinMode(LED_BUILTIN, OUTPUT);
   
   // Initialize Serial Communication
-  Serial.begin(SERIAL_BAUD);
-  while (!Serial && millis() < 3000); // Wait up to 3 seconds for USB serial
+  // No waiting for the host: commands are accepted as soon as loop() runs
+  // and the host finds out we are ready with HELLO
+  Link.begin(SERIAL_BAUD);
   
-  Serial.println("==========================================");
-  Serial.println("Teensy 4.1 Dual Motor Controller");
-  Serial.println("Single board controlling 2 motors");
-  Serial.println("Ready for commands");
-  Serial.println("==========================================");
+  Link.println("==========================================");
+  Link.println("Teensy 4.1 Dual Motor Controller");
+  Link.println("Single board controlling 2 motors");
+  Link.println("Ready for commands");
+  Link.println("==========================================");
   
-  // Reserve buffer space
-  inputBuffer.reserve(128);
+  // Cycle counter for ISR timing
+  ARM_DEMCR |= ARM_DEMCR_TRCENA;
+  ARM_DWT_CTRL |= ARM_DWT_CTRL_CYCCNTENA;
   
-  // Blink LED to indicate ready
-  for (int i = 0; i < 3; i++) {
-    digitalWrite(LED_BUILTIN, HIGH);
-    delay(100);
-    digitalWrite(LED_BUILTIN, LOW);
-    delay(100);
-  }
+  setupDone = true;  // From here on any heap allocation halts
 }
 
 void loop() {
-  // Read Serial Commands
-  while (Serial.available()) {
-    char inChar = (char)Serial.read();
-    
-    if (inChar == '\n' || inChar == '\r') {
-      if (inputBuffer.length() > 0) {
-        commandReady = true;
-      }
-    } else {
-      inputBuffer += inChar;
-    }
-  }
+  recordLoopTime();
   
-  // Process Command
-  if (commandReady) {
-    processCommand(inputBuffer);
-    inputBuffer = "";
-    commandReady = false;
+  // Read Serial Commands into the queue
+  readSerial();
+  
+  // Process one queued command per pass so the speed update is never starved
+  if (rxCount > 0) {
+    while (estopRequested && !isEstopLine(rxQueue[rxTail])) {
+      Link.print("ESTOP - dropped: ");
+      Link.println(rxQueue[rxTail]);
+      rxTail = (rxTail + 1) % RX_QUEUE_DEPTH;
+      rxCount--;
+      sendAck();
+    }
+    estopRequested = false;
+    processCommand(rxQueue[rxTail]);
+    rxTail = (rxTail + 1) % RX_QUEUE_DEPTH;
+    rxCount--;
+    sendAck();
   }
   
   // Update Speed (Acceleration/Deceleration)
   if (millis() - lastAccelUpdate >= accelUpdateInterval) {
-    // Calculate both motor speeds first
-    updateSpeed(motor1);
-    updateSpeed(motor2);
-    // Then update timers simultaneously
-    updateTimers();
+    if (pvtState == PVT_RUN) {
+      // Waypoint mode: the PVT curve sets both step rates
+      updatePvt();
+    } else {
+      // Calculate both motor speeds first
+      updateSpeed(motor1);
+      updateSpeed(motor2);
+      // Then update timers simultaneously
+      updateTimers();
+    }
     lastAccelUpdate = millis();
   }
   
@@ -175,9 +519,16 @@ void loop() {
     lastSyncCheck = millis();
   }
   
-  // Status LED heartbeat
-  static unsigned long lastBlink = 0;
-  if (millis() - lastBlink > 1000) {
+  // Periodic telemetry frame
+  if (telemetryInterval > 0 && millis() - lastTelemetry >= telemetryInterval) {
+    sendTelemetry();
+    lastTelemetry = millis();
+  }
+  
+  // Status LED heartbeat (fast blinks right after power-up show we are ready)
+  static uint32_t lastBlink = 0;
+  uint32_t blinkPeriod = millis() < STARTUP_BLINK_MS ? 100 : 1000;
+  if (millis() - lastBlink > blinkPeriod) {
     digitalWrite(LED_BUILTIN, !digitalRead(LED_BUILTIN));
     lastBlink = millis();
   }
@@ -185,24 +536,33 @@ void loop() {
 
 // Motor 1 Step ISR
 void stepISR_M1() {
+  uint32_t start = ARM_DWT_CYCCNT;
+  if (benchActive) benchPulse(0, start);
   digitalWrite(M1_PWM_PIN, HIGH);
   delayMicroseconds(5);
   digitalWrite(M1_PWM_PIN, LOW);
-  motor1.position += motor1.direction;
+  motor1.position = positionOffset(motor1.position, motor1.direction);
+  recordIsrTime(ARM_DWT_CYCCNT - start);
 }
 
 // Motor 2 Step ISR
 void stepISR_M2() {
+  uint32_t start = ARM_DWT_CYCCNT;
+  if (benchActive) benchPulse(1, start);
   digitalWrite(M2_PWM_PIN, HIGH);
   delayMicroseconds(5);
   digitalWrite(M2_PWM_PIN, LOW);
-  motor2.position += motor2.direction;
+  motor2.position = positionOffset(motor2.position, motor2.direction);
+  recordIsrTime(ARM_DWT_CYCCNT - start);
 }
 
 void updateSpeed(Motor &m) {
   if (!m.isRunning) {
     m.timer.end();
     m.currentSpeed = 0;
+    if (m.rampSpeed != 0) {
+      resetShaper(m);  // Stopped outright (SPEED:0) - nothing left to shape
+    }
     return;
   }
   
@@ -210,26 +570,325 @@ void updateSpeed(Motor &m) {
   if (m.boostActive && (millis() - m.boostStartTime >= boostConfig.duration)) {
     m.boostActive = false;
     m.targetSpeed = m.normalSpeed;  // Return to normal speed
-    Serial.print(m.name);
-    Serial.println(" boost complete - returning to normal speed");
+    Link.print(m.name);
+    Link.println(" boost complete - returning to normal speed");
   }
   
-  float speedDiff = m.targetSpeed - m.currentSpeed;
-  float accelStep = (ACCEL_RATE * accelUpdateInterval) / 1000.0;
+  float target = constrain(m.targetSpeed * feedScale(), 0, MAX_SPEED);
+  float speedDiff = target - m.rampSpeed;
+  float accelStep = (accelRate * accelUpdateInterval) / 1000.0;
   
   // Smooth acceleration/deceleration
   if (abs(speedDiff) > accelStep) {
     if (speedDiff > 0) {
-      m.currentSpeed += accelStep;
+      m.rampSpeed += accelStep;
     } else {
-      m.currentSpeed -= accelStep;
+      m.rampSpeed -= accelStep;
     }
   } else {
-    m.currentSpeed = m.targetSpeed;
+    m.rampSpeed = target;
   }
   
   // Constrain speed
-  m.currentSpeed = constrain(m.currentSpeed, 0, MAX_SPEED);
+  m.rampSpeed = constrain(m.rampSpeed, 0, MAX_SPEED);
+  m.currentSpeed = shapeSpeed(m, m.rampSpeed);
+}
+
+bool configureShaper(uint8_t type, float frequency, float damping) {
+  if (type == SHAPER_OFF) {
+    shaper = {SHAPER_OFF, 0, 0, 1, {1, 0, 0}, {0, 0, 0}};
+    return true;
+  }
+  if (!(frequency > 0) || !(damping >= 0 && damping < 1)) {
+    return false;  // Also rejects NaN
+  }
+  
+  // Impulses sit half a damped period apart; K scales each one so the
+  // decaying oscillations they start cancel
+  float root = sqrt(1 - damping * damping);
+  float k = exp(-damping * PI / root);
+  float halfPeriodTicks = 1000.0 / (2 * frequency * root * accelUpdateInterval);
+  
+  ShaperConfig next = {type, frequency, damping, 0, {0, 0, 0}, {0, 0, 0}};
+  if (type == SHAPER_ZV) {
+    next.impulses = 2;
+    next.amplitude[0] = 1 / (1 + k);
+    next.amplitude[1] = k / (1 + k);
+  } else if (type == SHAPER_ZVD) {
+    float sum = (1 + k) * (1 + k);
+    next.impulses = 3;
+    next.amplitude[0] = 1 / sum;
+    next.amplitude[1] = 2 * k / sum;
+    next.amplitude[2] = k * k / sum;
+  } else {
+    return false;
+  }
+  for (uint8_t i = 0; i < next.impulses; i++) {
+    next.delayTicks[i] = halfPeriodTicks * i;
+  }
+  if (next.delayTicks[next.impulses - 1] > SHAPER_HISTORY - 2) {
+    return false;  // Frequency too low for the history buffer
+  }
+  shaper = next;
+  return true;
+}
+
+float shapeSpeed(Motor &m, float speed) {
+  // One history sample per control tick; uint8_t indices wrap with the buffer
+  m.shaperHead++;
+  m.shaperHistory[m.shaperHead] = speed;
+  if (shaper.type == SHAPER_OFF) {
+    return speed;
+  }
+  
+  // Impulse times fall between ticks, so interpolate the history
+  float shaped = 0;
+  for (uint8_t i = 0; i < shaper.impulses; i++) {
+    uint8_t whole = (uint8_t)shaper.delayTicks[i];
+    float frac = shaper.delayTicks[i] - whole;
+    float newer = m.shaperHistory[(uint8_t)(m.shaperHead - whole)];
+    float older = m.shaperHistory[(uint8_t)(m.shaperHead - whole - 1)];
+    shaped += shaper.amplitude[i] * (newer + (older - newer) * frac);
+  }
+  return shaped;
+}
+
+void resetShaper(Motor &m, float speed) {
+  // Ramp and shaper continue from a steady speed
+  m.rampSpeed = speed;
+  for (uint16_t i = 0; i < SHAPER_HISTORY; i++) {
+    m.shaperHistory[i] = speed;
+  }
+}
+
+bool pvtAppend(const CmdText &params) {
+  // duration_ms:pos1:vel1:pos2:vel2
+  if (pvtCount >= PVT_DEPTH) {
+    return false;
+  }
+  PvtPoint point;
+  char text[RX_LINE_MAX];
+  char *end;
+  const char *next;
+  long duration = strtol(params.copyTo(text), &end, 10);
+  if (*end != ':') return false;
+  point.position[0] = strtol(end + 1, &end, 10);
+  if (*end != ':') return false;
+  point.velocity[0] = parseFloat(end + 1, &next);
+  if (*next != ':') return false;
+  point.position[1] = strtol(next + 1, &end, 10);
+  if (*end != ':') return false;
+  point.velocity[1] = parseFloat(end + 1, &next);
+  if (*next != '\0') return false;
+  
+  if (duration < PVT_MIN_SEGMENT_MS || duration > 65535 ||
+      !(abs(point.velocity[0]) <= MAX_SPEED) || !(abs(point.velocity[1]) <= MAX_SPEED)) {
+    return false;
+  }
+  point.durationMs = duration;
+  pvtBuffer[(pvtTail + pvtCount) % PVT_DEPTH] = point;
+  pvtCount++;
+  return true;
+}
+
+void pvtStart() {
+  // The first segment starts wherever the motors are, at their current speed
+  noInterrupts();
+  pvtFrom.position[0] = motor1.position;
+  pvtFrom.position[1] = motor2.position;
+  interrupts();
+  pvtFrom.velocity[0] = motor1.isRunning ? motor1.currentSpeed * motor1.direction : 0;
+  pvtFrom.velocity[1] = motor2.isRunning ? motor2.currentSpeed * motor2.direction : 0;
+  pvtFrom.durationMs = 0;
+  
+  motor1.boostActive = false;
+  motor2.boostActive = false;
+  motor1.isRunning = true;
+  motor2.isRunning = true;
+  pvtLastTickUs = micros();
+  pvtClockUs = 0;
+  pvtSegmentStartUs = 0;
+  pvtFeed = feedScale();
+  pvtPointsDone = 0;
+  pvtAiming = false;
+  pvtState = PVT_RUN;
+}
+
+void updatePvt() {
+  // Advance the plan clock at the feed rate
+  uint32_t now = micros();
+  pvtClockUs += (uint32_t)((now - pvtLastTickUs) * pvtFeed);
+  pvtLastTickUs = now;
+  uint32_t t = pvtClockUs - pvtSegmentStartUs;
+  
+  // Move on past segments that have finished
+  while (pvtCount > 0 && t >= pvtBuffer[pvtTail].durationMs * 1000UL) {
+    uint32_t duration = pvtBuffer[pvtTail].durationMs * 1000UL;
+    pvtFrom = pvtBuffer[pvtTail];
+    pvtTail = (pvtTail + 1) % PVT_DEPTH;
+    pvtCount--;
+    pvtPointsDone++;
+    pvtSegmentStartUs += duration;
+    pvtAiming = false;
+    t -= duration;
+  }
+  
+  noInterrupts();
+  int32_t pos1 = motor1.position;
+  int32_t pos2 = motor2.position;
+  interrupts();
+  
+  if (pvtCount == 0) {
+    if (pvtFrom.velocity[0] != 0 || pvtFrom.velocity[1] != 0) {
+      pvtHandOver(PVT_UNDERFLOW);
+      Link.println("PVT underflow - ramping to a stop");
+      return;
+    }
+    // Final point: close the last step or two, then hand back to the ramp
+    int32_t error1 = positionDiff(pvtFrom.position[0], pos1);
+    int32_t error2 = positionDiff(pvtFrom.position[1], pos2);
+    setStepRate(motor1, stepISR_M1, error1 * 1000.0 / accelUpdateInterval);
+    setStepRate(motor2, stepISR_M2, error2 * 1000.0 / accelUpdateInterval);
+    if (error1 == 0 && error2 == 0) {
+      pvtHandOver(PVT_DONE);
+    }
+    return;
+  }
+  
+  // Slew the feed no faster than accelRate allows at the planned speed,
+  // so pausing decelerates along the path instead of stopping dead
+  float planSpeed = max(abs(pvtVelocity(0, t)), abs(pvtVelocity(1, t)));
+  float feedStep = accelRate * accelUpdateInterval / 1000.0 / max(planSpeed, (float)MIN_SPEED);
+  float feedDiff = feedScale() - pvtFeed;
+  pvtFeed += constrain(feedDiff, -feedStep, feedStep);
+  
+  // Waypoint within reach: restart the step timers so the last step left
+  // to it lands just before its time, then leave them running until it is
+  // due (another tick's restart would shift their phase). Above 100% feed
+  // a tick can span several waypoints; only the first is aimed at.
+  if (pvtAiming && (int32_t)(now - pvtAimEndUs) < 0) {
+    return;
+  }
+  pvtAiming = false;
+  const PvtPoint &to = pvtBuffer[pvtTail];
+  uint32_t left = to.durationMs * 1000UL - t;
+  if (left <= PVT_AIM_TICKS * accelUpdateInterval * 1000UL * pvtFeed) {
+    float seconds = left / pvtFeed / 1000000.0;
+    int32_t steps1 = positionDiff(to.position[0], pos1);
+    int32_t steps2 = positionDiff(to.position[1], pos2);
+    setStepRate(motor1, stepISR_M1, steps1 == 0 ? 0 : (steps1 + copysignf(PVT_AIM_MARGIN, steps1)) / seconds, true);
+    setStepRate(motor2, stepISR_M2, steps2 == 0 ? 0 : (steps2 + copysignf(PVT_AIM_MARGIN, steps2)) / seconds, true);
+    pvtAiming = true;
+    pvtAimEndUs = now + (uint32_t)(seconds * 1000000.0);
+    return;
+  }
+  
+  // Steps needed to be on the curve at the next tick
+  uint32_t tNext = t + (uint32_t)(accelUpdateInterval * 1000UL * pvtFeed);
+  float perSecond = 1000.0 / accelUpdateInterval;
+  setStepRate(motor1, stepISR_M1, positionDiff(pvtTarget(0, tNext), pos1) * perSecond);
+  setStepRate(motor2, stepISR_M2, positionDiff(pvtTarget(1, tNext), pos2) * perSecond);
+}
+
+int32_t pvtTarget(uint8_t axis, uint32_t t) {
+  // Position t us into the current segment, carrying the time left over
+  // into the buffered segments after it (above 100% feed one tick can span
+  // several) or on at the last point's velocity when they run out. The
+  // Hermite cubic is only evaluated inside a segment, never past its end.
+  const PvtPoint *from = &pvtFrom;
+  const PvtPoint *to = &pvtBuffer[pvtTail];
+  uint32_t duration = to->durationMs * 1000UL;
+  for (uint8_t next = 1; t >= duration; next++) {
+    if (next >= pvtCount) {
+      return positionOffset(to->position[axis], lroundf(to->velocity[axis] * ((t - duration) / 1000000.0)));
+    }
+    t -= duration;
+    from = to;
+    to = &pvtBuffer[(pvtTail + next) % PVT_DEPTH];
+    duration = to->durationMs * 1000UL;
+  }
+  
+  // Cubic Hermite basis; positions stay relative to the segment start so
+  // large absolute counts keep their precision in float
+  float seconds = duration / 1000000.0;
+  float s = (float)t / duration;
+  float s2 = s * s;
+  float s3 = s2 * s;
+  float delta = (s3 - 2 * s2 + s) * seconds * from->velocity[axis]
+              + (3 * s2 - 2 * s3) * positionDiff(to->position[axis], from->position[axis])
+              + (s3 - s2) * seconds * to->velocity[axis];
+  return positionOffset(from->position[axis], lroundf(delta));
+}
+
+float pvtVelocity(uint8_t axis, uint32_t t) {
+  // Planned speed (steps/sec at 100% feed) t us into the current segment
+  if (pvtCount == 0) {
+    return 0;
+  }
+  const PvtPoint &to = pvtBuffer[pvtTail];
+  uint32_t duration = to.durationMs * 1000UL;
+  if (t >= duration) {
+    return to.velocity[axis];
+  }
+  float seconds = duration / 1000000.0;
+  float s = (float)t / duration;
+  float s2 = s * s;
+  return (3 * s2 - 4 * s + 1) * pvtFrom.velocity[axis]
+       + (6 * s - 6 * s2) * positionDiff(to.position[axis], pvtFrom.position[axis]) / seconds
+       + (3 * s2 - 2 * s) * to.velocity[axis];
+}
+
+float feedScale() {
+  return paused ? 0 : feedOverride / 100.0;
+}
+
+void pvtHandOver(uint8_t state) {
+  // Back to the speed ramp at the current speed, decelerating unless the
+  // next command sets a speed; drops whatever is still buffered
+  for (uint8_t i = 0; i < 2; i++) {
+    Motor &m = i == 0 ? motor1 : motor2;
+    m.targetSpeed = 0;
+    resetShaper(m, m.currentSpeed);
+    m.isRunning = m.currentSpeed > 0;
+  }
+  pvtCount = 0;
+  pvtState = state;
+}
+
+void setStepRate(Motor &m, void (*isr)(), float rate, bool restart) {
+  // Signed step rate straight to the timer, bypassing the ramp; restart
+  // puts the first step a full period from now
+  float speed = constrain(abs(rate), 0, MAX_SPEED);
+  if (speed < 1) {
+    m.timer.end();
+    m.currentSpeed = 0;
+    return;
+  }
+  int dir = rate < 0 ? -1 : 1;
+  if (dir != m.direction) {
+    m.direction = dir;
+    digitalWrite(m.dirPin, dir == 1 ? LOW : HIGH);
+  }
+  
+  // Less than a step per tick: keep the timer's phase, or restarting it
+  // every tick would hold the step off forever
+  float period = 1000000.0 / speed;
+  if (!restart && m.currentSpeed > 0 && period >= accelUpdateInterval * 1000.0) {
+    m.timer.update(period);
+  } else {
+    m.timer.end();
+    m.timer.begin(isr, period);
+  }
+  m.currentSpeed = speed;
+}
+
+uint8_t lookupVerb(const CmdText &command) {
+  for (const Verb &verb : verbs) {
+    if (command == verb.name) {
+      return verb.op;
+    }
+  }
+  return OP_UNKNOWN;
 }
 
 void updateTimers() {
@@ -253,14 +912,25 @@ void updateTimers() {
   }
 }
 
-void processCommand(String cmd) {
-  cmd.trim();
-  cmd.toUpperCase();
+void processCommand(const char *line) {
+  // Trimmed, upper-case copy; everything below is a slice of it
+  char text[RX_LINE_MAX];
+  uint8_t begin = 0;
+  uint8_t end = strnlen(line, RX_LINE_MAX - 1);
+  STRING_WORK(2 * end);
+  while (begin < end && (line[begin] == ' ' || (line[begin] >= '\t' && line[begin] <= '\r'))) begin++;
+  while (end > begin && (line[end - 1] == ' ' || (line[end - 1] >= '\t' && line[end - 1] <= '\r'))) end--;
+  for (uint8_t i = begin; i < end; i++) {
+    char c = line[i];
+    text[i - begin] = c >= 'a' && c <= 'z' ? c - ('a' - 'A') : c;
+  }
+  CmdText cmd;
+  cmd.ptr = text;
+  cmd.len = end - begin;
   
   // Parse command format: COMMAND:VALUE or MOTOR:COMMAND:VALUE
-  int firstColon = cmd.indexOf(':');
-  String command = "";
-  String value = "";
+  CmdText command;
+  CmdText value;
   Motor *targetMotor = nullptr;
   
   // Check if command starts with M1 or M2
@@ -281,91 +951,106 @@ void processCommand(String cmd) {
     command = cmd;
   }
   
+  uint8_t op = lookupVerb(command);
+  linkStats.opcodes[op]++;
+  
+  // Manual motion takes over from a PVT move
+  if (pvtState == PVT_RUN && (MOTION_OPS >> op & 1)) {
+    pvtHandOver(PVT_ABORTED);
+  }
+  
   // Process Commands
-  if (command == "SPEED" || command == "S") {
+  if (op == OP_SPEED) {
     float speed = value.toFloat();
     if (targetMotor) {
       setSpeed(*targetMotor, speed);
-      Serial.print(targetMotor->name);
-      Serial.print(" speed set to: ");
-      Serial.println(speed);
+      Link.print(targetMotor->name);
+      Link.print(" speed set to: ");
+      Link.println(speed);
     } else {
       // Set both motors
       setSpeed(motor1, speed);
       setSpeed(motor2, speed);
-      Serial.print("Both motors speed set to: ");
-      Serial.println(speed);
+      Link.print("Both motors speed set to: ");
+      Link.println(speed);
     }
     
-  } else if (command == "FORWARD" || command == "FWD" || command == "F") {
+  } else if (op == OP_FORWARD) {
     if (targetMotor) {
       setDirection(*targetMotor, 1);
-      Serial.print(targetMotor->name);
-      Serial.println(" direction: FORWARD");
+      Link.print(targetMotor->name);
+      Link.println(" direction: FORWARD");
     } else {
       setDirection(motor1, 1);
       setDirection(motor2, 1);
-      Serial.println("Both motors direction: FORWARD");
+      Link.println("Both motors direction: FORWARD");
     }
     
-  } else if (command == "BACKWARD" || command == "BACK" || command == "B") {
+  } else if (op == OP_BACKWARD) {
     if (targetMotor) {
       setDirection(*targetMotor, -1);
-      Serial.print(targetMotor->name);
-      Serial.println(" direction: BACKWARD");
+      Link.print(targetMotor->name);
+      Link.println(" direction: BACKWARD");
     } else {
       setDirection(motor1, -1);
       setDirection(motor2, -1);
-      Serial.println("Both motors direction: BACKWARD");
+      Link.println("Both motors direction: BACKWARD");
     }
     
-  } else if (command == "STOP" || command == "X") {
+  } else if (op == OP_STOP) {
+    paused = false;  // A stop ends the move a pause was holding
     if (targetMotor) {
       stopMotor(*targetMotor);
-      Serial.print(targetMotor->name);
-      Serial.println(" stopped");
+      Link.print(targetMotor->name);
+      Link.println(" stopped");
     } else {
       stopMotor(motor1);
       stopMotor(motor2);
-      Serial.println("Both motors stopped");
+      Link.println("Both motors stopped");
     }
     
-  } else if (command == "ESTOP" || command == "E") {
+  } else if (op == OP_ESTOP) {
+    paused = false;
     emergencyStop();
-    Serial.println("EMERGENCY STOP - ALL MOTORS");
+    Link.println("EMERGENCY STOP - ALL MOTORS");
     
-  } else if (command == "RUN" || command == "R") {
+  } else if (op == OP_RUN) {
     if (targetMotor) {
       targetMotor->isRunning = true;
-      Serial.print(targetMotor->name);
-      Serial.println(" running");
+      Link.print(targetMotor->name);
+      Link.println(" running");
     } else {
       motor1.isRunning = true;
       motor2.isRunning = true;
-      Serial.println("Both motors running");
+      Link.println("Both motors running");
     }
     
-  } else if (command == "STATUS" || command == "?") {
-    printStatus();
+  } else if (op == OP_STATUS) {
+    // STATUS:C - one machine-readable line instead of the full dump
+    if (value == "C") {
+      printStatusCompact();
+    } else {
+      printStatus();
+    }
     
-  } else if (command == "RESET" || command == "RST") {
+  } else if (op == OP_RESET) {
     if (targetMotor) {
       targetMotor->position = 0;
       stopMotor(*targetMotor);
-      Serial.print(targetMotor->name);
-      Serial.println(" reset");
+      Link.print(targetMotor->name);
+      Link.println(" reset");
     } else {
       motor1.position = 0;
       motor2.position = 0;
       stopMotor(motor1);
       stopMotor(motor2);
-      Serial.println("Both motors reset");
+      Link.println("Both motors reset");
     }
     
-  } else if (command == "SPIN") {
+  } else if (op == OP_SPIN) {
     // SPIN:LEFT:speed or SPIN:RIGHT:speed
     int colonPos = value.indexOf(':');
-    String direction = value.substring(0, colonPos);
+    CmdText direction = value.substring(0, colonPos);
     float speed = value.substring(colonPos + 1).toFloat();
     
     if (direction == "LEFT" || direction == "L") {
@@ -375,8 +1060,8 @@ void processCommand(String cmd) {
       setSpeed(motor2, speed);
       motor1.isRunning = true;
       motor2.isRunning = true;
-      Serial.print("Spinning LEFT at ");
-      Serial.println(speed);
+      Link.print("Spinning LEFT at ");
+      Link.println(speed);
     } else if (direction == "RIGHT" || direction == "R") {
       setDirection(motor1, 1);   // M1 forward
       setDirection(motor2, -1);  // M2 backward
@@ -384,16 +1069,17 @@ void processCommand(String cmd) {
       setSpeed(motor2, speed);
       motor1.isRunning = true;
       motor2.isRunning = true;
-      Serial.print("Spinning RIGHT at ");
-      Serial.println(speed);
+      Link.print("Spinning RIGHT at ");
+      Link.println(speed);
     } else {
-      Serial.println("Invalid SPIN direction. Use LEFT or RIGHT");
+      linkStats.parseErrors++;
+      Link.println("Invalid SPIN direction. Use LEFT or RIGHT");
     }
     
-  } else if (command == "BOOST") {
+  } else if (op == OP_BOOST) {
     // BOOST:LEFT:speed or BOOST:RIGHT:speed or BOOST:FORWARD:speed
     int colonPos = value.indexOf(':');
-    String direction = value.substring(0, colonPos);
+    CmdText direction = value.substring(0, colonPos);
     float speed = value.substring(colonPos + 1).toFloat();
     
     if (direction == "LEFT" || direction == "L") {
@@ -403,8 +1089,8 @@ void processCommand(String cmd) {
       applyBoost(motor2, speed);
       motor1.isRunning = true;
       motor2.isRunning = true;
-      Serial.print("BOOST Spin LEFT at ");
-      Serial.println(speed);
+      Link.print("BOOST Spin LEFT at ");
+      Link.println(speed);
     } else if (direction == "RIGHT" || direction == "R") {
       setDirection(motor1, 1);
       setDirection(motor2, -1);
@@ -412,8 +1098,8 @@ void processCommand(String cmd) {
       applyBoost(motor2, speed);
       motor1.isRunning = true;
       motor2.isRunning = true;
-      Serial.print("BOOST Spin RIGHT at ");
-      Serial.println(speed);
+      Link.print("BOOST Spin RIGHT at ");
+      Link.println(speed);
     } else if (direction == "FORWARD" || direction == "F") {
       setDirection(motor1, 1);
       setDirection(motor2, 1);
@@ -421,8 +1107,8 @@ void processCommand(String cmd) {
       applyBoost(motor2, speed);
       motor1.isRunning = true;
       motor2.isRunning = true;
-      Serial.print("BOOST Forward at ");
-      Serial.println(speed);
+      Link.print("BOOST Forward at ");
+      Link.println(speed);
     } else if (direction == "BACKWARD" || direction == "B") {
       setDirection(motor1, -1);
       setDirection(motor2, -1);
@@ -430,71 +1116,213 @@ void processCommand(String cmd) {
       applyBoost(motor2, speed);
       motor1.isRunning = true;
       motor2.isRunning = true;
-      Serial.print("BOOST Backward at ");
-      Serial.println(speed);
+      Link.print("BOOST Backward at ");
+      Link.println(speed);
     } else {
-      Serial.println("Invalid BOOST direction");
+      linkStats.parseErrors++;
+      Link.println("Invalid BOOST direction");
     }
     
-  } else if (command == "SYNC") {
+  } else if (op == OP_SYNC) {
     // Reset both motor positions simultaneously
     noInterrupts();
     motor1.position = 0;
     motor2.position = 0;
     interrupts();
-    Serial.println("Motors synchronized - positions reset");
+    Link.println("Motors synchronized - positions reset");
+    
+  } else if (op == OP_TELEMETRY) {
+    // TELEMETRY:interval_ms (0 disables)
+    telemetryInterval = value.toInt();
+    lastTelemetry = millis();
+    Link.print("Telemetry interval: ");
+    Link.print(telemetryInterval);
+    Link.println(" ms");
+    
+  } else if (op == OP_PERF) {
+    printPerf();
+    
+  } else if (op == OP_BENCH) {
+    // BENCH:RUN - blocks for about two seconds; drivers must be off
+    if (value == "RUN") {
+      runBench();
+    } else {
+      Link.println("BENCH:RUN pulses both STEP pins up to 100 kHz - power down the drivers first");
+    }
+    
+  } else if (op == OP_OVERRIDE) {
+    // OVERRIDE:percent (0-200) - scales speeds and PVT timing on the fly.
+    // A missing or non-numeric percent is rejected, not read as 0%.
+    char text[RX_LINE_MAX];
+    char *end;
+    const char *digits = value.copyTo(text);
+    long percent = strtol(digits, &end, 10);
+    if (end == digits || *end != '\0') {
+      linkStats.parseErrors++;
+      Link.println("Invalid override (OVERRIDE:percent, 0-200)");
+    } else {
+      feedOverride = constrain(percent, 0, MAX_FEED_OVERRIDE);
+      Link.print("Feed override: ");
+      Link.print(feedOverride);
+      Link.println(paused ? "% (paused)" : "%");
+    }
+    
+  } else if (op == OP_PAUSE) {
+    paused = true;
+    Link.println("Paused - decelerating along the current move");
+    
+  } else if (op == OP_RESUME) {
+    paused = false;
+    Link.print("Resumed at ");
+    Link.print(feedOverride);
+    Link.println("%");
+    
+  } else if (op == OP_PVT) {
+    // PVT:duration_ms:pos1:vel1:pos2:vel2 queues a point, PVT:GO starts,
+    // PVT:? reports; all answer with printPvt's status line
+    if (value == "GO") {
+      if (pvtState != PVT_RUN && pvtCount > 0) {
+        pvtStart();
+      }
+    } else if (value != "?" && !pvtAppend(value)) {
+      linkStats.parseErrors++;
+      Link.print("PVT point rejected: ");
+      Link.write(value.ptr, value.len);
+      Link.println();
+    }
+    printPvt();
     
-  } else if (command == "CONFIG") {
+  } else if (op == OP_MEM) {
+    printMem();
+    
+  } else if (op == OP_LINK) {
+    printLink();
+    
+  } else if (op == OP_HELLO) {
+    // HELLO:nonce - connection handshake, see printHello
+    printHello(value);
+    
+  } else if (op == OP_CONFIG) {
     // CONFIG:BOOST:multiplier:duration:enabled
     // Example: CONFIG:BOOST:1.5:200:1
     if (value.startsWith("BOOST:")) {
-      String params = value.substring(6);  // Remove "BOOST:"
+      CmdText params = value.substring(6);  // Remove "BOOST:"
+      int colon1 = params.indexOf(':');
+      int colon2 = colon1 > 0 ? params.indexOf(':', colon1 + 1) : -1;
+      float multiplier = params.substring(0, colon1).toFloat();
+      long duration = params.substring(colon1 + 1, colon2).toInt();
+      
+      // All three fields, or nothing changes
+      if (colon2 < 0 || !(multiplier > 0 && multiplier <= MAX_BOOST_MULTIPLIER) ||
+          duration < 0 || duration > 65535) {
+        linkStats.parseErrors++;
+        Link.println("Invalid boost config (CONFIG:BOOST:multiplier:duration_ms:enabled)");
+      } else {
+        boostConfig.multiplier = multiplier;
+        boostConfig.duration = duration;
+        boostConfig.enabled = params.substring(colon2 + 1).toInt() == 1;
+        
+        Link.println("Boost configuration updated:");
+        Link.print("  Multiplier: ");
+        Link.println(boostConfig.multiplier);
+        Link.print("  Duration: ");
+        Link.print(boostConfig.duration);
+        Link.println(" ms");
+        Link.print("  Enabled: ");
+        Link.println(boostConfig.enabled ? "YES" : "NO");
+      }
+    } else if (value.startsWith("ACCEL:")) {
+      // CONFIG:ACCEL:steps_per_sec2
+      float rate = value.substring(6).toFloat();
+      if (rate >= MIN_ACCEL_RATE && isfinite(rate)) {
+        accelRate = rate;
+      } else {
+        linkStats.parseErrors++;
+      }
+      Link.print("Acceleration: ");
+      Link.print(accelRate);
+      Link.println(" steps/sec^2");
+    } else if (value.startsWith("SHAPER:")) {
+      // CONFIG:SHAPER:OFF or CONFIG:SHAPER:ZV|ZVD:frequency_hz:damping_ratio
+      CmdText params = value.substring(7);
       int colon1 = params.indexOf(':');
       int colon2 = params.indexOf(':', colon1 + 1);
+      CmdText type = colon1 > 0 ? params.substring(0, colon1) : params;
+      float frequency = params.substring(colon1 + 1, colon2).toFloat();
+      float damping = colon2 > 0 ? params.substring(colon2 + 1).toFloat() : 0;
       
-      boostConfig.multiplier = params.substring(0, colon1).toFloat();
-      boostConfig.duration = params.substring(colon1 + 1, colon2).toInt();
-      boostConfig.enabled = params.substring(colon2 + 1).toInt() == 1;
+      bool ok = false;
+      if (type == "OFF") {
+        ok = configureShaper(SHAPER_OFF, 0, 0);
+      } else if (type == "ZV") {
+        ok = configureShaper(SHAPER_ZV, frequency, damping);
+      } else if (type == "ZVD") {
+        ok = configureShaper(SHAPER_ZVD, frequency, damping);
+      }
       
-      Serial.println("Boost configuration updated:");
-      Serial.print("  Multiplier: ");
-      Serial.println(boostConfig.multiplier);
-      Serial.print("  Duration: ");
-      Serial.print(boostConfig.duration);
-      Serial.println(" ms");
-      Serial.print("  Enabled: ");
-      Serial.println(boostConfig.enabled ? "YES" : "NO");
+      if (!ok) {
+        linkStats.parseErrors++;
+        Link.println("Invalid shaper (type OFF/ZV/ZVD, frequency too low, or damping not 0-1)");
+      } else if (shaper.type == SHAPER_OFF) {
+        Link.println("Input shaper: OFF");
+      } else {
+        Link.print("Input shaper: ");
+        Link.print(shaper.type == SHAPER_ZV ? "ZV " : "ZVD ");
+        Link.print(shaper.frequency);
+        Link.print(" Hz, damping ");
+        Link.print(shaper.damping);
+        Link.print(", delay ");
+        Link.print(shaper.delayTicks[shaper.impulses - 1] * accelUpdateInterval);
+        Link.println(" ms");
+      }
     } else {
-      Serial.println("CONFIG:BOOST:multiplier:duration:enabled");
-      Serial.println("Example: CONFIG:BOOST:1.5:200:1");
+      linkStats.parseErrors++;
+      Link.println("CONFIG:BOOST:multiplier:duration:enabled");
+      Link.println("Example: CONFIG:BOOST:1.5:200:1");
+      Link.println("CONFIG:ACCEL:steps_per_sec2");
+      Link.println("CONFIG:SHAPER:ZV|ZVD:frequency_hz:damping or CONFIG:SHAPER:OFF");
     }
     
   } else {
-    Serial.print("Unknown command: ");
-    Serial.println(cmd);
-    Serial.println("Available commands:");
-    Serial.println("  SPEED:value or S:value - Set both motors speed");
-    Serial.println("  M1:SPEED:value - Set Motor 1 speed");
-    Serial.println("  M2:SPEED:value - Set Motor 2 speed");
-    Serial.println("  FORWARD or F - Both motors forward");
-    Serial.println("  M1:FORWARD - Motor 1 forward");
-    Serial.println("  M2:BACKWARD - Motor 2 backward");
-    Serial.println("  RUN or R - Start motor(s)");
-    Serial.println("  STOP or X - Stop motor(s)");
-    Serial.println("  ESTOP or E - Emergency stop all");
-    Serial.println("  STATUS or ? - Get status");
-    Serial.println("  RESET - Reset position(s) to zero");
-    Serial.println("  SPIN:LEFT:speed - Spin left (point turn)");
-    Serial.println("  SPIN:RIGHT:speed - Spin right (point turn)");
-    Serial.println("  BOOST:LEFT:speed - Boosted spin left");
-    Serial.println("  BOOST:RIGHT:speed - Boosted spin right");
-    Serial.println("  SYNC - Synchronize motor positions");
-    Serial.println("  CONFIG:BOOST:mult:dur:enabled - Configure boost");
+    linkStats.unknown++;
+    Link.print("Unknown command: ");
+    Link.write(cmd.ptr, cmd.len);
+    Link.println();
+    Link.println("Available commands:");
+    Link.println("  SPEED:value or S:value - Set both motors speed");
+    Link.println("  M1:SPEED:value - Set Motor 1 speed");
+    Link.println("  M2:SPEED:value - Set Motor 2 speed");
+    Link.println("  FORWARD or F - Both motors forward");
+    Link.println("  M1:FORWARD - Motor 1 forward");
+    Link.println("  M2:BACKWARD - Motor 2 backward");
+    Link.println("  RUN or R - Start motor(s)");
+    Link.println("  STOP or X - Stop motor(s)");
+    Link.println("  ESTOP or E - Emergency stop all");
+    Link.println("  STATUS or ? - Get status");
+    Link.println("  STATUS:C - Status as one line (see printStatusCompact)");
+    Link.println("  RESET - Reset position(s) to zero");
+    Link.println("  SPIN:LEFT:speed - Spin left (point turn)");
+    Link.println("  SPIN:RIGHT:speed - Spin right (point turn)");
+    Link.println("  BOOST:LEFT:speed - Boosted spin left");
+    Link.println("  BOOST:RIGHT:speed - Boosted spin right");
+    Link.println("  SYNC - Synchronize motor positions");
+    Link.println("  CONFIG:BOOST:mult:dur:enabled - Configure boost");
+    Link.println("  CONFIG:ACCEL:rate - Set acceleration (steps/sec^2)");
+    Link.println("  CONFIG:SHAPER:type:hz:damping - Input shaper (ZV, ZVD or OFF)");
+    Link.println("  TELEMETRY:ms or TEL:ms - Stream telemetry frames (0 = off)");
+    Link.println("  PERF - Loop/ISR timing histograms");
+    Link.println("  MEM - Stack high-water mark and static RAM");
+    Link.println("  LINK - USB link counters (bytes, lines, errors, stalls, per command)");
+    Link.println("  BENCH:RUN - Step rate / CPU headroom self-test (drivers off)");
+    Link.println("  HELLO:nonce - Handshake (protocol, version, queue, capabilities)");
+    Link.println("  PVT:ms:pos1:vel1:pos2:vel2 - Queue a waypoint (PVT:GO starts, PVT:? reports)");
+    Link.println("  OVERRIDE:percent or OV:percent - Feed override 0-200%");
+    Link.println("  PAUSE or P / RESUME - Decelerate and hold / carry on");
   }
 }
 
 void setSpeed(Motor &m, float speed) {
-  speed = constrain(speed, 0, MAX_SPEED);
+  speed = isnan(speed) ? 0 : constrain(speed, 0, MAX_SPEED);  // SPEED:NAN parses
   m.targetSpeed = speed;
   
   if (speed > 0 && !m.isRunning) {
@@ -509,16 +1337,23 @@ void setDirection(Motor &m, int dir) {
   
   // If changing direction at high speed, slow down first
   if (newDir != m.direction && m.currentSpeed > 500) {
-    Serial.print(m.name);
-    Serial.println(" slowing for direction change...");
+    Link.print(m.name);
+    Link.println(" slowing for direction change...");
     
-    // Reduce speed before direction change
-    float originalTarget = m.targetSpeed;
-    m.targetSpeed = 200;  // Slow to safe speed
+    // Reduce speed before direction change; a boost ends here, or expiring
+    // mid-slowdown it would raise the target again
+    float originalTarget = m.boostActive ? m.normalSpeed : m.targetSpeed;
+    m.boostActive = false;
+    m.targetSpeed = 200 / max(feedScale(), 1.0f);  // Slow to safe speed, even overridden
     
     while (m.currentSpeed > 300) {
       updateSpeed(m);
+      updateTimers();  // Step rate follows the ramp (and shaper) on the way down
       delay(accelUpdateInterval);
+      readSerial();
+      if (estopRequested) {
+        return;  // The ESTOP runs next; never reverse at speed
+      }
     }
     
     // Now safe to change direction
@@ -535,31 +1370,48 @@ void setDirection(Motor &m, int dir) {
 }
 
 void stopMotor(Motor &m) {
-  // Gradual stop
+  // Gradual stop (ending any boost, whose expiry would restore the speed)
+  m.boostActive = false;
   m.targetSpeed = 0;
-  // Wait for deceleration
+  // Wait for deceleration (an ESTOP received meanwhile takes over)
   while (m.currentSpeed > 1) {
     updateSpeed(m);
+    updateTimers();
     delay(accelUpdateInterval);
+    readSerial();
+    if (estopRequested) {
+      return;
+    }
   }
   m.isRunning = false;
   m.timer.end();
   m.currentSpeed = 0;
+  resetShaper(m);
 }
 
 void emergencyStop() {
   // Quick ramp-down stop (0.5 second) to prevent mechanical stress
-  Serial.println("EMERGENCY STOP - Ramping down...");
+  Link.println("EMERGENCY STOP - Ramping down...");
   
   // Set both motors to decelerate quickly
+  motor1.boostActive = false;
+  motor2.boostActive = false;
   motor1.targetSpeed = 0;
   motor2.targetSpeed = 0;
   
+  // Ramp straight down from the current speed, unshaped - stopping soon
+  // matters more here than sway
+  uint8_t shaperType = shaper.type;
+  shaper.type = SHAPER_OFF;
+  motor1.rampSpeed = motor1.currentSpeed;
+  motor2.rampSpeed = motor2.currentSpeed;
+  
   // Quick deceleration over 0.5 seconds
-  unsigned long stopStartTime = millis();
+  uint32_t stopStartTime = millis();
   while ((motor1.currentSpeed > 1 || motor2.currentSpeed > 1) && (millis() - stopStartTime < 500)) {
     updateSpeed(motor1);
     updateSpeed(motor2);
+    updateTimers();
     delay(accelUpdateInterval);
   }
   
@@ -570,50 +1422,91 @@ void emergencyStop() {
   motor2.isRunning = false;
   motor1.currentSpeed = 0;
   motor2.currentSpeed = 0;
+  resetShaper(motor1);
+  resetShaper(motor2);
+  shaper.type = shaperType;
   digitalWrite(M1_PWM_PIN, LOW);
   digitalWrite(M2_PWM_PIN, LOW);
   
-  Serial.println("Motors stopped safely.");
+  Link.println("Motors stopped safely.");
 }
 
 void printStatus() {
-  Serial.println("======== DUAL MOTOR STATUS ========");
-  
-  Serial.println("--- Motor 1 (Left/Port) ---");
-  Serial.print("  Running: ");
-  Serial.println(motor1.isRunning ? "YES" : "NO");
-  Serial.print("  Current Speed: ");
-  Serial.println(motor1.currentSpeed);
-  Serial.print("  Target Speed: ");
-  Serial.println(motor1.targetSpeed);
-  Serial.print("  Direction: ");
-  Serial.println(motor1.direction == 1 ? "FORWARD" : "BACKWARD");
-  Serial.print("  Position: ");
-  Serial.println(motor1.position);
-  Serial.print("  Boost Active: ");
-  Serial.println(motor1.boostActive ? "YES" : "NO");
-  
-  Serial.println("--- Motor 2 (Right/Starboard) ---");
-  Serial.print("  Running: ");
-  Serial.println(motor2.isRunning ? "YES" : "NO");
-  Serial.print("  Current Speed: ");
-  Serial.println(motor2.currentSpeed);
-  Serial.print("  Target Speed: ");
-  Serial.println(motor2.targetSpeed);
-  Serial.print("  Direction: ");
-  Serial.println(motor2.direction == 1 ? "FORWARD" : "BACKWARD");
-  Serial.print("  Position: ");
-  Serial.println(motor2.position);
-  Serial.print("  Boost Active: ");
-  Serial.println(motor2.boostActive ? "YES" : "NO");
+  respLine("======== DUAL MOTOR STATUS ========");
+  
+  for (uint8_t i = 0; i < 2; i++) {
+    Motor &m = i == 0 ? motor1 : motor2;
+    respLine(i == 0 ? "--- Motor 1 (Left/Port) ---" : "--- Motor 2 (Right/Starboard) ---");
+    respStr("  Running: ");
+    respLine(m.isRunning ? "YES" : "NO");
+    respStr("  Current Speed: ");
+    respFixed(m.currentSpeed, 2);
+    respLine("");
+    respStr("  Target Speed: ");
+    respFixed(m.targetSpeed, 2);
+    respLine("");
+    respStr("  Direction: ");
+    respLine(m.direction == 1 ? "FORWARD" : "BACKWARD");
+    respStr("  Position: ");
+    respInt(m.position);
+    respLine("");
+    respStr("  Boost Active: ");
+    respLine(m.boostActive ? "YES" : "NO");
+  }
   
   // Sync status
-  long posDiff = abs(motor1.position - motor2.position);
-  Serial.print("--- Sync Drift: ");
-  Serial.print(posDiff);
-  Serial.println(" steps ---");
+  int32_t posDiff = abs(positionDiff(motor1.position, motor2.position));
+  respStr("--- Sync Drift: ");
+  respInt(posDiff);
+  respLine(" steps ---");
+  respStr("--- RX Credits: ");
+  respUInt(rxCredits());
+  respStr(" of ");
+  respUInt(RX_QUEUE_DEPTH);
+  respLine(" ---");
+  respStr("--- Feed Override: ");
+  respUInt(feedOverride);
+  respLine(paused ? "% (PAUSED) ---" : "% ---");
   
-  Serial.println("===================================");
+  respLine("===================================");
+  respSend();
+}
+
+void printStatusCompact() {
+  // STATUS:millis:run1:speed1:target1:dir1:pos1:boost1:run2:speed2:target2:dir2:pos2:boost2:drift:credits:override:paused
+  // Speeds are whole steps/sec, flags are 0/1, directions are 1/-1
+  noInterrupts();
+  int32_t pos1 = motor1.position;
+  int32_t pos2 = motor2.position;
+  interrupts();
+  
+  respStr("STATUS:");
+  respUInt(millis());
+  for (uint8_t i = 0; i < 2; i++) {
+    Motor &m = i == 0 ? motor1 : motor2;
+    respChar(':');
+    respUInt(m.isRunning);
+    respChar(':');
+    respFixed(m.currentSpeed, 0);
+    respChar(':');
+    respFixed(m.targetSpeed, 0);
+    respChar(':');
+    respInt(m.direction);
+    respChar(':');
+    respInt(i == 0 ? pos1 : pos2);
+    respChar(':');
+    respUInt(m.boostActive);
+  }
+  respChar(':');
+  respInt(abs(positionDiff(pos1, pos2)));
+  respChar(':');
+  respUInt(rxCredits());
+  respChar(':');
+  respUInt(feedOverride);
+  respChar(':');
+  respUInt(paused);
+  respLine("");
+  respSend();
 }
 
 void applyBoost(Motor &m, float targetSpeed) {
@@ -624,6 +1517,7 @@ void applyBoost(Motor &m, float targetSpeed) {
   }
   
   // Calculate boost speed
+  targetSpeed = isnan(targetSpeed) ? 0 : constrain(targetSpeed, 0, MAX_SPEED);
   float boostSpeed = targetSpeed * boostConfig.multiplier;
   
   // Safety cap - never exceed absolute max
@@ -640,26 +1534,667 @@ void applyBoost(Motor &m, float targetSpeed) {
   m.boostStartTime = millis();
   m.targetSpeed = boostSpeed;  // Start with boosted speed
   
-  Serial.print(m.name);
-  Serial.print(" boost activated: ");
-  Serial.print(boostSpeed);
-  Serial.print(" steps/sec for ");
-  Serial.print(boostConfig.duration);
-  Serial.println(" ms");
+  Link.print(m.name);
+  Link.print(" boost activated: ");
+  Link.print(boostSpeed);
+  Link.print(" steps/sec for ");
+  Link.print(boostConfig.duration);
+  Link.println(" ms");
 }
 
 void checkSync() {
   // Calculate position difference
-  long posDiff = abs(motor1.position - motor2.position);
+  int32_t posDiff = abs(positionDiff(motor1.position, motor2.position));
   
   // Alert if drift exceeds threshold
   if (posDiff > SYNC_THRESHOLD && (motor1.isRunning || motor2.isRunning)) {
-    Serial.print("⚠️  SYNC WARNING: Position drift = ");
-    Serial.print(posDiff);
-    Serial.println(" steps");
-    Serial.print("   Motor1: ");
-    Serial.print(motor1.position);
-    Serial.print(" | Motor2: ");
-    Serial.println(motor2.position);
+    Link.print("⚠️  SYNC WARNING: Position drift = ");
+    Link.print(posDiff);
+    Link.println(" steps");
+    Link.print("   Motor1: ");
+    Link.print(motor1.position);
+    Link.print(" | Motor2: ");
+    Link.println(motor2.position);
+  }
+}
+
+// Wrap-safe position arithmetic (see Motor)
+int32_t positionDiff(int32_t a, int32_t b) {
+  return (int32_t)((uint32_t)a - (uint32_t)b);
+}
+
+int32_t positionOffset(int32_t position, int32_t steps) {
+  return (int32_t)((uint32_t)position + (uint32_t)steps);
+}
+
+void readSerial() {
+  uint32_t backlog = Link.available();
+  if (backlog > linkStats.rxBacklogMax) {
+    linkStats.rxBacklogMax = backlog;
+  }
+  
+  while (Link.available()) {
+    char inChar = (char)Link.read();
+    
+    if (inChar == '\n' || inChar == '\r') {
+      if (rxLineLen == 0) {
+        continue;  // Ignore blank lines (and the second half of CRLF)
+      }
+      rxLine[rxLineLen] = '\0';
+      rxLineLen = 0;
+      rxLinesReceived++;
+      linkStats.lines++;
+      if (rxLineCut) {
+        linkStats.rxTruncated++;
+        rxLineCut = false;
+      }
+      // HELLO completing a fragment left by a host that died mid-write:
+      // drop the fragment instead of executing it
+      const char *hello = strstr(rxLine, "HELLO:");
+      if (hello != NULL && hello != rxLine) {
+        memmove(rxLine, hello, strlen(hello) + 1);
+        linkStats.rxTruncated++;
+      }
+      
+      if (rxCount < RX_QUEUE_DEPTH) {
+        memcpy(rxQueue[rxHead], rxLine, RX_LINE_MAX);
+        rxHead = (rxHead + 1) % RX_QUEUE_DEPTH;
+        rxCount++;
+        if (isEstopLine(rxLine)) {
+          estopRequested = true;
+        }
+      } else {
+        // Host ignored its credits - still ACK so its accounting stays in step
+        linkStats.rxDropped++;
+        Link.print("RX queue full - dropped: ");
+        Link.println(rxLine);
+        sendAck();
+      }
+    } else if (rxLineLen < RX_LINE_MAX - 1) {
+      rxLine[rxLineLen++] = inChar;
+    } else {
+      rxLineCut = true;
+    }
+  }
+}
+
+int LinkSerial::available() {
+  return Serial.available();
+}
+
+int LinkSerial::read() {
+  int c = Serial.read();
+  if (c >= 0) {
+    linkStats.rxBytes++;
+  }
+  return c;
+}
+
+size_t LinkSerial::write(const uint8_t *buffer, size_t size) {
+  // Returns at once while the USB buffers have room, blocks once the host
+  // stops reading
+  uint32_t start = micros();
+  size_t n = Serial.write(buffer, size);
+  uint32_t took = micros() - start;
+  
+  linkStats.txBytes += n;
+  linkStats.txWrites++;
+  if (took >= TX_STALL_US) {
+    linkStats.txStalls++;
+    linkStats.txBlockedUs += took;
+  }
+  return n;
+}
+
+bool isEstopLine(const char *line) {
+  // "ESTOP" or "E" in any case, surrounding whitespace ignored as processCommand does
+  const char *words[] = {"ESTOP", "E"};
+  while (*line == ' ' || (*line >= '\t' && *line <= '\r')) line++;
+  for (const char *word : words) {
+    const char *p = line;
+    const char *w = word;
+    while (*w && (*p == *w || *p == *w - 'A' + 'a')) {
+      p++;
+      w++;
+    }
+    while (*p == ' ' || (*p >= '\t' && *p <= '\r')) p++;
+    if (!*w && !*p) {
+      return true;
+    }
   }
+  return false;
+}
+
+uint8_t rxCredits() {
+  return RX_QUEUE_DEPTH - rxCount;
+}
+
+void sendAck() {
+  // ACK:credits:lines_received
+  respStr("ACK:");
+  respUInt(rxCredits());
+  respChar(':');
+  respUInt(rxLinesReceived);
+  respLine("");
+  respSend();
+}
+
+void sendTelemetry() {
+  // T:millis:pos1:pos2:speed1:speed2:credits:lines_received:rx_lost:tx_blocked_ms:rx_backlog_max
+  // Speeds are signed by direction and rounded to whole steps/sec; the last
+  // three are link health from LinkStats (rx_lost: lines dropped or truncated)
+  noInterrupts();
+  int32_t pos1 = motor1.position;
+  int32_t pos2 = motor2.position;
+  interrupts();
+  
+  respStr("T:");
+  respUInt(millis());
+  respChar(':');
+  respInt(pos1);
+  respChar(':');
+  respInt(pos2);
+  respChar(':');
+  respInt((int32_t)(motor1.currentSpeed * motor1.direction));
+  respChar(':');
+  respInt((int32_t)(motor2.currentSpeed * motor2.direction));
+  respChar(':');
+  respUInt(rxCredits());
+  respChar(':');
+  respUInt(rxLinesReceived);
+  respChar(':');
+  respUInt(linkStats.rxDropped + linkStats.rxTruncated);
+  respChar(':');
+  respUInt(linkStats.txBlockedUs / 1000);
+  respChar(':');
+  respUInt(linkStats.rxBacklogMax);
+  respLine("");
+  respSend();
+}
+
+// Index of the power-of-two bucket holding value (bucket i holds < 2^i)
+static inline uint8_t perfBucket(uint32_t value) {
+  uint8_t bucket = value ? 32 - __builtin_clz(value) : 0;
+  return bucket < PERF_BUCKETS ? bucket : PERF_BUCKETS - 1;
 }
+
+void recordLoopTime() {
+  uint32_t now = micros();
+  if (loopCount > 0) {
+    uint32_t period = now - lastLoopMicros;
+    loopHist[perfBucket(period)]++;
+    loopTotalUs += period;
+  }
+  loopCount++;
+  lastLoopMicros = now;
+}
+
+void recordIsrTime(uint32_t cycles) {
+  // Both step ISRs run at the same priority, so they never nest
+  isrHist[perfBucket(cycles >> ISR_HIST_SHIFT)]++;
+  isrCount++;
+  isrTotalCycles += cycles;
+  if (benchActive) {
+    benchIsrCycles += cycles;
+    if (cycles > benchIsrMax) benchIsrMax = cycles;
+  }
+}
+
+void benchPulse(uint8_t axis, uint32_t cycles) {
+  // Worst deviation of a pulse interval from the programmed period
+  if (benchPulses[axis] > 0) {
+    uint32_t interval = cycles - benchLastPulse[axis];
+    uint32_t error = interval > benchPeriodCycles ? interval - benchPeriodCycles : benchPeriodCycles - interval;
+    if (error > benchJitterMax) benchJitterMax = error;
+  }
+  benchLastPulse[axis] = cycles;
+  benchPulses[axis]++;
+}
+
+void runBench() {
+  if (motor1.isRunning || motor2.isRunning || pvtState == PVT_RUN) {
+    Link.println("BENCH refused - stop the motors first");
+    return;
+  }
+  
+  // PERF should describe normal running, so the bench's ISRs are taken
+  // back out afterwards, and so are its steps
+  uint32_t histSaved[PERF_BUCKETS];
+  noInterrupts();
+  memcpy(histSaved, (const void *)isrHist, sizeof(histSaved));
+  uint32_t countSaved = isrCount;
+  uint64_t cyclesSaved = isrTotalCycles;
+  int32_t pos1 = motor1.position;
+  int32_t pos2 = motor2.position;
+  interrupts();
+  
+  float cyclesPerUs = F_CPU_ACTUAL / 1000000.0;
+  uint32_t windowCycles = BENCH_WINDOW_MS * (F_CPU_ACTUAL / 1000);
+  uint32_t maxRate = 0;
+  float cpuAtMaxSpeed = 0;
+  bool allOk = true;
+  Link.println("BENCH:rate:pulses1:pulses2:isr_avg_us:isr_max_us:loop_max_us:jitter_max_us:cpu_pct:ok");
+  
+  for (uint8_t i = 0; i < sizeof(benchRates) / sizeof(benchRates[0]); i++) {
+    uint32_t rate = benchRates[i];
+    noInterrupts();
+    benchPulses[0] = benchPulses[1] = 0;
+    benchJitterMax = benchIsrMax = 0;
+    benchIsrCycles = 0;
+    benchPeriodCycles = F_CPU_ACTUAL / rate;
+    benchActive = true;
+    interrupts();
+    motor1.timer.begin(stepISR_M1, 1000000.0 / rate);
+    motor2.timer.begin(stepISR_M2, 1000000.0 / rate);
+    
+    // Stand-in for idle loop() passes; the longest gap between two is the
+    // latency the ISRs add
+    uint32_t start = ARM_DWT_CYCCNT;
+    uint32_t last = start;
+    uint32_t maxGap = 0;
+    while (ARM_DWT_CYCCNT - start < windowCycles) {
+      uint32_t now = ARM_DWT_CYCCNT;
+      if (now - last > maxGap) maxGap = now - last;
+      last = now;
+      delayMicroseconds(1);
+    }
+    motor1.timer.end();
+    motor2.timer.end();
+    benchActive = false;
+    uint32_t elapsed = ARM_DWT_CYCCNT - start;
+    
+    uint32_t pulses = benchPulses[0] + benchPulses[1];
+    float cpu = benchIsrCycles * 100.0 / elapsed;
+    uint32_t expected = (uint64_t)rate * elapsed / F_CPU_ACTUAL;
+    uint32_t slack = expected / 100 + 2;
+    bool ok = benchPulses[0] + slack >= expected && benchPulses[1] + slack >= expected &&
+              benchJitterMax * 100 <= benchPeriodCycles * BENCH_MAX_JITTER_PCT &&
+              cpu <= BENCH_MAX_CPU_PCT;
+    allOk = allOk && ok;
+    if (allOk) maxRate = rate;
+    if (rate == MAX_SPEED) cpuAtMaxSpeed = cpu;
+    
+    respStr("BENCH:");
+    respUInt(rate);
+    respChar(':');
+    respUInt(benchPulses[0]);
+    respChar(':');
+    respUInt(benchPulses[1]);
+    respChar(':');
+    respFixed(pulses ? benchIsrCycles / pulses / cyclesPerUs : 0, 2);
+    respChar(':');
+    respFixed(benchIsrMax / cyclesPerUs, 2);
+    respChar(':');
+    respFixed(maxGap / cyclesPerUs, 2);
+    respChar(':');
+    respFixed(benchJitterMax / cyclesPerUs, 2);
+    respChar(':');
+    respFixed(cpu, 1);
+    respChar(':');
+    respUInt(ok);
+    respLine("");
+    respSend();
+  }
+  
+  noInterrupts();
+  memcpy((void *)isrHist, histSaved, sizeof(histSaved));
+  isrCount = countSaved;
+  isrTotalCycles = cyclesSaved;
+  motor1.position = pos1;
+  motor2.position = pos2;
+  interrupts();
+  lastLoopMicros = micros();  // Nor should the blocked loop() pass count
+  digitalWrite(M1_PWM_PIN, LOW);
+  digitalWrite(M2_PWM_PIN, LOW);
+  
+  // BENCH:MAX:highest_sustainable_rate:cpu_pct_at_MAX_SPEED
+  respStr("BENCH:MAX:");
+  respUInt(maxRate);
+  respChar(':');
+  respFixed(cpuAtMaxSpeed, 1);
+  respLine("");
+  respSend();
+}
+
+void printPerf() {
+  // PERF:cpu_hz:loops:loop_us_total:b0,b1,...:isrs:isr_cycles_total:b0,b1,...
+  // Counters are cumulative since boot
+  uint32_t isrSnapshot[PERF_BUCKETS];
+  noInterrupts();
+  for (uint8_t i = 0; i < PERF_BUCKETS; i++) {
+    isrSnapshot[i] = isrHist[i];
+  }
+  uint32_t isrs = isrCount;
+  uint64_t isrCycles = isrTotalCycles;
+  interrupts();
+  
+  respStr("PERF:");
+  respUInt(F_CPU_ACTUAL);
+  respChar(':');
+  respUInt(loopCount);
+  respChar(':');
+  respUInt(loopTotalUs);
+  respChar(':');
+  for (uint8_t i = 0; i < PERF_BUCKETS; i++) {
+    if (i) respChar(',');
+    respUInt(loopHist[i]);
+  }
+  respChar(':');
+  respUInt(isrs);
+  respChar(':');
+  respUInt(isrCycles);
+  respChar(':');
+  for (uint8_t i = 0; i < PERF_BUCKETS; i++) {
+    if (i) respChar(',');
+    respUInt(isrSnapshot[i]);
+  }
+  respLine("");
+  respSend();
+}
+
+void printHello(const CmdText &nonce) {
+  // HELLO:nonce:protocol:firmware:queue_depth:line_max:uptime_ms:capabilities
+  // The nonce is echoed so the host can tell this reply from ones to
+  // earlier attempts; uptime tells it whether we rebooted since last time
+  respStr("HELLO:");
+  respText(nonce);
+  respChar(':');
+  respUInt(PROTOCOL_VERSION);
+  respChar(':');
+  respStr(FIRMWARE_VERSION);
+  respChar(':');
+  respUInt(RX_QUEUE_DEPTH);
+  respChar(':');
+  respUInt(RX_LINE_MAX);
+  respChar(':');
+  respUInt(millis());
+  respChar(':');
+  respLine(CAPABILITIES);
+  respSend();
+}
+
+void printPvt() {
+  // PVT:state:buffered:free:points_done
+  static const char *states[] = {"IDLE", "RUN", "DONE", "UNDERFLOW", "ABORTED"};
+  respStr("PVT:");
+  respStr(states[pvtState]);
+  respChar(':');
+  respUInt(pvtCount);
+  respChar(':');
+  respUInt(PVT_DEPTH - pvtCount);
+  respChar(':');
+  respUInt(pvtPointsDone);
+  respLine("");
+  respSend();
+}
+
+// Response builder (see RESP_BUFFER_SIZE)
+
+void respChar(char c) {
+  if (respLen < RESP_BUFFER_SIZE) {
+    respBuf[respLen++] = c;
+  }
+}
+
+void respStr(const char *s) {
+  while (*s && respLen < RESP_BUFFER_SIZE) {
+    respBuf[respLen++] = *s++;
+  }
+}
+
+void respText(const CmdText &text) {
+  for (uint8_t i = 0; i < text.len && respLen < RESP_BUFFER_SIZE; i++) {
+    respBuf[respLen++] = text.ptr[i];
+  }
+}
+
+void respUInt(uint64_t value) {
+  // Digits come out least significant first; 32-bit values stay on the
+  // single-instruction divide, only the PERF totals need 64-bit math
+  char digits[20];
+  uint8_t n = 0;
+  while (value > 0xFFFFFFFFULL) {
+    digits[n++] = '0' + (char)(value % 10);
+    value /= 10;
+  }
+  uint32_t v = (uint32_t)value;
+  do {
+    digits[n++] = '0' + (char)(v % 10);
+    v /= 10;
+  } while (v);
+  while (n) {
+    respChar(digits[--n]);
+  }
+}
+
+void respInt(int32_t value) {
+  if (value < 0) {
+    respChar('-');
+    respUInt((uint32_t)0 - (uint32_t)value);
+  } else {
+    respUInt((uint32_t)value);
+  }
+}
+
+void respFixed(float value, uint8_t decimals) {
+  // Fixed point: scale, round once, then print integer and fraction parts
+  // (same digits as Link.print(float, decimals) for our speed range)
+  static const uint32_t scales[] = {1, 10, 100, 1000, 10000};
+  if (decimals > 4) decimals = 4;
+  uint32_t scale = scales[decimals];
+  if (value < 0) {
+    respChar('-');
+    value = -value;
+  }
+  uint32_t scaled = (uint32_t)(value * scale + 0.5f);
+  respUInt(scaled / scale);
+  if (decimals) {
+    respChar('.');
+    uint32_t frac = scaled % scale;
+    for (uint32_t digit = scale / 10; digit > 0; digit /= 10) {
+      respChar('0' + (char)((frac / digit) % 10));
+    }
+  }
+}
+
+void respLine(const char *s) {
+  respStr(s);
+  respChar('\r');
+  respChar('\n');
+}
+
+void respSend() {
+  Link.write(respBuf, respLen);
+  respLen = 0;
+}
+
+float parseFloat(const char *s, const char **end) {
+  // Decimal number ("-12", "1.5", "2E3") like strtod, which newlib backs
+  // with heap-allocated big numbers; *end is left after the number, or at s
+  // if there is none. Exact for the integers and short fractions we get.
+  const char *p = s;
+  while (*p == ' ') p++;
+  bool negative = *p == '-';
+  if (*p == '-' || *p == '+') p++;
+  double mantissa = 0;
+  int32_t exponent = 0;
+  bool digits = false;
+  for (; *p >= '0' && *p <= '9'; p++, digits = true) {
+    mantissa = mantissa * 10 + (*p - '0');
+  }
+  if (*p == '.') {
+    for (p++; *p >= '0' && *p <= '9'; p++, digits = true) {
+      mantissa = mantissa * 10 + (*p - '0');
+      exponent--;
+    }
+  }
+  if (!digits) {
+    *end = s;
+    return 0;
+  }
+  if (*p == 'E' || *p == 'e') {
+    const char *q = p + 1;
+    bool negativeExp = *q == '-';
+    if (*q == '-' || *q == '+') q++;
+    if (*q >= '0' && *q <= '9') {
+      int32_t e = 0;
+      for (; *q >= '0' && *q <= '9'; q++) {
+        e = min(e * 10 + (*q - '0'), (int32_t)1000);
+      }
+      exponent += negativeExp ? -e : e;
+      p = q;
+    }
+  }
+  *end = p;
+  if (mantissa != 0 && exponent != 0) {
+    double scale = pow(10.0, abs(exponent));
+    mantissa = exponent > 0 ? mantissa * scale : mantissa / scale;
+  }
+  return (float)(negative ? -mantissa : mantissa);
+}
+
+float CmdText::toFloat() const {
+  char buf[RX_LINE_MAX];
+  const char *end;
+  return parseFloat(copyTo(buf), &end);
+}
+
+void printMem() {
+  // MEM:stack_max:stack_size:static_ram:boot_heap_used
+  // Bytes; the stack and static RAM are 0 off the Teensy (host build),
+  // which has no DTCM layout to measure
+  respStr("MEM:");
+#if defined(__IMXRT1062__)
+  respUInt(stackUsed());
+  respChar(':');
+  respUInt((uintptr_t)&_estack - (uintptr_t)&_ebss);
+  respChar(':');
+  respUInt((uintptr_t)&_ebss - (uintptr_t)&_sdata);
+#else
+  respStr("0:0:0");
+#endif
+  respChar(':');
+  respUInt(bootHeapUsed);
+  respLine("");
+  respSend();
+}
+
+void printLink() {
+  // LINK:rx_bytes:tx_bytes:lines:parse_errors:unknown:truncated:dropped:
+  //      rx_backlog_max:tx_writes:tx_stalls:tx_blocked_us:VERB=count,...
+  // Counts since boot; verbs that have not been seen are left out
+  const uint32_t fields[] = {
+    linkStats.rxBytes, linkStats.txBytes, linkStats.lines, linkStats.parseErrors,
+    linkStats.unknown, linkStats.rxTruncated, linkStats.rxDropped, linkStats.rxBacklogMax,
+    linkStats.txWrites, linkStats.txStalls, linkStats.txBlockedUs,
+  };
+  respStr("LINK");
+  for (uint32_t value : fields) {
+    respChar(':');
+    respUInt(value);
+  }
+  respChar(':');
+  
+  bool first = true;
+  for (uint8_t op = OP_UNKNOWN + 1; op < OP_COUNT; op++) {
+    if (linkStats.opcodes[op] == 0) {
+      continue;
+    }
+    for (const Verb &verb : verbs) {
+      if (verb.op == op) {  // Canonical name comes first
+        if (!first) {
+          respChar(',');
+        }
+        respStr(verb.name);
+        respChar('=');
+        respUInt(linkStats.opcodes[op]);
+        first = false;
+        break;
+      }
+    }
+  }
+  respLine("");
+  respSend();
+}
+
+#if defined(__IMXRT1062__)
+
+void stackPaint() {
+  // Everything between the last static variable and our own frame
+  uint32_t *p = (uint32_t *)&_ebss;
+  uint32_t *limit = (uint32_t *)((uintptr_t)__builtin_frame_address(0) - STACK_PAINT_MARGIN);
+  while (p < limit) {
+    *p++ = STACK_PAINT;
+  }
+}
+
+uint32_t stackUsed() {
+  // Deepest the stack (loop, ISRs and all) has reached: the first word
+  // that no longer holds the paint
+  const uint32_t *p = (const uint32_t *)&_ebss;
+  const uint32_t *top = (const uint32_t *)&_estack;
+  while (p < top && *p == STACK_PAINT) {
+    p++;
+  }
+  return (top - p) * sizeof(uint32_t);
+}
+
+void __attribute__((noreturn)) heapTrap(size_t size) {
+  // Stop stepping where we are, say why, and stay here
+  motor1.timer.end();
+  motor2.timer.end();
+  digitalWriteFast(M1_PWM_PIN, LOW);
+  digitalWriteFast(M2_PWM_PIN, LOW);
+  Link.print("HEAP: ");
+  Link.print((uint32_t)size);
+  Link.println(" byte allocation after setup - halted");
+  while (true) {
+    digitalToggleFast(LED_BUILTIN);
+    delay(50);
+  }
+}
+
+void *heapAlloc(size_t size) {
+  // Each block is preceded by its size, so realloc can copy it
+  size_t need = (size + sizeof(size_t) + 7) & ~(size_t)7;
+  if (setupDone || need > BOOT_HEAP_SIZE - bootHeapUsed) {
+    heapTrap(size);
+  }
+  static uint8_t bootHeap[BOOT_HEAP_SIZE] __attribute__((aligned(8)));
+  size_t *block = (size_t *)(bootHeap + bootHeapUsed);
+  bootHeapUsed += need;
+  *block = size;
+  return block + 1;
+}
+
+extern "C" {
+void *malloc(size_t size) { return heapAlloc(size); }
+void free(void *) {}  // The boot pool is never reused
+void *calloc(size_t count, size_t size) {
+  if (size && count > SIZE_MAX / size) heapTrap(SIZE_MAX);
+  void *p = heapAlloc(count * size);
+  memset(p, 0, count * size);
+  return p;
+}
+void *realloc(void *ptr, size_t size) {
+  void *p = heapAlloc(size);
+  if (ptr) {
+    size_t old = ((size_t *)ptr)[-1];
+    memcpy(p, ptr, old < size ? old : size);
+  }
+  return p;
+}
+// newlib's own callers (stdio, strtod, ...) use the reentrant versions
+void *_malloc_r(struct _reent *, size_t size) { return malloc(size); }
+void _free_r(struct _reent *, void *ptr) { free(ptr); }
+void *_calloc_r(struct _reent *, size_t count, size_t size) { return calloc(count, size); }
+void *_realloc_r(struct _reent *, void *ptr, size_t size) { return realloc(ptr, size); }
+}
+
+#else
+
+// The host simulator shares its process, stack and heap with the shim and
+// Python; there is nothing of ours to paint or trap
+void stackPaint() {}
+
+#endif